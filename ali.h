@@ -1,7 +1,12 @@
 //
 // Created by Michal
 //
+#include <cstddef>
 #include <string>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "options.h"
 
 #ifndef MINICPU_ALI_H
 #define MINICPU_ALI_H
@@ -14,14 +19,53 @@ class ALI {
 public:
     Hardware hw;              // Hardware instance
     std::string filename;     // Filename inputted by user for SAL txt file
-    std::string currentLine;  // Current instruction line in file
 
-    // Current index of the memory array
-    // Used to put the Instruction in the correct spot in the memory array
+    // Number of lines loaded, each one took a slot of the memory array
     int currentIndex = 0;
 
+    Program program;       // Decoded program that is actually run
+    bool halted = false;   // Set once HLT has been executed
+
+    // Hardware with memorySize slots in each memory
+    explicit ALI(int memorySize = Hardware::defaultMemorySize) : hw(memorySize) {}
+    ALI(const ALI&) = delete;
+    ALI& operator=(const ALI&) = delete;
+
+    // Deletes the Instruction objects buildInstructions created
+    ~ALI();
+
     // Runs the main command loop and executes all the instructions
     void startExecution();
+
+    // Runs the file given on the command line without any prompts, printing
+    // only what the trace level asks for. Returns the process exit code:
+    // 0 halted, 1 load error, 2 fault, 3 max steps reached, 4 cycle found,
+    // 5 breakpoint or watchpoint hit.
+    int runHeadless(const Options& options);
+
+    // Runs the file like runHeadless, then waits for it to change, applies
+    // the edits to the loaded program (see ProgramSource) and runs it again
+    // from options.resumePc or where it stopped, until the process is
+    // stopped. Returns 1 if the file cannot be loaded the first time.
+    int runWatch(const Options& options);
+
+    // Reads the SAL file through a memory mapping, then decodes and links the
+    // instructions. A precompiled .salb file is loaded without parsing and sets
+    // the memory size it was assembled with. Returns false and sets error if
+    // the program cannot be run.
+    bool loadFile(const std::string& name, std::string& error);
+
+    // Same as loadFile for source already in memory
+    bool loadSource(const char* text, size_t size, std::string& error);
+
+    // Creates the Instruction objects of the loaded program in
+    // instruction_memory. Only the reference engine of the benchmark runs
+    // them; loading does not create them.
+    void buildInstructions();
+
+    // Runs at most budget instructions of the decoded program, printing the
+    // state after each one. Reports a fault if pc reaches an empty slot.
+    ExecStatus run(long long budget);
 };
 //
 // END OF ALI
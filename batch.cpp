@@ -0,0 +1,951 @@
+#include <cstdint>
+#include <cstdio>
+#include <climits>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "loops.h"
+#include "trace.h"
+#include "options.h"
+#include "ali.h"
+#include "jit.h"
+#include "mappedfile.h"
+#include "workpool.h"
+#include "batch.h"
+
+// GCC and Clang on x86 can compile the AVX2 kernels without -mavx2 and pick
+// them at run time. Everywhere else (or with -DMINICPU_NO_AVX2) only the
+// plain kernels are built.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(MINICPU_NO_AVX2)
+#define MINICPU_BATCH_AVX2 1
+#include <immintrin.h>
+#else
+#define MINICPU_BATCH_AVX2 0
+#endif
+
+using namespace std;
+
+//
+// Start of batch helpers
+//
+// Lanes per vector, width of BatchLanes is a multiple of it
+static const int vectorLanes = 8;
+
+// Lanes run together by runBatch. More lanes means fewer runs of the
+// scheduler per lane, fewer means less work on lanes a split group masks out.
+static const int lanesPerBatch = 256;
+
+// Replaces the memory slots in the value with their rows
+static void renumber(LinearValue& value, const unordered_map<int, int>& rows) {
+    if (value.slot >= 0) {
+        value.slot = rows.at(value.slot);
+    }
+    for (int& slot : value.invariants) {
+        slot = rows.at(slot);
+    }
+}
+//
+// End of batch helpers
+//
+
+
+
+//
+// Start of BatchProgram definitions
+//
+BatchProgram::BatchProgram(const Program& source) : program(source) {
+    // Every symbol has its own slot, which becomes its row
+    unordered_map<int, int> slotRows;
+    for (size_t symbol = 0; symbol < program.addresses.size(); symbol++) {
+        slotRows[program.addresses[symbol]] = (int) symbol;
+    }
+    rows = (int) program.symbols.size();
+
+    code = program.code;
+    for (int pc = 0; pc < program.length; pc++) {
+        int opcode = code[pc].opcode;
+        if (opcode == OP_LDA || opcode == OP_LDB || opcode == OP_STR) {
+            code[pc].operand = slotRows.at(code[pc].operand);
+        } else if (!program.fused.empty() && program.fused[pc].opcode == OP_LOOP) {
+            code[pc] = program.fused[pc];
+        }
+    }
+
+    // Loop summaries only name slots the loop body accesses, all of them symbols
+    loops = program.loops;
+    for (LoopSummary& loop : loops) {
+        for (int& slot : loop.inductionSlots) {
+            slot = slotRows.at(slot);
+        }
+        for (int& slot : loop.derivedSlots) {
+            slot = slotRows.at(slot);
+        }
+        for (LinearValue& value : loop.steps) {
+            renumber(value, slotRows);
+        }
+        for (LinearValue& value : loop.derived) {
+            renumber(value, slotRows);
+        }
+        for (LinearValue& value : loop.adds) {
+            renumber(value, slotRows);
+        }
+        renumber(loop.a, slotRows);
+        renumber(loop.b, slotRows);
+    }
+}
+//
+// End of BatchProgram definitions
+//
+
+
+
+//
+// Start of BatchLanes definitions
+//
+BatchLanes::BatchLanes(int lanes, int rows, int symbols)
+    : count(lanes),
+      width((lanes + vectorLanes - 1) / vectorLanes * vectorLanes),
+      a(width, 0), b(width, 0), zero(width, 0), overflow(width, 0),
+      memory((size_t) rows * width, 0),
+      declared((size_t) symbols * width, 0),
+      pc(width, 0), executed(width, 0),
+      status(width, (uint8_t) EXEC_BUDGET) {
+
+    // Padding lanes stay stopped
+    for (int l = 0; l < count; l++) {
+        status[l] = LANE_RUNNING;
+    }
+}
+
+// Copies lane l into the hardware
+void BatchLanes::toHardware(const Program& program, int l, Hardware& hw) const {
+    hw.a = a[l];
+    hw.b = b[l];
+    hw.zero_bit = zero[l] != 0 ? 1 : 0;
+    hw.overflow_bit = overflow[l] != 0 ? 1 : 0;
+    hw.pc = pc[l];
+
+    hw.clearSymbols();
+    for (size_t symbol = 0; symbol < program.symbols.size(); symbol++) {
+        int address = program.addresses[symbol];
+        hw.value_memory[address] = memory[symbol * width + l];
+        if (declared[symbol * width + l] != 0) {
+            hw.symbol_table[program.symbols[symbol]] = address;
+        }
+    }
+}
+
+// Copies the hardware back into lane l
+void BatchLanes::fromHardware(const Program& program, int l, const Hardware& hw) {
+    a[l] = (int32_t) hw.a;
+    b[l] = (int32_t) hw.b;
+    zero[l] = hw.zero_bit != 0 ? -1 : 0;
+    overflow[l] = hw.overflow_bit != 0 ? -1 : 0;
+    pc[l] = hw.pc;
+
+    for (size_t symbol = 0; symbol < program.symbols.size(); symbol++) {
+        memory[symbol * width + l] = (int32_t) hw.value_memory[program.addresses[symbol]];
+        declared[symbol * width + l] = hw.symbol_table.count(program.symbols[symbol]) != 0 ? 1 : 0;
+    }
+}
+//
+// End of BatchLanes definitions
+//
+
+
+
+//
+// Start of batch kernels
+//
+// A kernel set runs one straight line run (no jumps or HLT) for the lanes of
+// mask in [lo, hi), and works out which of them take a branch. Masks and
+// bits are 0 or -1 per lane.
+struct BatchKernels {
+    // Runs code[pc, pc + count) on the masked lanes
+    void (*run)(BatchLanes& lanes, const DecodedInstruction* code, int pc, int count,
+                const int32_t* mask, int lo, int hi);
+
+    // taken = mask & bits, returns the number of lanes in taken
+    int (*branch)(const int32_t* bits, const int32_t* mask, int32_t* taken, int lo, int hi);
+};
+
+// Plain C++ kernels: each lane runs the whole run in scalar registers
+static void runPlain(BatchLanes& lanes, const DecodedInstruction* code, int pc, int count,
+                     const int32_t* mask, int lo, int hi) {
+    const size_t width = lanes.width;
+    int32_t* memory = lanes.memory.data();
+
+    for (int l = lo; l < hi; l++) {
+        if (mask[l] == 0) {
+            continue;
+        }
+
+        int32_t a = lanes.a[l];
+        int32_t b = lanes.b[l];
+        int32_t zero = lanes.zero[l];
+        int32_t overflow = lanes.overflow[l];
+
+        for (int i = pc; i < pc + count; i++) {
+            const int operand = code[i].operand;
+            switch (code[i].opcode) {
+                case OP_DEC:
+                    lanes.declared[operand * width + l] = 1;
+                    break;
+                case OP_LDA:
+                    a = memory[operand * width + l];
+                    break;
+                case OP_LDB:
+                    b = memory[operand * width + l];
+                    break;
+                case OP_LDI:
+                    a = operand;
+                    break;
+                case OP_STR:
+                    memory[operand * width + l] = a;
+                    break;
+                case OP_XCH: {
+                    int32_t temp = a;
+                    a = b;
+                    b = temp;
+                    break;
+                }
+                case OP_ADD: {
+                    // Same rules as addRegisters
+                    long long result = (long long) a + b;
+                    if (result <= -2147483648LL || result >= 2147483647LL) {
+                        overflow = -1;
+                    } else if (result == 0) {
+                        a = 0;
+                        zero = -1;
+                    } else {
+                        a = (int32_t) result;
+                        overflow = 0;
+                        zero = 0;
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        lanes.a[l] = a;
+        lanes.b[l] = b;
+        lanes.zero[l] = zero;
+        lanes.overflow[l] = overflow;
+    }
+}
+
+static int branchPlain(const int32_t* bits, const int32_t* mask, int32_t* taken, int lo, int hi) {
+    int count = 0;
+    for (int l = lo; l < hi; l++) {
+        taken[l] = bits[l] & mask[l];
+        count += taken[l] != 0;
+    }
+    return count;
+}
+
+#if MINICPU_BATCH_AVX2
+// AVX2 kernels: eight lanes per vector, each group of eight runs the whole
+// run in vector registers. Lanes outside the mask keep their values through
+// blends.
+__attribute__((target("avx2")))
+static void runAvx2(BatchLanes& lanes, const DecodedInstruction* code, int pc, int count,
+                    const int32_t* mask, int lo, int hi) {
+    const size_t width = lanes.width;
+    int32_t* memory = lanes.memory.data();
+    const __m256i intMin = _mm256_set1_epi32(INT32_MIN);
+    const __m256i intMax = _mm256_set1_epi32(INT32_MAX);
+    const __m256i zeros = _mm256_setzero_si256();
+
+    for (int l = lo; l < hi; l += vectorLanes) {
+        const __m256i m = _mm256_loadu_si256((const __m256i*) (mask + l));
+        if (_mm256_testz_si256(m, m)) {
+            continue;
+        }
+
+        __m256i a = _mm256_loadu_si256((const __m256i*) (lanes.a.data() + l));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (lanes.b.data() + l));
+        __m256i zero = _mm256_loadu_si256((const __m256i*) (lanes.zero.data() + l));
+        __m256i overflow = _mm256_loadu_si256((const __m256i*) (lanes.overflow.data() + l));
+
+        for (int i = pc; i < pc + count; i++) {
+            const int operand = code[i].operand;
+            switch (code[i].opcode) {
+                case OP_DEC:
+                    for (int k = l; k < l + vectorLanes; k++) {
+                        if (mask[k] != 0) {
+                            lanes.declared[operand * width + k] = 1;
+                        }
+                    }
+                    break;
+                case OP_LDA: {
+                    __m256i value = _mm256_loadu_si256((const __m256i*) (memory + operand * width + l));
+                    a = _mm256_blendv_epi8(a, value, m);
+                    break;
+                }
+                case OP_LDB: {
+                    __m256i value = _mm256_loadu_si256((const __m256i*) (memory + operand * width + l));
+                    b = _mm256_blendv_epi8(b, value, m);
+                    break;
+                }
+                case OP_LDI:
+                    a = _mm256_blendv_epi8(a, _mm256_set1_epi32(operand), m);
+                    break;
+                case OP_STR: {
+                    __m256i* row = (__m256i*) (memory + operand * width + l);
+                    _mm256_storeu_si256(row, _mm256_blendv_epi8(_mm256_loadu_si256(row), a, m));
+                    break;
+                }
+                case OP_XCH: {
+                    __m256i temp = a;
+                    a = _mm256_blendv_epi8(a, b, m);
+                    b = _mm256_blendv_epi8(b, temp, m);
+                    break;
+                }
+                case OP_ADD: {
+                    // The sum of two ints is out of range exactly when the 32 bit
+                    // add overflows or gives INT_MIN or INT_MAX (addRegisters
+                    // treats both ends as overflow)
+                    __m256i result = _mm256_add_epi32(a, b);
+                    __m256i wrapped = _mm256_srai_epi32(
+                        _mm256_and_si256(_mm256_xor_si256(a, result), _mm256_xor_si256(b, result)), 31);
+                    __m256i over = _mm256_or_si256(wrapped, _mm256_or_si256(_mm256_cmpeq_epi32(result, intMin),
+                                                                            _mm256_cmpeq_epi32(result, intMax)));
+                    __m256i isZero = _mm256_andnot_si256(over, _mm256_cmpeq_epi32(result, zeros));
+                    __m256i normal = _mm256_andnot_si256(_mm256_or_si256(over, isZero), m);
+
+                    a = _mm256_blendv_epi8(a, result, _mm256_andnot_si256(over, m));
+                    overflow = _mm256_or_si256(_mm256_andnot_si256(normal, overflow), _mm256_and_si256(over, m));
+                    zero = _mm256_or_si256(_mm256_andnot_si256(normal, zero), _mm256_and_si256(isZero, m));
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        _mm256_storeu_si256((__m256i*) (lanes.a.data() + l), a);
+        _mm256_storeu_si256((__m256i*) (lanes.b.data() + l), b);
+        _mm256_storeu_si256((__m256i*) (lanes.zero.data() + l), zero);
+        _mm256_storeu_si256((__m256i*) (lanes.overflow.data() + l), overflow);
+    }
+}
+
+__attribute__((target("avx2,popcnt")))
+static int branchAvx2(const int32_t* bits, const int32_t* mask, int32_t* taken, int lo, int hi) {
+    int count = 0;
+    for (int l = lo; l < hi; l += vectorLanes) {
+        __m256i lane = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (bits + l)),
+                                        _mm256_loadu_si256((const __m256i*) (mask + l)));
+        _mm256_storeu_si256((__m256i*) (taken + l), lane);
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(lane)));
+    }
+    return count;
+}
+#endif
+
+// Kernels for this CPU, chosen once
+static const BatchKernels& batchKernels() {
+    static const BatchKernels plain = { runPlain, branchPlain };
+#if MINICPU_BATCH_AVX2
+    static const BatchKernels avx2 = { runAvx2, branchAvx2 };
+    static const bool haveAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    if (haveAvx2) {
+        return avx2;
+    }
+#endif
+    return plain;
+}
+//
+// End of batch kernels
+//
+
+
+
+//
+// Start of batch execution definitions
+//
+// Runs every lane until it halts, faults or has executed budget instructions
+void runBatchLanes(const BatchProgram& batch, BatchLanes& lanes, long long budget, Hardware& scratch) {
+    const BatchKernels& kernels = batchKernels();
+    const Program& program = batch.program;
+    const DecodedInstruction* const code = batch.code.data();
+    const int width = lanes.width;
+
+    vector<int32_t> mask(width, 0);
+    vector<int32_t> taken(width, 0);
+    vector<long long> loopMemory(batch.rows);
+
+    // Trying to skip costs a copy of every row per lane, and lanes that
+    // cannot skip once usually cannot on the next iteration either. After an
+    // attempt in which no lane skipped, the back edge of that loop runs as a
+    // plain JMP for a growing number of times. Skipping or not gives the same
+    // results, so this only changes the speed.
+    vector<int> loopBackoff(batch.loops.size(), 0);
+    vector<int> loopWait(batch.loops.size(), 0);
+
+    // The group: lanes of mask in [lo, hi), all at groupPc. Instructions the
+    // group ran since it was formed are added to the lanes when it ends.
+    int groupPc = -1;
+    int groupSize = 0;
+    int lo = 0;
+    int hi = 0;
+    long long groupExecuted = 0;
+    long long groupLeft = 0;  // Smallest budget left of any lane in the group
+    bool groupSparse = false; // Fewer than two lanes per vector the group touches
+
+    // Ends the group, every lane in it at pc with the given status
+    auto endGroup = [&](int pc, uint8_t status) {
+        for (int l = lo; l < hi; l++) {
+            if (mask[l] != 0) {
+                lanes.pc[l] = pc;
+                lanes.executed[l] += groupExecuted;
+                lanes.status[l] = status;
+            }
+        }
+        groupPc = -1;
+    };
+
+    while (true) {
+        if (groupPc < 0) {
+            // Next group: the lanes at the lowest pc. Lanes that took different
+            // branches are behind or ahead of each other and meet again there.
+            groupPc = INT_MAX;
+            for (int l = 0; l < width; l++) {
+                if (lanes.status[l] == LANE_RUNNING && lanes.pc[l] < groupPc) {
+                    groupPc = lanes.pc[l];
+                }
+            }
+            if (groupPc == INT_MAX) {
+                break;
+            }
+
+            groupSize = 0;
+            lo = width;
+            hi = 0;
+            groupLeft = LLONG_MAX;
+            int vectors = 0;
+            for (int l = 0; l < width; l++) {
+                bool member = lanes.status[l] == LANE_RUNNING && lanes.pc[l] == groupPc;
+                mask[l] = member ? -1 : 0;
+                if (member) {
+                    if (groupSize == 0 || l / vectorLanes != (hi - 1) / vectorLanes) {
+                        vectors++;
+                    }
+                    groupSize++;
+                    lo = min(lo, l);
+                    hi = l + 1;
+                    groupLeft = min(groupLeft, budget - lanes.executed[l]);
+                }
+            }
+            lo = lo / vectorLanes * vectorLanes;
+            hi = (hi + vectorLanes - 1) / vectorLanes * vectorLanes;
+            groupExecuted = 0;
+            groupSparse = groupSize < 2 * vectors;
+        }
+
+        const int pc = groupPc;
+        const int length = program.runLength[pc];
+
+        // Empty slot: same as runDecoded, pc stays on it
+        if (length == 0) {
+            endGroup(pc, EXEC_FAULT);
+            continue;
+        }
+
+        // The budget of some lane ends inside this run, or the lanes are so
+        // spread out the vectors would mostly run masked off lanes: every
+        // lane of the group finishes on its own with the scalar engine
+        if (length > groupLeft || groupSparse) {
+            endGroup(pc, LANE_RUNNING);
+            NoTrace trace;
+            for (int l = lo; l < hi; l++) {
+                if (mask[l] == 0) {
+                    continue;
+                }
+                long long left = budget - lanes.executed[l];
+                lanes.toHardware(program, l, scratch);
+                ExecStatus status = runDecoded(scratch, program, left, trace);
+                lanes.fromHardware(program, l, scratch);
+                lanes.executed[l] = budget - left;
+                if (status != EXEC_BUDGET || left == 0) {
+                    lanes.status[l] = (uint8_t) status;
+                }
+            }
+            continue;
+        }
+
+        // Everything up to the jump or HLT that ends the run
+        const DecodedInstruction& last = code[pc + length - 1];
+        const bool ends = endsRun(last.opcode) || last.opcode == OP_LOOP;
+        kernels.run(lanes, code, pc, ends ? length - 1 : length, mask.data(), lo, hi);
+        groupExecuted += length;
+        groupLeft -= length;
+
+        const int next = pc + length;
+        switch (ends ? last.opcode : OP_NONE) {
+            case OP_JMP:
+                groupPc = last.operand;
+                break;
+
+            case OP_JZS:
+            case OP_JVS: {
+                const int32_t* bits = last.opcode == OP_JZS ? lanes.zero.data() : lanes.overflow.data();
+                int count = kernels.branch(bits, mask.data(), taken.data(), lo, hi);
+                if (count == 0) {
+                    groupPc = next;
+                } else if (count == groupSize) {
+                    groupPc = last.operand;
+                } else {
+                    // The group splits, every lane waits at its own pc
+                    for (int l = lo; l < hi; l++) {
+                        if (mask[l] != 0) {
+                            lanes.pc[l] = taken[l] != 0 ? last.operand : next;
+                            lanes.executed[l] += groupExecuted;
+                        }
+                    }
+                    groupPc = -1;
+                }
+                break;
+            }
+
+            case OP_LOOP: {
+                // Skip the iterations of the counted loop lane by lane. Every
+                // lane ends up at the header, so the group stays together; only
+                // the instruction counts differ.
+                const LoopSummary& loop = batch.loops[last.operand];
+                groupPc = loop.header;
+                if (loopWait[last.operand] > 0) {
+                    loopWait[last.operand]--;
+                    break;
+                }
+
+                bool anySkipped = false;
+                groupLeft = LLONG_MAX;
+                for (int l = lo; l < hi; l++) {
+                    if (mask[l] == 0) {
+                        continue;
+                    }
+                    for (int row = 0; row < batch.rows; row++) {
+                        loopMemory[row] = lanes.memory[(size_t) row * width + l];
+                    }
+                    long long a = lanes.a[l];
+                    long long b = lanes.b[l];
+                    int zero = lanes.zero[l] != 0 ? 1 : 0;
+                    int overflow = lanes.overflow[l] != 0 ? 1 : 0;
+                    long long left = budget - lanes.executed[l] - groupExecuted;
+                    long long skipped = skipLoopIterations(loop, loopMemory.data(), a, b, zero, overflow, left);
+                    if (skipped > 0) {
+                        for (int row = 0; row < batch.rows; row++) {
+                            lanes.memory[(size_t) row * width + l] = (int32_t) loopMemory[row];
+                        }
+                        lanes.a[l] = (int32_t) a;
+                        lanes.b[l] = (int32_t) b;
+                        lanes.executed[l] += skipped;
+                        anySkipped = true;
+                    }
+                    groupLeft = min(groupLeft, left - skipped);
+                }
+
+                int& backoff = loopBackoff[last.operand];
+                backoff = anySkipped ? 0 : min(2 * backoff + 1, 1023);
+                loopWait[last.operand] = backoff;
+                break;
+            }
+
+            case OP_HLT:
+                endGroup(next - 1, EXEC_HALTED);
+                break;
+
+            default:
+                groupPc = next;
+                break;
+        }
+    }
+}
+//
+// End of batch execution definitions
+//
+
+
+
+//
+// Start of batch command
+//
+// Splits the line at commas, without the blanks around each field
+static vector<string> splitFields(const char* begin, const char* end) {
+    vector<string> fields;
+    const char* start = begin;
+    for (const char* p = begin; p <= end; p++) {
+        if (p == end || *p == ',') {
+            const char* first = start;
+            const char* last = p;
+            while (first < last && (*first == ' ' || *first == '\t')) {
+                first++;
+            }
+            while (last > first && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) {
+                last--;
+            }
+            fields.emplace_back(first, last);
+            start = p + 1;
+        }
+    }
+    return fields;
+}
+
+// Reads the inputs file: a header line with symbol names, then one line of
+// initial values per run. Sets symbols to the symbol ids of the columns and
+// values to the values, row after row.
+static bool readInputs(const string& filename, const Program& program, vector<int>& symbols,
+                       vector<int32_t>& values, string& error) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        error = "could not open " + filename;
+        return false;
+    }
+
+    const char* p = file.data();
+    const char* const end = p + file.size();
+    int line = 0;
+    bool header = true;
+    while (p < end) {
+        const char* newline = (const char*) memchr(p, '\n', end - p);
+        const char* lineEnd = newline == nullptr ? end : newline;
+        vector<string> fields = splitFields(p, lineEnd);
+        p = lineEnd + 1;
+        line++;
+
+        // Blank lines are skipped
+        if (fields.size() == 1 && fields[0].empty()) {
+            continue;
+        }
+
+        const string where = filename + ": line " + to_string(line) + ": ";
+        if (header) {
+            for (const string& name : fields) {
+                auto symbol = program.symbolIds.find(name);
+                if (symbol == program.symbolIds.end()) {
+                    error = where + "'" + name + "' is not a symbol of the program";
+                    return false;
+                }
+                symbols.push_back(symbol->second);
+            }
+            header = false;
+            continue;
+        }
+
+        if (fields.size() != symbols.size()) {
+            error = where + "expected " + to_string(symbols.size()) + " values";
+            return false;
+        }
+        for (const string& field : fields) {
+            char* stop = nullptr;
+            errno = 0;
+            long long value = strtoll(field.c_str(), &stop, 10);
+            if (field.empty() || *stop != '\0' || errno != 0 || value < INT32_MIN || value > INT32_MAX) {
+                error = where + "'" + field + "' is not a 32 bit integer";
+                return false;
+            }
+            values.push_back((int32_t) value);
+        }
+    }
+
+    if (header) {
+        error = filename + ": no header line with symbol names";
+        return false;
+    }
+    return true;
+}
+
+// Around the runs of a JSON result
+static const char* const jsonBegin = "{\n  \"version\": 1,\n  \"runs\": [";
+static const char* const jsonEnd = "\n  ]\n}\n";
+
+// Final state of one run
+struct BatchResult {
+    std::string error;         // Why the file could not be loaded (nothing else is set then)
+    ExecStatus status = EXEC_HALTED;
+    long long executed = 0;    // Instructions executed
+    int pc = 0;
+    long long a = 0;
+    long long b = 0;
+    int zero = 0;
+    int overflow = 0;
+    vector<long long> memory;  // Value of every symbol, in symbol id order
+};
+
+// Writes the result of run index, named label, as a CSV line or as an
+// element of the JSON runs array
+static void writeResult(ostream& out, const Options& options, size_t index, const string& label,
+                        const vector<string>& symbols, const BatchResult& result) {
+    const char* status = result.error.empty() ? statusName(result.status) : "error";
+
+    if (options.json) {
+        out << (index == 0 ? "\n" : ",\n") << "    {";
+        if (options.batchFiles) {
+            out << "\"file\": ";
+            writeJsonString(out, label);
+        } else {
+            out << "\"run\": " << label;
+        }
+        out << ", \"status\": \"" << status << "\"";
+        if (!result.error.empty()) {
+            out << ", \"error\": ";
+            writeJsonString(out, result.error);
+            out << "}";
+            return;
+        }
+        out << ", \"instructions\": " << result.executed << ", \"pc\": " << result.pc
+            << ", \"a\": " << result.a << ", \"b\": " << result.b
+            << ", \"zero\": " << result.zero << ", \"overflow\": " << result.overflow << ", \"memory\": {";
+        for (size_t symbol = 0; symbol < symbols.size(); symbol++) {
+            out << (symbol == 0 ? "" : ", ");
+            writeJsonString(out, symbols[symbol]);
+            out << ": " << result.memory[symbol];
+        }
+        out << "}}";
+        return;
+    }
+
+    writeCsvField(out, label);
+    out << ',' << status;
+    if (!result.error.empty()) {
+        out << ",,,,,,,,";
+        writeCsvField(out, result.error);
+        out << '\n';
+        return;
+    }
+    out << ',' << result.executed << ',' << result.pc << ',' << result.a << ',' << result.b << ','
+        << result.zero << ',' << result.overflow;
+    if (options.batchFiles) {
+        // Every file has its own symbols: name=value pairs in one field
+        string memory;
+        for (size_t symbol = 0; symbol < symbols.size(); symbol++) {
+            memory += (symbol == 0 ? "" : " ") + symbols[symbol] + "=" + to_string(result.memory[symbol]);
+        }
+        out << ',';
+        writeCsvField(out, memory);
+        out << ",\n";
+    } else {
+        for (long long value : result.memory) {
+            out << ',' << value;
+        }
+        out << '\n';
+    }
+}
+
+// Writes the results of the tasks in task order, whatever order they finish in
+class OrderedOutput {
+public:
+    explicit OrderedOutput(ostream& stream) : out(stream) {}
+
+    // Hands over the output of task index; it is written once all earlier
+    // tasks have handed over theirs
+    void put(size_t index, string text) {
+        lock_guard<mutex> guard(lock);
+        pending[index] = move(text);
+        while (!pending.empty() && pending.begin()->first == next) {
+            out << pending.begin()->second;
+            pending.erase(pending.begin());
+            next++;
+        }
+    }
+
+private:
+    mutex lock;
+    ostream& out;
+    size_t next = 0;                // Task whose output is written next
+    map<size_t, string> pending;    // Finished tasks after it
+};
+
+// Runs the machine with the engine the options ask for
+static ExecStatus runEngine(const Options& options, const JitProgram* jit, Hardware& hw,
+                            const Program& program, long long& left) {
+    NoTrace trace;
+    if (jit != nullptr) {
+        return jit->run(hw, program, left);
+    }
+    if (options.engine == ENGINE_SWITCH) {
+        return runDecoded<NoTrace, false>(hw, program, left, trace);
+    }
+    return runDecoded(hw, program, left, trace);
+}
+
+// Runs every file on its own, one task per file
+static int runFiles(const Options& options, WorkPool& pool, ostream& out) {
+    if (options.json) {
+        out << jsonBegin;
+    } else {
+        out << "file,status,instructions,pc,a,b,zero,overflow,memory,error\n";
+    }
+
+    OrderedOutput ordered(out);
+    atomic<bool> failed(false);
+    pool.run(options.files.size(), [&](int, size_t index) {
+        const string& filename = options.files[index];
+        BatchResult result;
+
+        // Every file gets a machine of its own, there is nothing to share
+        ALI ali(options.memorySize);
+        if (ali.loadFile(filename, result.error)) {
+            Program& program = ali.program;
+            if (!options.fusion || !options.loopSkip) {
+                fuseProgram(program, options.fusion, options.loopSkip);
+            }
+            unique_ptr<JitProgram> jit;
+            if (options.engine == ENGINE_JIT) {
+                jit.reset(new JitProgram(program));
+            }
+
+            long long left = options.maxSteps;
+            Hardware& hw = ali.hw;
+            result.status = runEngine(options, jit.get(), hw, program, left);
+            result.executed = options.maxSteps - left;
+            result.pc = hw.pc;
+            result.a = hw.a;
+            result.b = hw.b;
+            result.zero = hw.zero_bit;
+            result.overflow = hw.overflow_bit;
+            for (int address : program.addresses) {
+                result.memory.push_back(hw.value_memory[address]);
+            }
+        } else {
+            failed = true;
+        }
+
+        ostringstream text;
+        writeResult(text, options, index, filename, ali.program.symbols, result);
+        ordered.put(index, text.str());
+    });
+
+    if (options.json) {
+        out << jsonEnd;
+    }
+    return failed ? 1 : 0;
+}
+
+// Runs options.filename once for every row of the inputs, lanesPerBatch rows per task
+static int runInputs(const Options& options, WorkPool& pool, ostream& out) {
+    ALI ali(options.memorySize);
+    string error;
+    if (!ali.loadFile(options.filename, error)) {
+        cerr << "minicpu: " << options.filename << ": " << error << endl;
+        return 1;
+    }
+    Program& program = ali.program;
+    if (!options.fusion || !options.loopSkip) {
+        fuseProgram(program, options.fusion, options.loopSkip);
+    }
+
+    vector<int> columns;
+    vector<int32_t> values;
+    if (!readInputs(options.batchFile, program, columns, values, error)) {
+        cerr << "minicpu: " << error << endl;
+        return 1;
+    }
+    const size_t runs = columns.empty() ? 0 : values.size() / columns.size();
+
+    // The program is only read while running, so all workers share it
+    BatchProgram batch(program);
+    unique_ptr<JitProgram> jit;
+    if (!options.simd && options.engine == ENGINE_JIT) {
+        jit.reset(new JitProgram(program));
+    }
+
+    if (options.json) {
+        out << jsonBegin;
+    } else {
+        out << "run,status,instructions,pc,a,b,zero,overflow";
+        for (const string& symbol : program.symbols) {
+            out << ',';
+            writeCsvField(out, symbol);
+        }
+        out << '\n';
+    }
+
+    // A machine per worker for the lanes that run on the scalar engine
+    const int memorySize = (int) ali.hw.value_memory.size();
+    vector<unique_ptr<Hardware>> machines;
+    for (int worker = 0; worker < pool.size(); worker++) {
+        machines.emplace_back(new Hardware(memorySize));
+    }
+
+    OrderedOutput ordered(out);
+    const size_t tasks = (runs + lanesPerBatch - 1) / lanesPerBatch;
+    pool.run(tasks, [&](int worker, size_t task) {
+        Hardware& hw = *machines[worker];
+        const size_t first = task * lanesPerBatch;
+        const int count = (int) min(runs - first, (size_t) lanesPerBatch);
+
+        BatchLanes lanes(count, batch.rows, (int) program.symbols.size());
+        for (int l = 0; l < count; l++) {
+            for (size_t column = 0; column < columns.size(); column++) {
+                lanes.memory[(size_t) columns[column] * lanes.width + l] =
+                    values[(first + l) * columns.size() + column];
+            }
+        }
+
+        if (options.simd) {
+            runBatchLanes(batch, lanes, options.maxSteps, hw);
+        } else {
+            // Every run on its own with the normal engine
+            for (int l = 0; l < count; l++) {
+                long long left = options.maxSteps;
+                lanes.toHardware(program, l, hw);
+                lanes.status[l] = (uint8_t) runEngine(options, jit.get(), hw, program, left);
+                lanes.fromHardware(program, l, hw);
+                lanes.executed[l] = options.maxSteps - left;
+            }
+        }
+
+        ostringstream text;
+        BatchResult result;
+        result.memory.resize(program.symbols.size());
+        for (int l = 0; l < count; l++) {
+            result.status = (ExecStatus) lanes.status[l];
+            result.executed = lanes.executed[l];
+            result.pc = lanes.pc[l];
+            result.a = lanes.a[l];
+            result.b = lanes.b[l];
+            result.zero = lanes.zero[l] != 0 ? 1 : 0;
+            result.overflow = lanes.overflow[l] != 0 ? 1 : 0;
+            for (size_t symbol = 0; symbol < program.symbols.size(); symbol++) {
+                result.memory[symbol] = lanes.memory[symbol * lanes.width + l];
+            }
+            writeResult(text, options, first + l, to_string(first + l), program.symbols, result);
+        }
+        ordered.put(task, text.str());
+    });
+
+    if (options.json) {
+        out << jsonEnd;
+    }
+    return 0;
+}
+
+// Runs options.filename for every row of the inputs, or every file of
+// options.files, on all cores and prints the final states in order
+int runBatch(const Options& options) {
+    OutputBuffer buffer(stdout);
+    ostream out(&buffer);
+    WorkPool pool(options.jobs);
+    int code = options.batchFiles ? runFiles(options, pool, out) : runInputs(options, pool, out);
+    out.flush();
+    return code;
+}
+//
+// End of batch command
+//
@@ -0,0 +1,106 @@
+//
+// Created by Michal
+//
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+#include "loops.h"
+#include "options.h"
+
+#ifndef MINICPU_BATCH_H
+#define MINICPU_BATCH_H
+
+//
+// Start of BatchProgram
+//
+class BatchProgram {
+    // A linked program prepared for running many lanes at once. Only the
+    // slots of symbols are ever read or written, so lane memory has one row
+    // per symbol (its id) instead of one per memory slot, and the
+    // LDA/LDB/STR operands and loop summaries are renumbered to those rows.
+public:
+    // Prepares the program after fuseProgram: the counted loops of
+    // Program::fused (OP_LOOP) are kept, everything else is the plain code
+    explicit BatchProgram(const Program& program);
+
+    const Program& program;                // Program the lanes run
+    std::vector<DecodedInstruction> code;  // Plain code with row operands and OP_LOOP back edges
+    std::vector<LoopSummary> loops;        // Program::loops with rows instead of slots
+    int rows = 0;                          // Rows of lane memory (number of symbols)
+};
+//
+// End of BatchProgram
+//
+
+
+
+//
+// Start of BatchLanes
+//
+// Status of a lane that has not stopped yet (the others hold an ExecStatus)
+const uint8_t LANE_RUNNING = 255;
+
+class BatchLanes {
+    // Machine state of a group of lanes, as structure of arrays: lane l of a
+    // register, bit or memory row is element l of its array, so the batch
+    // engine works on eight lanes with one AVX2 instruction.
+    //
+    // Values are 32 bit: LDI loads an int, ADD only keeps results inside the
+    // int range and inputs are checked to be ints, so no value a SAL program
+    // can hold needs more. The bits are 0 or -1 (all bits set).
+public:
+    // count lanes, all at pc 0 with zero registers and memory
+    BatchLanes(int count, int rows, int symbols);
+
+    int count;                   // Lanes in use
+    int width;                   // count rounded up to a whole vector (padding lanes never run)
+    std::vector<int32_t> a;      // Register A
+    std::vector<int32_t> b;      // Register B
+    std::vector<int32_t> zero;   // Zero bit
+    std::vector<int32_t> overflow;  // Overflow bit
+    std::vector<int32_t> memory; // Row r of lane l at r * width + l
+    std::vector<uint8_t> declared;  // Symbol s of lane l at s * width + l, 1 once its DEC ran
+    std::vector<int> pc;         // Program counter
+    std::vector<long long> executed;  // Instructions executed
+    std::vector<uint8_t> status; // LANE_RUNNING or the ExecStatus the lane stopped with
+
+    // Copies lane l into the hardware (registers, bits, symbols and their
+    // slots) so the scalar engines can run it, and back
+    void toHardware(const Program& program, int l, Hardware& hw) const;
+    void fromHardware(const Program& program, int l, const Hardware& hw);
+};
+//
+// End of BatchLanes
+//
+
+
+
+//
+// Start of batch execution
+//
+// Runs every lane until it halts, faults or has executed budget instructions,
+// with the same results runDecoded gives for each lane on its own.
+//
+// Lanes at the same pc form a group that runs one straight line run at a
+// time with the AVX2 kernels (plain C++ on other CPUs), masked to the lanes
+// of the group. A JZS/JVS that not all of them take splits the group; the
+// lanes then wait at their own pc and the group at the lowest pc runs next,
+// so lanes that went different ways join up again where their paths meet.
+// A budget that ends inside a run and counted loops are handled lane by lane
+// with the scalar engine (scratch is its hardware, with the program's memory
+// size).
+void runBatchLanes(const BatchProgram& batch, BatchLanes& lanes, long long budget, Hardware& scratch);
+
+// Runs options.filename once for every row of the options.batchFile inputs,
+// or every file of options.files on its own (options.batchFiles), on
+// options.jobs threads and prints the final state of each run as CSV or JSON,
+// in input order. Returns the process exit code.
+int runBatch(const Options& options);
+//
+// End of batch execution
+//
+
+#endif //MINICPU_BATCH_H
@@ -0,0 +1,410 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#include "hardware.h"
+#include "instructions.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "options.h"
+#include "ali.h"
+#include "jit.h"
+#include "bench.h"
+
+using namespace std;
+
+//
+// Start of benchmark helpers
+//
+// Stream buffer that throws away everything written to it
+class NullBuffer : public streambuf {
+protected:
+    int_type overflow(int_type c) override {
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char*, streamsize count) override {
+        return count;
+    }
+};
+
+// Puts the machine back into the state it has right after loading
+static void resetState(Hardware& hw) {
+    for (auto &e : hw.value_memory) {
+        e = 0;
+    }
+    hw.clearSymbols();
+    hw.a = 0;
+    hw.b = 0;
+    hw.pc = 0;
+    hw.zero_bit = 0;
+    hw.overflow_bit = 0;
+}
+
+// The "a" loop as it was before the decoded engine: a virtual call per
+// instruction and a full state print after each one
+static ExecStatus runReference(Hardware& hw, long long& budget) {
+    while (budget > 0) {
+        if (hw.pc < 0 || hw.pc >= (int) hw.instruction_memory.size()) {
+            return EXEC_FAULT;
+        }
+
+        Instruction* instruction = hw.instruction_memory[hw.pc];
+        if (instruction == nullptr) {
+            return EXEC_FAULT;
+        }
+
+        instruction->execute();
+        budget--;
+
+        if (instruction->printString == "HLT") {
+            return EXEC_HALTED;
+        }
+    }
+    return EXEC_BUDGET;
+}
+
+// Peak resident set size of the whole process so far in kilobytes (not of
+// one engine, the operating system only keeps the maximum), 0 where the
+// platform does not report it
+static long long peakMemoryKb() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+struct BenchResult {
+    long long instructions = 0;       // Instructions executed over all repetitions
+    double seconds = 0;               // Time spent running them
+    ExecStatus status = EXEC_BUDGET;  // How the last repetition ended
+};
+
+// Runs the program with the engine again and again until at least minimum
+// seconds have passed
+template <typename Engine>
+static BenchResult measure(ALI& ali, long long budget, double minimum, Engine engine) {
+    BenchResult result;
+
+    while (result.seconds < minimum) {
+        resetState(ali.hw);
+        long long left = budget;
+
+        auto start = chrono::steady_clock::now();
+        result.status = engine(ali, left);
+        auto end = chrono::steady_clock::now();
+
+        result.instructions += budget - left;
+        result.seconds += chrono::duration<double>(end - start).count();
+    }
+
+    return result;
+}
+
+struct BenchRow {
+    // One engine measured on one program
+    string workload;          // File name or generated workload name
+    long long scale = 0;      // Iterations of the generated workload, 0 for files
+    string engine;            // Engine name
+    double parseSeconds = 0;  // Time to load (parse, decode and link) the program once
+    BenchResult result;       // What the engine did
+    long long peakKb = 0;     // Peak RSS of the process so far, after the engine ran
+};
+
+// Loads the program from source, measures how long loading takes and runs it
+// with every execution engine, adding one row per engine
+static bool benchmarkProgram(const string& workload, long long scale, const string& source,
+                             const Options& options, vector<BenchRow>& rows, string& error) {
+    const double minimum = 0.2;  // Seconds each engine runs at least
+
+    // Loading is short, so it is repeated and averaged
+    double parseSeconds = 0;
+    int loads = 0;
+    while (parseSeconds < minimum / 10 || loads < 10) {
+        ALI loader(options.memorySize);
+
+        auto start = chrono::steady_clock::now();
+        bool loaded = loader.loadSource(source.data(), source.size(), error);
+        auto end = chrono::steady_clock::now();
+
+        if (!loaded) {
+            return false;
+        }
+        parseSeconds += chrono::duration<double>(end - start).count();
+        loads++;
+    }
+    parseSeconds /= loads;
+
+    ALI ali(options.memorySize);
+    ali.loadSource(source.data(), source.size(), error);
+    ali.buildInstructions();
+
+    auto addRow = [&](const string& engine, const BenchResult& result) {
+        BenchRow row;
+        row.workload = workload;
+        row.scale = scale;
+        row.engine = engine;
+        row.parseSeconds = parseSeconds;
+        row.result = result;
+        row.peakKb = peakMemoryKb();
+        rows.push_back(row);
+    };
+
+    // The reference prints the full state after every instruction, so it is
+    // capped to keep the benchmark short. Its output goes nowhere.
+    NullBuffer nothing;
+    streambuf* saved = cout.rdbuf(&nothing);
+    BenchResult reference = measure(ali, min(options.maxSteps, 1000000LL), minimum,
+        [](ALI& machine, long long& left) { return runReference(machine.hw, left); });
+    cout.rdbuf(saved);
+    addRow("reference", reference);
+
+    // The engines run every instruction they count: skipped loop iterations
+    // would count as executed and make the rate say nothing about dispatch
+    Program noSkip = ali.program;
+    fuseProgram(noSkip, true, false);
+    addRow("switch", measure(ali, options.maxSteps, minimum,
+        [&noSkip](ALI& machine, long long& left) {
+            NoTrace trace;
+            return runDecoded<NoTrace, false>(machine.hw, noSkip, left, trace);
+        }));
+
+#if MINICPU_COMPUTED_GOTO
+    addRow("threaded", measure(ali, options.maxSteps, minimum,
+        [&noSkip](ALI& machine, long long& left) {
+            NoTrace trace;
+            return runDecoded<NoTrace, true>(machine.hw, noSkip, left, trace);
+        }));
+#endif
+
+    // Same engine without superinstructions, to see what they gain
+
+    Program unfused = ali.program;
+    unfused.fused.clear();
+    addRow("unfused", measure(ali, options.maxSteps, minimum,
+        [&unfused](ALI& machine, long long& left) {
+            NoTrace trace;
+            return runDecoded(machine.hw, unfused, left, trace);
+        }));
+
+#if MINICPU_JIT
+    JitProgram jit(ali.program);
+    if (jit.ready()) {
+        addRow("jit", measure(ali, options.maxSteps, minimum,
+            [&jit](ALI& machine, long long& left) { return jit.run(machine.hw, machine.program, left); }));
+    }
+#endif
+
+    // What a normal run does: counted loops skipped. Its instructions include
+    // the skipped iterations, so its rate is the effective speed of the run,
+    // not instructions dispatched.
+    addRow("loop-skip", measure(ali, options.maxSteps, minimum,
+        [](ALI& machine, long long& left) {
+            NoTrace trace;
+            return runDecoded(machine.hw, machine.program, left, trace);
+        }));
+
+    return true;
+}
+
+// Writes all rows as one JSON document
+static void printJson(ostream& out, const vector<BenchRow>& rows) {
+    out << "{\n  \"version\": 2,\n  \"results\": [";
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        const BenchRow& row = rows[i];
+        const BenchResult& result = row.result;
+        double perSecond = result.instructions / result.seconds;
+        double nanoseconds = result.instructions > 0 ? result.seconds * 1e9 / result.instructions : 0;
+
+        out << (i == 0 ? "\n" : ",\n") << "    {\"workload\": ";
+        writeJsonString(out, row.workload);
+        out << ", \"scale\": " << row.scale << ", \"engine\": ";
+        writeJsonString(out, row.engine);
+        out << setprecision(6)
+            << ", \"status\": \"" << statusName(result.status) << "\""
+            << ", \"parse_us\": " << row.parseSeconds * 1e6
+            << ", \"instructions\": " << result.instructions
+            << ", \"seconds\": " << result.seconds
+            << ", \"instructions_per_second\": " << perSecond
+            << ", \"ns_per_instruction\": " << nanoseconds
+            << ", \"process_peak_rss_kb\": " << row.peakKb << "}";
+    }
+
+    out << "\n  ]\n}" << endl;
+}
+
+// Prints the rows as a table, with the speedup over the reference engine of
+// the same program
+static void printTable(ostream& out, const vector<BenchRow>& rows) {
+    out << left << setw(20) << "workload" << setw(11) << "engine" << right
+        << setw(11) << "parse us"
+        << setw(16) << "instructions"
+        << setw(10) << "seconds"
+        << setw(12) << "instr/s"
+        << setw(11) << "ns/instr"
+        << setw(12) << "speedup"
+        << setw(13) << "proc peak KB" << endl;
+
+    double baseline = 0;
+    for (const BenchRow& row : rows) {
+        const BenchResult& result = row.result;
+        double perSecond = result.instructions / result.seconds;
+        double nanoseconds = result.instructions > 0 ? result.seconds * 1e9 / result.instructions : 0;
+        if (row.engine == "reference") {
+            baseline = perSecond;
+        }
+
+        string workload = row.workload;
+        if (row.scale > 0) {
+            workload += " " + to_string(row.scale);
+        }
+
+        out << left << setw(20) << workload << setw(11) << row.engine << right << setprecision(4)
+            << setw(11) << row.parseSeconds * 1e6
+            << setw(16) << result.instructions
+            << setw(10) << result.seconds
+            << setw(12) << perSecond
+            << setw(11) << nanoseconds
+            << setw(11) << (baseline > 0 ? perSecond / baseline : 0) << "x"
+            << setw(13) << row.peakKb << endl;
+    }
+}
+
+// Prints the rows in the format the options ask for
+static void printRows(const Options& options, const vector<BenchRow>& rows) {
+    if (options.json) {
+        printJson(cout, rows);
+    } else {
+        printTable(cout, rows);
+    }
+}
+//
+// End of benchmark helpers
+//
+
+
+
+//
+// Start of benchmark workloads
+//
+// Joins the lines into a SAL file
+static string joinLines(const vector<string>& lines) {
+    string source;
+    for (const string& line : lines) {
+        source += line + "\n";
+    }
+    return source;
+}
+
+// tests/test8, 9 and 12: count from 0 up to iterations
+static string countedLoop(long long iterations) {
+    return joinLines({
+        "DEC counter", "DEC limit", "DEC one",
+        "LDI 0", "STR counter", "LDI -" + to_string(iterations), "STR limit", "LDI 1", "STR one",
+        "LDA counter", "LDB one", "ADD", "STR counter",                 // 9
+        "LDA limit", "LDB counter", "ADD", "JZS 18", "JMP 9",
+        "HLT"                                                           // 18
+    });
+}
+
+// tests/test10: outer loop around an inner loop
+static string nestedLoop(long long outer, long long inner) {
+    return joinLines({
+        "DEC outer_counter", "DEC outer_limit", "DEC inner_counter", "DEC inner_limit", "DEC one",
+        "LDI 0", "STR outer_counter", "LDI -" + to_string(outer), "STR outer_limit",
+        "LDI -" + to_string(inner), "STR inner_limit", "LDI 1", "STR one",
+        "LDI 0", "STR inner_counter",                                   // 13
+        "LDA inner_counter", "LDB one", "ADD", "STR inner_counter",     // 15
+        "LDA inner_limit", "LDB inner_counter", "ADD", "JZS 24", "JMP 15",
+        "LDA outer_counter", "LDB one", "ADD", "STR outer_counter",     // 24
+        "LDA outer_limit", "LDB outer_counter", "ADD", "JZS 33", "JMP 13",
+        "HLT"                                                           // 33
+    });
+}
+
+// tests/test11 run until ADD overflows, started over repetitions times
+static string fibonacciUntilOverflow(long long repetitions) {
+    return joinLines({
+        "DEC prev", "DEC curr", "DEC next", "DEC reps", "DEC one",
+        "LDI 1", "STR one", "LDI -" + to_string(repetitions), "STR reps",
+        "LDI 0", "STR prev", "LDI 1", "STR curr",                       // 9
+        "LDA prev", "LDB curr", "ADD", "JVS 23",                        // 13
+        "STR next", "LDA curr", "STR prev", "LDA next", "STR curr", "JMP 13",
+        "LDA reps", "LDB one", "ADD", "STR reps", "JZS 29", "JMP 9",    // 23
+        "HLT"                                                           // 29
+    });
+}
+//
+// End of benchmark workloads
+//
+
+
+
+//
+// Start of benchmark definitions
+//
+// Runs the file with every execution engine and prints the comparison
+int runBenchmark(const Options& options) {
+    ifstream inputFile(options.filename);
+    if (!inputFile.is_open()) {
+        cerr << "minicpu: could not open " << options.filename << endl;
+        return 1;
+    }
+
+    stringstream source;
+    source << inputFile.rdbuf();
+
+    vector<BenchRow> rows;
+    string error;
+    if (!benchmarkProgram(options.filename, 0, source.str(), options, rows, error)) {
+        cerr << "minicpu: " << options.filename << ": " << error << endl;
+        return 1;
+    }
+
+    printRows(options, rows);
+    return 0;
+}
+
+// Runs the generated workloads at every scale from 10^3 to options.scale
+int runBenchmarkSuite(const Options& options) {
+    vector<BenchRow> rows;
+    string error;
+
+    for (long long scale = 1000; scale <= options.scale; scale *= 10) {
+        // A Fibonacci run takes 45 additions before ADD overflows
+        bool done = benchmarkProgram("loop", scale, countedLoop(scale), options, rows, error) &&
+                    benchmarkProgram("nested", scale, nestedLoop(scale / 1000, 1000), options, rows, error) &&
+                    benchmarkProgram("fibonacci", scale, fibonacciUntilOverflow(max(1LL, scale / 45)),
+                                     options, rows, error);
+        if (!done) {
+            cerr << "minicpu: benchmark workload: " << error << endl;
+            return 1;
+        }
+
+        // Progress for long runs, the results come at the end
+        cerr << "minicpu: finished scale " << scale << endl;
+    }
+
+    printRows(options, rows);
+    return 0;
+}
+//
+// End of benchmark definitions
+//
@@ -0,0 +1,30 @@
+//
+// Created by Michal
+//
+
+#include "options.h"
+
+#ifndef MINICPU_BENCH_H
+#define MINICPU_BENCH_H
+
+//
+// Start of benchmark
+//
+// Runs options.filename with every execution engine (the reference
+// Instruction objects, the switch engine and, when the compiler supports it,
+// the threaded engine and the JIT, none of them skipping counted loops, then
+// the threaded engine with loop skipping) and prints load time, instructions
+// per second, ns per instruction, process peak RSS and the speedup over the
+// reference loop, as a table or as JSON (options.json). Returns the process
+// exit code.
+int runBenchmark(const Options& options);
+
+// Same for generated versions of the test programs (counted loop, nested loop
+// and Fibonacci until overflow) at every scale from 10^3 up to options.scale
+// iterations
+int runBenchmarkSuite(const Options& options);
+//
+// End of benchmark
+//
+
+#endif //MINICPU_BENCH_H
@@ -0,0 +1,268 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <utility>
+#include "hardware.h"
+#include "bytecode.h"
+
+using namespace std;
+
+//
+// Start of Opcode definitions
+//
+// Returns the mnemonic of the opcode ("DEC", "LDA", ...)
+const char* opcodeName(int opcode) {
+    static const char* const names[] = {
+        "DEC", "LDA", "LDB", "LDI", "STR", "XCH", "JMP", "JZS", "JVS", "ADD", "HLT", "N/A",
+        "LDA/LDB/ADD/STR", "LDA/LDB/ADD/JZS", "LDA/LDB/ADD/JVS", "LOOP", "BRK"
+    };
+
+    if (opcode < 0 || opcode > OP_BREAK) {
+        return names[OP_NONE];
+    }
+    return names[opcode];
+}
+//
+// End of Opcode definitions
+//
+
+
+
+//
+// Start of HandlerTables definitions
+//
+HandlerTables& HandlerTables::operator=(const HandlerTables&) {
+    clear();
+    return *this;
+}
+
+// Table of labels[code[pc].opcode] for every pc of code
+const void* const* HandlerTables::table(const void* const* labels, int count, const DecodedInstruction* code,
+                                        size_t size) const {
+    lock_guard<mutex> guard(lock);
+
+    vector<const void*>& handlers = tables[make_pair((const void*) labels, (const void*) code)];
+    if (handlers.size() != size) {
+        handlers.resize(size);
+        for (size_t pc = 0; pc < size; pc++) {
+            int opcode = code[pc].opcode;
+            handlers[pc] = labels[opcode >= 0 && opcode < count ? opcode : OP_NONE];
+        }
+    }
+    return handlers.data();
+}
+
+// Drops every table
+void HandlerTables::clear() {
+    lock_guard<mutex> guard(lock);
+    tables.clear();
+}
+//
+// End of HandlerTables definitions
+//
+
+
+
+//
+// Start of Program definitions
+//
+// Returns the id of the symbol, adding it if it is not known yet
+int Program::symbolId(const string& symbol) {
+    auto found = symbolIds.find(symbol);
+    if (found != symbolIds.end()) {
+        return found->second;
+    }
+
+    int id = (int) symbols.size();
+    symbols.push_back(symbol);
+    symbolIds.emplace(symbol, id);
+    return id;
+}
+
+// Recomputes runLength after the code has been changed
+void computeRunLengths(Program& program) {
+    const int size = (int) program.code.size();
+    program.runLength.assign(size, 0);
+    program.handlers.clear();
+    program.fused.clear();
+    program.loops.clear();
+
+    // Walk backwards so every run length is the next one plus one
+    for (int pc = size - 1; pc >= 0; pc--) {
+        int opcode = program.code[pc].opcode;
+
+        if (opcode == OP_NONE || opcode == OP_BREAK) {
+            program.runLength[pc] = 0;
+        } else if (endsRun(opcode) || pc + 1 == size) {
+            program.runLength[pc] = 1;
+        } else {
+            program.runLength[pc] = program.runLength[pc + 1] + 1;
+        }
+    }
+}
+
+// Gives every declared symbol its address in value_memory and replaces the
+// symbol operands of LDA/LDB/STR with those addresses
+bool linkProgram(Hardware& hw, Program& program, string& error) {
+    program.addresses.assign(program.symbols.size(), -1);
+
+    // Allocate in program order, same rule as DEC used to apply at run time:
+    // the first address whose instruction slot is empty (no instruction on
+    // that line, or past the end of the program) and that no other symbol
+    // has taken yet
+    SlotAllocator slots(program.code, program.length, (int) hw.value_memory.size());
+    for (int pc = 0; pc < program.length; pc++) {
+        const DecodedInstruction& decoded = program.code[pc];
+        if (decoded.opcode != OP_DEC || program.addresses[decoded.operand] != -1) {
+            continue;
+        }
+
+        program.addresses[decoded.operand] = slots.allocate();
+        if (program.addresses[decoded.operand] == -1) {
+            error = "line " + to_string(pc + 1) + ": no free memory for symbol '" + program.symbols[decoded.operand] + "'";
+            return false;
+        }
+    }
+
+    // Bind the operands. Every symbol must have been declared somewhere.
+    for (int pc = 0; pc < program.length; pc++) {
+        DecodedInstruction& decoded = program.code[pc];
+        if (decoded.opcode != OP_DEC && decoded.opcode != OP_LDA &&
+            decoded.opcode != OP_LDB && decoded.opcode != OP_STR) {
+            continue;
+        }
+
+        int address = program.addresses[decoded.operand];
+        if (address == -1) {
+            error = "line " + to_string(pc + 1) + ": undefined symbol '" + program.symbols[decoded.operand] + "'";
+            return false;
+        }
+
+        // DEC keeps its symbol id, it needs the name to bind the symbol
+        if (decoded.opcode != OP_DEC) {
+            decoded.operand = address;
+        }
+    }
+
+    fuseProgram(program);
+    return true;
+}
+
+// True if every operand of the linked code points inside the program and memory
+bool checkProgram(const Program& program, int memorySize) {
+    if (program.length < 0 || program.code.size() != (size_t) program.length + 1 ||
+        program.argText.size() != program.code.size() || program.addresses.size() != program.symbols.size() ||
+        program.code[program.length].opcode != OP_NONE) {
+        return false;
+    }
+    for (int address : program.addresses) {
+        if (address < -1 || address >= memorySize) {
+            return false;
+        }
+    }
+
+    for (const DecodedInstruction& instruction : program.code) {
+        int operand = instruction.operand;
+        bool valid;
+        switch (instruction.opcode) {
+            case OP_DEC:
+                valid = operand >= 0 && operand < (int) program.symbols.size() && program.addresses[operand] >= 0;
+                break;
+            case OP_LDA:
+            case OP_LDB:
+            case OP_STR:
+                valid = operand >= 0 && operand < memorySize;
+                break;
+            case OP_JMP:
+            case OP_JZS:
+            case OP_JVS:
+                valid = operand >= 0 && operand <= program.length;
+                break;
+            default:
+                valid = instruction.opcode >= 0 && instruction.opcode <= OP_NONE;
+                break;
+        }
+        if (!valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Builds Program::fused from the linked code
+void fuseProgram(Program& program, bool superinstructions, bool loops) {
+    const vector<DecodedInstruction>& code = program.code;
+    program.fused = code;
+    program.loops.clear();
+    program.handlers.clear();
+
+    // Backward jumps that close a counted loop skip ahead at run time (loops.h)
+    for (int pc = 0; loops && pc < program.length; pc++) {
+        LoopSummary loop;
+        if (code[pc].opcode == OP_JMP && summarizeLoop(program, code[pc].operand, pc, loop)) {
+            program.fused[pc].opcode = OP_LOOP;
+            program.fused[pc].operand = (int) program.loops.size();
+            program.loops.push_back(loop);
+        }
+    }
+
+    // Look for LDA x; LDB y; ADD; followed by STR, JZS or JVS. Only the first
+    // record changes, the superinstruction reads its other operands from the
+    // records after it.
+    for (int pc = 0; superinstructions && pc + 3 < program.length; pc++) {
+        if (code[pc].opcode != OP_LDA || code[pc + 1].opcode != OP_LDB || code[pc + 2].opcode != OP_ADD) {
+            continue;
+        }
+
+        int last = code[pc + 3].opcode;
+        if (last == OP_STR) {
+            program.fused[pc].opcode = OP_ADD_STR;
+        } else if (last == OP_JZS) {
+            program.fused[pc].opcode = OP_ADD_JZS;
+        } else if (last == OP_JVS) {
+            program.fused[pc].opcode = OP_ADD_JVS;
+        } else {
+            continue;
+        }
+
+        pc += 3;  // Continue after the group
+    }
+}
+//
+// End of Program definitions
+//
+
+
+
+//
+// Start of SlotAllocator definitions
+//
+SlotAllocator::SlotAllocator(const vector<DecodedInstruction>& code, int length, int memorySize)
+    : taken(memorySize, 0) {
+    for (int pc = 0; pc < length && pc < memorySize; pc++) {
+        taken[pc] = code[pc].opcode != OP_NONE ? 1 : 0;
+    }
+}
+
+int SlotAllocator::allocate() {
+    while (next < (int) taken.size() && taken[next] != 0) {
+        next++;
+    }
+    if (next == (int) taken.size()) {
+        return -1;
+    }
+    taken[next] = 1;
+    return next++;
+}
+
+bool SlotAllocator::reserve(int slot) {
+    if (slot < 0 || slot >= (int) taken.size() || taken[slot] != 0) {
+        return false;
+    }
+    taken[slot] = 1;
+    return true;
+}
+//
+// End of SlotAllocator definitions
+//
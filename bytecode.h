@@ -0,0 +1,244 @@
+//
+// Created by Michal
+//
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <utility>
+#include "hardware.h"
+#include "loops.h"
+
+#ifndef MINICPU_BYTECODE_H
+#define MINICPU_BYTECODE_H
+
+//
+// Start of Opcode
+//
+// Numeric opcode of every instruction in the decoded program.
+// OP_NONE marks a memory slot that holds no instruction (blank line or
+// past the end of the program); running into it stops execution.
+// The opcodes after OP_NONE are superinstructions made by fuseProgram and
+// OP_BREAK, which only the Debugger's patched copy of a program holds.
+enum Opcode {
+    OP_DEC,
+    OP_LDA,
+    OP_LDB,
+    OP_LDI,
+    OP_STR,
+    OP_XCH,
+    OP_JMP,
+    OP_JZS,
+    OP_JVS,
+    OP_ADD,
+    OP_HLT,
+    OP_NONE,
+    OP_ADD_STR,  // LDA x; LDB y; ADD; STR z
+    OP_ADD_JZS,  // LDA x; LDB y; ADD; JZS n
+    OP_ADD_JVS,  // LDA x; LDB y; ADD; JVS n
+    OP_LOOP,     // JMP back to a counted loop, operand is the index into Program::loops
+    OP_BREAK     // Breakpoint patched over an instruction by the Debugger (debugger.h)
+};
+
+// Returns the mnemonic of the opcode ("DEC", "LDA", ...)
+const char* opcodeName(int opcode);
+
+// True for the instructions that end a straight line run: jumps and HLT
+inline bool endsRun(int opcode) {
+    return opcode == OP_JMP || opcode == OP_JZS || opcode == OP_JVS || opcode == OP_HLT;
+}
+//
+// End of Opcode
+//
+
+
+
+//
+// Start of DecodedInstruction
+//
+struct DecodedInstruction {
+    // Fixed size record of the decoded program. The operand is already an
+    // integer: the jump target for JMP/JZS/JVS, the value for LDI, the symbol
+    // id (index into Program::symbols) for DEC and, once the program is linked,
+    // the value_memory address for LDA/LDB/STR.
+    int opcode;   // One of Opcode
+    int operand;  // Resolved operand, 0 if the instruction has none
+};
+//
+// End of DecodedInstruction
+//
+
+
+
+//
+// Start of OperandText
+//
+class OperandText {
+    // Operand text of every record of a program in one block, with where the
+    // text of each record starts, instead of one std::string per record.
+    // Building, copying or loading it from a file is a few bulk copies
+    // however long the program is.
+public:
+    std::string text;                 // Texts of all records, one after the other
+    std::vector<uint32_t> offsets{0}; // Record pc is text[offsets[pc], offsets[pc + 1])
+
+    // Number of records
+    size_t size() const { return offsets.size() - 1; }
+
+    // Text of the record
+    std::string operator[](size_t pc) const {
+        return std::string(text.data() + offsets[pc], offsets[pc + 1] - offsets[pc]);
+    }
+
+    // Adds the text of the next record
+    void append(const char* begin, size_t length) {
+        text.append(begin, length);
+        offsets.push_back((uint32_t) text.size());
+    }
+    void append(const std::string& record) { append(record.data(), record.size()); }
+};
+//
+// End of OperandText
+//
+
+
+
+//
+// Start of HandlerTables
+//
+class HandlerTables {
+    // Handler addresses of the threaded engines (see runDecoded), one table
+    // per engine instance and code array, each built the first time that
+    // engine runs the program. Building is locked and a table never changes
+    // once built, so machines running the same program on several threads
+    // share them. Copying a program does not copy its tables.
+public:
+    HandlerTables() = default;
+    HandlerTables(const HandlerTables&) {}
+    HandlerTables& operator=(const HandlerTables&);
+
+    // Table of labels[code[pc].opcode] for every pc of code (size records).
+    // labels (count entries) identifies the engine instance.
+    const void* const* table(const void* const* labels, int count, const DecodedInstruction* code,
+                             size_t size) const;
+
+    // Drops every table, the code has changed
+    void clear();
+
+private:
+    mutable std::mutex lock;
+    mutable std::map<std::pair<const void*, const void*>, std::vector<const void*>> tables;
+};
+//
+// End of HandlerTables
+//
+
+
+
+//
+// Start of Program
+//
+class Program {
+    // Program decoded from the SAL source (see parseProgram in loader.h).
+    // The hot data (code) is a dense array; the text of every operand is kept
+    // on the side only so traces print exactly what the Instruction classes print.
+public:
+    // Decoded instructions. Holds one extra OP_NONE record at index length
+    // so running off the end (or jumping outside the program) stops cleanly.
+    std::vector<DecodedInstruction> code;
+
+    // Copy of code where the first record of every LDA/LDB/ADD/STR (or JZS,
+    // JVS) group is replaced by a superinstruction (see fuseProgram). The
+    // other records of the group are left as they are, so jumps into the
+    // middle of a group still work. The JMP at the end of a counted loop
+    // becomes OP_LOOP. Empty if fusion is turned off.
+    std::vector<DecodedInstruction> fused;
+
+    // Counted loops found by fuseProgram, indexed by the OP_LOOP operand
+    std::vector<LoopSummary> loops;
+
+    // Operand text as stored in Instruction::argValue ("N/A" if none)
+    OperandText argText;
+
+    // Symbol names, indexed by symbol id
+    std::vector<std::string> symbols;
+
+    // Symbol id of every name in symbols
+    std::unordered_map<std::string, int> symbolIds;
+
+    // value_memory address of every symbol, indexed by symbol id (set by linkProgram)
+    std::vector<int> addresses;
+
+    // Number of instructions executed when entering the program at pc and
+    // running straight until the next jump or HLT (included) or an empty slot
+    // or breakpoint (not included). The engine checks its budget once per run
+    // with this.
+    std::vector<int> runLength;
+
+    // Threaded engine tables, the only part a running engine writes (see HandlerTables)
+    HandlerTables handlers;
+
+    int length = 0;  // Number of instructions (without the sentinel)
+
+    // Returns the id of the symbol, adding it if it is not known yet
+    int symbolId(const std::string& symbol);
+};
+
+// Recomputes runLength after the code has been changed. Also drops
+// Program::fused, call fuseProgram again once the code is final.
+void computeRunLengths(Program& program);
+
+// True if the linked code is safe to run with memorySize slots: every symbol
+// address and LDA/LDB/STR operand is inside memory, every DEC names a symbol
+// with an address, every jump stays inside the program and the code ends
+// with the sentinel. Used on programs read back from files.
+bool checkProgram(const Program& program, int memorySize);
+
+// Builds Program::fused from the linked code: superinstructions and, for
+// backward JMPs whose loop summarizeLoop can describe, OP_LOOP
+void fuseProgram(Program& program, bool superinstructions = true, bool loops = true);
+
+// Gives every declared symbol its address in value_memory (first address not
+// used by an instruction or an earlier DEC, in program order) and replaces the
+// symbol ids of LDA/LDB/STR with those addresses. Also builds
+// Program::fused. Returns false and sets error if a symbol is used without a
+// DEC or there is no free address left.
+bool linkProgram(Hardware& hw, Program& program, std::string& error);
+//
+// End of Program
+//
+
+
+
+//
+// Start of SlotAllocator
+//
+class SlotAllocator {
+    // Hands out the value_memory slots of the symbols. A slot is free if no
+    // instruction is on that line (or it is past the end of the program) and
+    // no symbol has it yet. Slots are never given back, so everything below
+    // the search position is taken and allocate() costs O(1) amortized: the
+    // whole program links in O(slots + symbols) and the layout is the same as
+    // scanning for the lowest free slot every time.
+public:
+    // All slots of memory with a size of memorySize, minus the lines of code
+    SlotAllocator(const std::vector<DecodedInstruction>& code, int length, int memorySize);
+
+    // Takes the lowest free slot. Returns -1 if there is none left.
+    int allocate();
+
+    // Takes slot if it is free. Returns false if it is not.
+    bool reserve(int slot);
+
+private:
+    std::vector<char> taken;  // Per slot: 1 if code or a symbol is there
+    int next = 0;             // Every slot below next is taken
+};
+//
+// End of SlotAllocator
+//
+
+#endif //MINICPU_BYTECODE_H
@@ -0,0 +1,173 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+#include "mappedfile.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+// First bytes of every checkpoint
+static const char checkpointMagic[8] = "MCSNAP";
+
+
+
+//
+// Start of checkpoint definitions
+//
+// Writes the checkpoint to filename
+bool saveCheckpoint(const string& filename, const Hardware& hw, const Program& program, bool halted,
+                    bool atBreakpoint, string& error) {
+    const uint32_t memorySize = (uint32_t) hw.value_memory.size();
+    const uint32_t codeSize = (uint32_t) program.code.size();
+    const uint32_t symbolCount = (uint32_t) program.symbols.size();
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+    header.version = checkpointVersion;
+    header.headerSize = sizeof(CheckpointHeader);
+    header.a = hw.a;
+    header.b = hw.b;
+    header.pc = hw.pc;
+    header.zeroBit = hw.zero_bit;
+    header.overflowBit = hw.overflow_bit;
+    header.halted = halted ? 1 : 0;
+    header.atBreakpoint = atBreakpoint ? 1 : 0;
+    header.memorySize = memorySize;
+    header.codeSize = codeSize;
+    header.symbolCount = symbolCount;
+
+    // Strings go into one block after the text entries
+    string text;
+    vector<CheckpointSymbol> symbols(symbolCount);
+    for (uint32_t i = 0; i < symbolCount; i++) {
+        symbols[i].address = program.addresses[i];
+        symbols[i].declared = hw.symbol_table.count(program.symbols[i]) != 0 ? 1 : 0;
+        symbols[i].nameOffset = (uint32_t) text.size();
+        symbols[i].nameSize = (uint32_t) program.symbols[i].size();
+        text += program.symbols[i];
+    }
+    vector<CheckpointText> operands(codeSize);
+    for (uint32_t pc = 0; pc < codeSize; pc++) {
+        operands[pc].offset = (uint32_t) text.size();
+        operands[pc].size = program.argText.offsets[pc + 1] - program.argText.offsets[pc];
+        text.append(program.argText.text, program.argText.offsets[pc], operands[pc].size);
+    }
+
+    // Build the file in memory; the header is filled in last
+    string file(sizeof(header), '\0');
+    header.memoryOffset = appendSection(file, hw.value_memory.data(), memorySize * sizeof(int64_t));
+    header.codeOffset = appendSection(file, program.code.data(), codeSize * sizeof(DecodedInstruction));
+    header.symbolsOffset = appendSection(file, symbols.data(), symbols.size() * sizeof(CheckpointSymbol));
+    header.textOffset = appendSection(file, operands.data(), operands.size() * sizeof(CheckpointText));
+    file += text;
+    header.fileSize = file.size();
+    memcpy(&file[0], &header, sizeof(header));
+
+    // Write next to the old checkpoint and replace it only when complete
+    return replaceFile(filename, file, error);
+}
+
+// Replaces the state of the hardware and the program with the checkpoint
+bool restoreCheckpoint(const string& filename, Hardware& hw, Program& program, bool& halted, bool& atBreakpoint,
+                       string& error) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        error = "could not open " + filename;
+        return false;
+    }
+
+    CheckpointHeader header;
+    if (file.size() < sizeof(header)) {
+        error = "not a MiniCPU checkpoint";
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, checkpointMagic, sizeof(header.magic)) != 0) {
+        error = "not a MiniCPU checkpoint";
+        return false;
+    }
+
+    const uint32_t memorySize = header.memorySize;
+    const uint64_t textEntries = header.textOffset + (uint64_t) header.codeSize * sizeof(CheckpointText);
+    if (header.version != checkpointVersion || header.headerSize != sizeof(CheckpointHeader) ||
+        header.fileSize != file.size()) {
+        error = "unsupported or truncated checkpoint";
+        return false;
+    }
+    if (memorySize == 0 || memorySize > (uint32_t) Hardware::maximumMemorySize ||
+        header.codeSize == 0 || header.codeSize > memorySize + 1 ||
+        !file.contains(header.memoryOffset, header.memorySize, sizeof(int64_t)) ||
+        !file.contains(header.codeOffset, header.codeSize, sizeof(DecodedInstruction)) ||
+        !file.contains(header.symbolsOffset, header.symbolCount, sizeof(CheckpointSymbol)) ||
+        !file.contains(header.textOffset, header.codeSize, sizeof(CheckpointText))) {
+        error = "checkpoint does not match this build";
+        return false;
+    }
+
+    // Decode everything into a new program first, so a bad file changes nothing
+    const char* text = file.data() + textEntries;
+    const uint64_t textSize = file.size() - textEntries;
+    Program restored;
+    restored.code.resize(header.codeSize);
+    memcpy(restored.code.data(), file.data() + header.codeOffset, header.codeSize * sizeof(DecodedInstruction));
+    restored.length = (int) header.codeSize - 1;
+
+    vector<CheckpointText> operands(header.codeSize);
+    memcpy(operands.data(), file.data() + header.textOffset, operands.size() * sizeof(CheckpointText));
+    for (uint32_t pc = 0; pc < header.codeSize; pc++) {
+        if ((uint64_t) operands[pc].offset + operands[pc].size > textSize) {
+            error = "checkpoint text is damaged";
+            return false;
+        }
+        restored.argText.append(text + operands[pc].offset, operands[pc].size);
+    }
+
+    vector<CheckpointSymbol> symbols(header.symbolCount);
+    memcpy(symbols.data(), file.data() + header.symbolsOffset, symbols.size() * sizeof(CheckpointSymbol));
+    for (const CheckpointSymbol& symbol : symbols) {
+        if ((uint64_t) symbol.nameOffset + symbol.nameSize > textSize ||
+            symbol.address < -1 || symbol.address >= (int32_t) memorySize) {
+            error = "checkpoint symbols are damaged";
+            return false;
+        }
+        restored.symbols.emplace_back(text + symbol.nameOffset, symbol.nameSize);
+        restored.symbolIds.emplace(restored.symbols.back(), (int) restored.symbols.size() - 1);
+        restored.addresses.push_back(symbol.address);
+    }
+
+    // Every operand has to point inside the program and memory
+    if (!checkProgram(restored, (int) memorySize) || header.pc < 0 || header.pc > restored.length) {
+        error = "checkpoint code is damaged";
+        return false;
+    }
+
+    computeRunLengths(restored);
+    fuseProgram(restored);
+    program = restored;
+
+    // The checkpoint decides the memory size
+    hw.value_memory.resize(memorySize);
+    memcpy(hw.value_memory.data(), file.data() + header.memoryOffset, memorySize * sizeof(int64_t));
+    hw.clearSymbols();
+    for (size_t i = 0; i < symbols.size(); i++) {
+        if (symbols[i].declared != 0) {
+            hw.symbol_table[program.symbols[i]] = symbols[i].address;
+        }
+    }
+    hw.a = header.a;
+    hw.b = header.b;
+    hw.pc = header.pc;
+    hw.zero_bit = header.zeroBit != 0 ? 1 : 0;
+    hw.overflow_bit = header.overflowBit != 0 ? 1 : 0;
+    halted = header.halted != 0;
+    atBreakpoint = header.atBreakpoint != 0;
+    return true;
+}
+//
+// End of checkpoint definitions
+//
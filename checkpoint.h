@@ -0,0 +1,77 @@
+//
+// Created by Michal
+//
+
+#include <cstdint>
+#include <string>
+#include "hardware.h"
+#include "bytecode.h"
+
+#ifndef MINICPU_CHECKPOINT_H
+#define MINICPU_CHECKPOINT_H
+
+//
+// Start of checkpoint files
+//
+// A checkpoint is the whole machine at an instruction boundary: registers,
+// bits, pc, value_memory, symbol_table and the decoded program. The file is a
+// fixed header followed by sections the header points to, each 8 byte aligned,
+// in the byte order of the machine, so restoring maps the file and copies the
+// sections straight into place:
+//     memory   int64 per value_memory slot
+//     code     DecodedInstruction per record (including the sentinel)
+//     symbols  CheckpointSymbol per symbol
+//     text     CheckpointText per record (operand text), then the names and
+//              operand texts the offsets point to
+const uint32_t checkpointVersion = 1;
+
+struct CheckpointHeader {
+    char magic[8];          // "MCSNAP" and zeros
+    uint32_t version;       // checkpointVersion
+    uint32_t headerSize;    // sizeof(CheckpointHeader)
+    int64_t a;              // Register A
+    int64_t b;              // Register B
+    int32_t pc;             // Program counter
+    int32_t zeroBit;        // Zero bit
+    int32_t overflowBit;    // Overflow bit
+    int32_t halted;         // 1 once HLT has been executed
+    uint32_t memorySize;    // Slots in the memory section
+    uint32_t codeSize;      // Records in the code section
+    uint32_t symbolCount;   // Entries in the symbols section
+    int32_t atBreakpoint;   // 1 if the run stopped at a breakpoint at pc
+    uint64_t memoryOffset;  // File offsets of the sections
+    uint64_t codeOffset;
+    uint64_t symbolsOffset;
+    uint64_t textOffset;
+    uint64_t fileSize;      // Size of the whole file
+};
+
+struct CheckpointSymbol {
+    int32_t address;        // value_memory address
+    int32_t declared;       // 1 if DEC has run (the symbol is in symbol_table)
+    uint32_t nameOffset;    // Name, relative to the text section
+    uint32_t nameSize;
+};
+
+struct CheckpointText {
+    uint32_t offset;        // Operand text, relative to the text section
+    uint32_t size;
+};
+
+// Writes the checkpoint to filename (through a temporary file that is renamed,
+// so an interrupted write never leaves a broken checkpoint behind).
+// atBreakpoint: the run stopped at a breakpoint at hw.pc (see Debugger::resumePc).
+// Returns false and sets error if it cannot be written.
+bool saveCheckpoint(const std::string& filename, const Hardware& hw, const Program& program, bool halted,
+                    bool atBreakpoint, std::string& error);
+
+// Replaces the state of the hardware and the program with the checkpoint and
+// builds the fused code again. Returns false and sets error if the file is not
+// a valid checkpoint; the hardware and program are unchanged then.
+bool restoreCheckpoint(const std::string& filename, Hardware& hw, Program& program, bool& halted,
+                       bool& atBreakpoint, std::string& error);
+//
+// End of checkpoint files
+//
+
+#endif //MINICPU_CHECKPOINT_H
@@ -0,0 +1,349 @@
+//
+// Created by Michal
+//
+
+#include <climits>
+#include "bytecode.h"
+#include "engine.h"
+
+#ifndef MINICPU_COMPILETIME_H
+#define MINICPU_COMPILETIME_H
+
+//
+// Start of compile time evaluation
+//
+// Runs a SAL program given as a constexpr string while compiling, so its
+// final state is a constant of the binary:
+//
+//     constexpr char source[] = "DEC x\nLDI 5\nSTR x\nHLT\n";
+//     constexpr auto result = MINICPU_EVALUATE(source, LLONG_MAX);
+//     static_assert(result.status == EXEC_HALTED && result.value("x") == 5, "");
+//
+// The source is parsed with the rules of the loader and every instruction
+// does exactly what the engines (and the Instruction classes) do, ADD with
+// its overflow rule included. A program the loader would reject (a missing
+// operand, an invalid number, an undefined symbol, too little memory) is a
+// compile error. The memory has Hardware::defaultMemorySize slots.
+//
+// Only C++11 constexpr is used: every function is a single return, and the
+// run is split in halves recursively so the recursion is only about
+// log2(steps) deep. It is meant for small fixed programs, the compiler does
+// all the work (--max-steps-like limits such as -fconstexpr-ops-limit apply).
+
+// The source: a constexpr char array without its terminating 0
+struct ConstText {
+    const char* data;
+    int size;
+};
+
+// Decoded instruction of the source, symbols numbered in order of first use
+struct ConstInstruction {
+    int opcode;
+    int operand;
+};
+
+// Index packs to build the arrays (std::index_sequence is C++14)
+template <int... I> struct ConstIndices {};
+template <int N, int... I> struct ConstMakeIndices : ConstMakeIndices<N - 1, N - 1, I...> {};
+template <int... I> struct ConstMakeIndices<0, I...> { typedef ConstIndices<I...> type; };
+
+// End of the line starting at pos
+constexpr int constLineEnd(ConstText text, int pos) {
+    return pos >= text.size || text.data[pos] == '\n' ? pos : constLineEnd(text, pos + 1);
+}
+
+constexpr int constNextLine(ConstText text, int pos) {
+    return constLineEnd(text, pos) + 1;
+}
+
+// Number of lines, counted like parseProgram does (no line after a final '\n')
+constexpr int constLineCount(ConstText text, int pos = 0) {
+    return pos >= text.size ? 0 : 1 + constLineCount(text, constNextLine(text, pos));
+}
+
+// Start of the line with that index
+constexpr int constLineStart(ConstText text, int line, int pos = 0) {
+    return line == 0 || pos >= text.size ? pos : constLineStart(text, line - 1, constNextLine(text, pos));
+}
+
+constexpr int constMnemonic(char x, char y, char z) {
+    return x == 'D' && y == 'E' && z == 'C' ? OP_DEC :
+           x == 'L' && y == 'D' && z == 'A' ? OP_LDA :
+           x == 'L' && y == 'D' && z == 'B' ? OP_LDB :
+           x == 'L' && y == 'D' && z == 'I' ? OP_LDI :
+           x == 'S' && y == 'T' && z == 'R' ? OP_STR :
+           x == 'X' && y == 'C' && z == 'H' ? OP_XCH :
+           x == 'J' && y == 'M' && z == 'P' ? OP_JMP :
+           x == 'J' && y == 'Z' && z == 'S' ? OP_JZS :
+           x == 'J' && y == 'V' && z == 'S' ? OP_JVS :
+           x == 'A' && y == 'D' && z == 'D' ? OP_ADD :
+           x == 'H' && y == 'L' && z == 'T' ? OP_HLT : OP_NONE;
+}
+
+// Opcode of the line at pos, OP_NONE if it does not start with a mnemonic
+constexpr int constOpcode(ConstText text, int pos) {
+    return constLineEnd(text, pos) - pos < 3 ? OP_NONE :
+           constMnemonic(text.data[pos], text.data[pos + 1], text.data[pos + 2]);
+}
+
+constexpr bool constUsesSymbol(int opcode) {
+    return opcode == OP_DEC || opcode == OP_LDA || opcode == OP_LDB || opcode == OP_STR;
+}
+
+constexpr bool constHasOperand(int opcode) {
+    return opcode != OP_NONE && opcode != OP_XCH && opcode != OP_ADD && opcode != OP_HLT;
+}
+
+constexpr int constFindSpace(ConstText text, int pos, int end) {
+    return pos >= end || text.data[pos] == ' ' ? pos : constFindSpace(text, pos + 1, end);
+}
+
+// Start of the operand of the line at pos (after the first space), past
+// the end of the line if there is no space
+constexpr int constOperand(ConstText text, int pos) {
+    return constFindSpace(text, pos, constLineEnd(text, pos)) + 1;
+}
+
+constexpr bool constSameName(const char* x, int xSize, const char* y, int ySize) {
+    return xSize == ySize && (xSize == 0 || (*x == *y && constSameName(x + 1, xSize - 1, y + 1, ySize - 1)));
+}
+
+constexpr int constNameSize(const char* name) {
+    return *name == 0 ? 0 : 1 + constNameSize(name + 1);
+}
+
+// True if the line at pos is one of the opcodes and names the symbol
+constexpr bool constNames(ConstText text, int pos, bool decOnly, const char* name, int size) {
+    return (decOnly ? constOpcode(text, pos) == OP_DEC : constUsesSymbol(constOpcode(text, pos))) &&
+           constOperand(text, pos) <= constLineEnd(text, pos) &&
+           constSameName(text.data + constOperand(text, pos), constLineEnd(text, pos) - constOperand(text, pos),
+                         name, size);
+}
+
+// Start of the first line (from pos on) that uses (or declares) the symbol, -1 if none
+constexpr int constFirstUse(ConstText text, bool decOnly, const char* name, int size, int pos = 0) {
+    return pos >= text.size ? -1 :
+           constNames(text, pos, decOnly, name, size) ? pos :
+           constFirstUse(text, decOnly, name, size, constNextLine(text, pos));
+}
+
+// True if the line at pos is the first one to use (or declare) its symbol
+constexpr bool constFirstAt(ConstText text, bool decOnly, int pos) {
+    return (decOnly ? constOpcode(text, pos) == OP_DEC : constUsesSymbol(constOpcode(text, pos))) &&
+           constOperand(text, pos) <= constLineEnd(text, pos) &&
+           constFirstUse(text, decOnly, text.data + constOperand(text, pos),
+                         constLineEnd(text, pos) - constOperand(text, pos)) == pos;
+}
+
+// Number of symbols first used (or declared) on the lines from pos to limit
+constexpr int constSymbolsBetween(ConstText text, bool decOnly, int pos, int limit) {
+    return pos >= limit || pos >= text.size ? 0 :
+           (constFirstAt(text, decOnly, pos) ? 1 : 0) + constSymbolsBetween(text, decOnly, constNextLine(text, pos), limit);
+}
+
+// Symbol id of the name (ids in order of first use, like Program::symbolId)
+constexpr int constSymbolId(ConstText text, const char* name, int size) {
+    return constFirstUse(text, false, name, size) < 0 ? throw "no such symbol" :
+           constSymbolsBetween(text, false, 0, constFirstUse(text, false, name, size));
+}
+
+// Start of the line where the symbol with that id is first used
+constexpr int constSymbolLine(ConstText text, int symbol, int pos = 0) {
+    return constFirstAt(text, false, pos) ? (symbol == 0 ? pos : constSymbolLine(text, symbol - 1, constNextLine(text, pos))) :
+           constSymbolLine(text, symbol, constNextLine(text, pos));
+}
+
+constexpr int constInstructionLines(ConstText text, int pos = 0) {
+    return pos >= text.size ? 0 :
+           (constOpcode(text, pos) != OP_NONE ? 1 : 0) + constInstructionLines(text, constNextLine(text, pos));
+}
+
+// Numbers, with the rules of parseNumber
+constexpr bool constBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+constexpr int constSkipBlanks(ConstText text, int pos, int end) {
+    return pos < end && constBlank(text.data[pos]) ? constSkipBlanks(text, pos + 1, end) : pos;
+}
+
+constexpr int constDigitsEnd(ConstText text, int pos, int end) {
+    return pos < end && text.data[pos] >= '0' && text.data[pos] <= '9' ? constDigitsEnd(text, pos + 1, end) : pos;
+}
+
+// Value of the digits, stops once it is too large for an int anyway
+constexpr long long constMagnitude(ConstText text, int pos, int end, long long value) {
+    return pos >= end || text.data[pos] < '0' || text.data[pos] > '9' || value > (long long) INT_MAX + 1 ? value :
+           constMagnitude(text, pos + 1, end, value * 10 + (text.data[pos] - '0'));
+}
+
+constexpr int constCheckedNumber(long long value, bool valid) {
+    return valid && value <= INT_MAX ? (int) value : throw "invalid number";
+}
+
+constexpr int constNumberDigits(ConstText text, bool negative, int digits, int end) {
+    return constCheckedNumber(negative ? -constMagnitude(text, digits, end, 0) : constMagnitude(text, digits, end, 0),
+                              constDigitsEnd(text, digits, end) != digits &&
+                              constMagnitude(text, digits, end, 0) <= (long long) INT_MAX + 1 &&
+                              constSkipBlanks(text, constDigitsEnd(text, digits, end), end) == end);
+}
+
+constexpr int constNumberSign(ConstText text, int sign, int end) {
+    return constNumberDigits(text, sign < end && text.data[sign] == '-',
+                             sign < end && (text.data[sign] == '-' || text.data[sign] == '+') ? sign + 1 : sign, end);
+}
+
+constexpr int constNumber(ConstText text, int begin, int end) {
+    return constNumberSign(text, constSkipBlanks(text, begin, end), end);
+}
+
+// Operand of a line that uses a symbol
+constexpr int constSymbolOperand(ConstText text, int pos) {
+    return constOperand(text, pos) == constLineEnd(text, pos) ? throw "instruction needs a symbol" :
+           constFirstUse(text, true, text.data + constOperand(text, pos),
+                         constLineEnd(text, pos) - constOperand(text, pos)) < 0 ? throw "undefined symbol" :
+           constSymbolId(text, text.data + constOperand(text, pos), constLineEnd(text, pos) - constOperand(text, pos));
+}
+
+// Jumps outside the program go to the sentinel record
+constexpr int constTarget(int target, int lines) {
+    return target < 0 || target > lines ? lines : target;
+}
+
+constexpr ConstInstruction constDecodeOpcode(ConstText text, int pos, int opcode, int lines) {
+    return !constHasOperand(opcode) ? ConstInstruction{opcode, 0} :
+           constOperand(text, pos) > constLineEnd(text, pos) ? throw "instruction needs an operand" :
+           constUsesSymbol(opcode) ? ConstInstruction{opcode, constSymbolOperand(text, pos)} :
+           opcode == OP_LDI ? ConstInstruction{opcode, constNumber(text, constOperand(text, pos), constLineEnd(text, pos))} :
+           ConstInstruction{opcode, constTarget(constNumber(text, constOperand(text, pos), constLineEnd(text, pos)), lines)};
+}
+
+constexpr ConstInstruction constDecodeLine(ConstText text, int pos, int lines) {
+    return constDecodeOpcode(text, pos, constOpcode(text, pos), lines);
+}
+
+// The checks of parseProgram and linkProgram on the sizes
+constexpr bool constFits(ConstText text, int lines) {
+    return lines > Hardware::defaultMemorySize ? throw "program does not fit in memory" :
+           constSymbolsBetween(text, true, 0, text.size) > Hardware::defaultMemorySize - constInstructionLines(text) ?
+           throw "no free memory for the symbols" : true;
+}
+
+// The decoded program, with the sentinel at index N
+template <int N>
+struct ConstProgram {
+    ConstInstruction code[N + 1];
+};
+
+template <int N, int... I>
+constexpr ConstProgram<N> constDecode(ConstText text, ConstIndices<I...>) {
+    return ConstProgram<N>{{constDecodeLine(text, constLineStart(text, I), N)..., ConstInstruction{OP_NONE, 0}}};
+}
+
+// Machine state, and the final state evaluateConst returns
+template <int N>
+struct ConstState {
+    ConstText text;
+    long long a;
+    long long b;
+    int zero_bit;
+    int overflow_bit;
+    int pc;
+    long long executed;
+    ExecStatus status;        // EXEC_BUDGET while it is still running
+    long long memory[N + 1];  // Value of every symbol, by symbol id
+    bool declared[N + 1];     // The symbol's DEC has run (it is in symbol_table)
+
+    // Number of symbols, and the name of each (ids in order of first use)
+    constexpr int symbols() const { return constSymbolsBetween(text, false, 0, text.size); }
+    constexpr ConstText symbolName(int symbol) const {
+        return ConstText{text.data + constOperand(text, constSymbolLine(text, symbol)),
+                         constLineEnd(text, constSymbolLine(text, symbol)) - constOperand(text, constSymbolLine(text, symbol))};
+    }
+
+    // Value of the symbol, and whether its DEC has run
+    constexpr long long value(const char* name) const {
+        return memory[constSymbolId(text, name, constNameSize(name))];
+    }
+    constexpr bool isDeclared(const char* name) const {
+        return declared[constSymbolId(text, name, constNameSize(name))];
+    }
+};
+
+// The state after one instruction; stored and declared are symbol ids or -1
+template <int N, int... I>
+constexpr ConstState<N> constNext(const ConstState<N>& state, ConstIndices<I...>, long long a, long long b, int zero,
+                                  int overflow, int pc, long long executed, ExecStatus status, int stored,
+                                  int declared) {
+    return ConstState<N>{state.text, a, b, zero, overflow, pc, executed, status,
+                         {(I == stored ? a : state.memory[I])...},
+                         {(I == declared || state.declared[I])...}};
+}
+
+// ADD with the rules of addRegisters: only the overflow bit changes if the
+// result is out of range, a zero result keeps the overflow bit
+constexpr bool constAddOverflows(long long result) {
+    return result <= -2147483648LL || result >= 2147483647LL;
+}
+
+template <int N>
+constexpr ConstState<N> constAdd(const ConstState<N>& state, long long result) {
+    return constNext(state, typename ConstMakeIndices<N + 1>::type(),
+                     constAddOverflows(result) ? state.a : result, state.b,
+                     constAddOverflows(result) ? state.zero_bit : result == 0 ? 1 : 0,
+                     constAddOverflows(result) ? 1 : result == 0 ? state.overflow_bit : 0,
+                     state.pc + 1, state.executed + 1, EXEC_BUDGET, -1, -1);
+}
+
+// Runs the instruction at pc
+template <int N>
+constexpr ConstState<N> constStep(const ConstState<N>& state, ConstInstruction instruction) {
+    return instruction.opcode == OP_NONE ?
+               constNext(state, typename ConstMakeIndices<N + 1>::type(), state.a, state.b, state.zero_bit,
+                         state.overflow_bit, state.pc, state.executed, EXEC_FAULT, -1, -1) :
+           instruction.opcode == OP_ADD ? constAdd(state, state.a + state.b) :
+           constNext(state, typename ConstMakeIndices<N + 1>::type(),
+                     instruction.opcode == OP_LDA ? state.memory[instruction.operand] :
+                     instruction.opcode == OP_LDI ? (long long) instruction.operand :
+                     instruction.opcode == OP_XCH ? state.b : state.a,
+                     instruction.opcode == OP_LDB ? state.memory[instruction.operand] :
+                     instruction.opcode == OP_XCH ? state.a : state.b,
+                     state.zero_bit, state.overflow_bit,
+                     instruction.opcode == OP_HLT ? state.pc :
+                     instruction.opcode == OP_JMP ||
+                     (instruction.opcode == OP_JZS && state.zero_bit != 0) ||
+                     (instruction.opcode == OP_JVS && state.overflow_bit != 0) ? instruction.operand : state.pc + 1,
+                     state.executed + 1, instruction.opcode == OP_HLT ? EXEC_HALTED : EXEC_BUDGET,
+                     instruction.opcode == OP_STR ? instruction.operand : -1,
+                     instruction.opcode == OP_DEC ? instruction.operand : -1);
+}
+
+// Runs at most steps instructions. Splitting the budget in halves keeps the
+// recursion about log2(steps) deep. An empty slot stops the run even when
+// the budget is used up, as in the engines.
+template <int N>
+constexpr ConstState<N> constRun(const ConstProgram<N>& program, const ConstState<N>& state, long long steps) {
+    return state.status != EXEC_BUDGET ? state :
+           steps == 0 ? (program.code[state.pc].opcode == OP_NONE ? constStep(state, program.code[state.pc]) : state) :
+           steps == 1 ? constStep(state, program.code[state.pc]) :
+           constRun(program, constRun(program, state, steps / 2), steps - steps / 2);
+}
+
+// Loads and runs the source with N lines for at most maxSteps instructions
+template <int N>
+constexpr ConstState<N> evaluateConst(ConstText text, long long maxSteps) {
+    return constFits(text, N) ?
+           constRun(constDecode<N>(text, typename ConstMakeIndices<N>::type()),
+                    ConstState<N>{text, 0, 0, 0, 0, 0, 0, EXEC_BUDGET, {}, {}}, maxSteps) :
+           throw "program cannot be loaded";
+}
+
+// Final state of the SAL program in the constexpr char array source
+#define MINICPU_EVALUATE(source, maxSteps)                                                  \
+    evaluateConst<constLineCount(ConstText{(source), (int) sizeof(source) - 1})>(           \
+        ConstText{(source), (int) sizeof(source) - 1}, (maxSteps))
+//
+// End of compile time evaluation
+//
+
+#endif //MINICPU_COMPILETIME_H
@@ -0,0 +1,195 @@
+#include <climits>
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "cycles.h"
+
+using namespace std;
+
+//
+// Start of cycle detector helpers
+//
+// Runs the plain code with one call per instruction, so counted loops are
+// not skipped, and stops when the state comes back to the one it started in
+struct CycleRound {
+    static const bool enabled = true;
+    static const bool backEdges = true;
+
+    const Program& program;
+    int pc;
+    long long a;
+    long long b;
+    int zero;
+    int overflow;
+    vector<long long> memory;
+
+    CycleRound(const Hardware& hw, const Program& code)
+        : program(code), pc(hw.pc), a(hw.a), b(hw.b), zero(hw.zero_bit), overflow(hw.overflow_bit) {
+        for (int address : program.addresses) {
+            memory.push_back(hw.value_memory[address]);
+        }
+    }
+
+    void step(const Hardware&, const Program&, int) {}
+
+    bool backEdge(const Hardware& hw, const Program&, long long) {
+        if (hw.pc != pc || hw.a != a || hw.b != b || hw.zero_bit != zero || hw.overflow_bit != overflow) {
+            return true;
+        }
+        for (size_t symbol = 0; symbol < memory.size(); symbol++) {
+            if (hw.value_memory[program.addresses[symbol]] != memory[symbol]) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+//
+// End of cycle detector helpers
+//
+
+
+
+//
+// Start of CycleDetector definitions
+//
+CycleDetector::CycleDetector(const Hardware& hw, const Program& program) {
+    save(hw, program, initial);
+}
+
+// Instructions executed before the next run
+void CycleDetector::startRun(long long executedBefore) {
+    base = executedBefore;
+}
+
+// Copies the registers, bits and symbol slots of hw
+void CycleDetector::save(const Hardware& hw, const Program& program, State& state) {
+    state.pc = hw.pc;
+    state.a = hw.a;
+    state.b = hw.b;
+    state.zero = hw.zero_bit;
+    state.overflow = hw.overflow_bit;
+    state.memory.resize(program.addresses.size());
+    for (size_t symbol = 0; symbol < program.addresses.size(); symbol++) {
+        state.memory[symbol] = hw.value_memory[program.addresses[symbol]];
+    }
+}
+
+// Puts the registers, bits and symbol slots back (no other slot is ever written)
+void CycleDetector::load(const State& state, Hardware& hw, const Program& program) {
+    hw.pc = state.pc;
+    hw.a = state.a;
+    hw.b = state.b;
+    hw.zero_bit = state.zero;
+    hw.overflow_bit = state.overflow;
+    for (size_t symbol = 0; symbol < state.memory.size(); symbol++) {
+        hw.value_memory[program.addresses[symbol]] = state.memory[symbol];
+    }
+}
+
+// True if hw is in the state
+bool CycleDetector::isState(const Hardware& hw, const Program& program, const State& state) {
+    // The registers almost always differ, so most back edges cost a few compares
+    if (hw.pc != state.pc || hw.a != state.a || hw.b != state.b ||
+        hw.zero_bit != state.zero || hw.overflow_bit != state.overflow) {
+        return false;
+    }
+    for (size_t symbol = 0; symbol < state.memory.size(); symbol++) {
+        if (hw.value_memory[program.addresses[symbol]] != state.memory[symbol]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false once the state at this back edge is one seen before
+bool CycleDetector::backEdge(const Hardware& hw, const Program& program, long long executed) {
+    if (haveSaved) {
+        since++;
+        if (isState(hw, program, saved)) {
+            found = true;
+            pc = hw.pc;
+            entered = saved.executed;  // Only a bound until measure
+            length = base + executed - saved.executed;  // Exact unless loops were skipped (measure)
+            return false;
+        }
+        if (since < power) {
+            return true;
+        }
+        power *= 2;
+    }
+
+    // Save this state
+    haveSaved = true;
+    since = 0;
+    save(hw, program, saved);
+    saved.executed = base + executed;
+    return true;
+}
+
+// Works out the exact length of the cycle and where it is entered
+void CycleDetector::measure(Hardware& hw, const Program& program) {
+    if (!found) {
+        return;
+    }
+
+    // One round is at most what the detection run saw between the two states
+    CycleRound round(hw, program);
+    long long left = length;
+    if (runDecoded(hw, program, left, round) == EXEC_STOPPED) {
+        length -= left;
+    }
+
+    // hw is in the saved state again after the round
+    findEntry(hw, program);
+    load(saved, hw, program);
+}
+
+// Binary search for the first state that comes back length instructions later
+void CycleDetector::findEntry(Hardware& hw, const Program& program) {
+    // Once a state comes back after one round, every later one does too, and
+    // the saved state does. So the entry is at most saved.executed
+    // instructions into the run. A probe starts from the latest state known
+    // to be before the entry, so all probes together run about saved.executed
+    // instructions plus a round each, on the fused engine with loop skipping
+    // (also after --no-loop-skip, the search is not part of the run).
+    Program fused = program;
+    fuseProgram(fused);
+
+    State from = initial;
+    long long at = 0;                    // Instructions before from
+    long long low = 0;
+    long long high = saved.executed;
+    State middle;
+    NoTrace trace;
+
+    while (low < high) {
+        long long mid = low + (high - low) / 2;
+
+        load(from, hw, program);
+        long long left = mid - at;
+        runDecoded(hw, fused, left, trace);
+        save(hw, program, middle);
+        left = length;
+        runDecoded(hw, fused, left, trace);
+
+        if (isState(hw, program, middle)) {
+            high = mid;
+        } else {
+            low = mid + 1;
+            from = middle;
+            at = mid;
+        }
+    }
+
+    // Run to the entry for its pc
+    load(from, hw, program);
+    long long left = low - at;
+    runDecoded(hw, fused, left, trace);
+    pc = hw.pc;
+    entered = low;
+}
+//
+// End of CycleDetector definitions
+//
@@ -0,0 +1,93 @@
+//
+// Created by Michal
+//
+
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+
+#ifndef MINICPU_CYCLES_H
+#define MINICPU_CYCLES_H
+
+//
+// Start of CycleDetector
+//
+class CycleDetector {
+    // Back edge hook (see runDecoded) that stops a run which can never end.
+    // The machine is deterministic and its state is small (pc, registers,
+    // bits and the slots of the symbols, the only slots STR can write), so
+    // once a state comes back the run repeats the same cycle forever.
+    //
+    // Every loop goes through a back edge, so states are only looked at
+    // there, with Brent's algorithm: one saved state is compared with every
+    // later one, and replaced after 1, 2, 4, 8, ... back edges. A cycle of
+    // n back edges is found within about twice the back edges it takes to
+    // enter it plus 2n. The registers are compared first and the symbol slots
+    // only when they are equal, so nearly every back edge costs a few
+    // compares and a match is never a guess.
+    //
+    // The state Brent's algorithm matched is somewhere inside the cycle, not
+    // where the program enters it. measure() finds the entry afterwards.
+public:
+    static const bool enabled = false;  // No per instruction calls, the fused engine runs
+    static const bool backEdges = true;
+
+    // hw: the state the first run the hook is used in starts from
+    CycleDetector(const Hardware& hw, const Program& program);
+
+    // Instructions executed before the next run (call it before every run
+    // after the first, runDecoded only tells the hook about its own run)
+    void startRun(long long executedBefore);
+
+    void step(const Hardware&, const Program&, int) {}
+
+    // Returns false once the state at this back edge is one seen before
+    bool backEdge(const Hardware& hw, const Program& program, long long executed);
+
+    // After the run stopped: works out the exact length of the cycle by
+    // running one round of it on the plain code (without loop skipping) from
+    // the state it stopped in, then where the program enters the cycle. hw
+    // ends up in the state it stopped in again.
+    void measure(Hardware& hw, const Program& program);
+
+    bool found = false;     // The run was stopped in a cycle
+    int pc = 0;             // pc of the first state of the cycle (after measure)
+    long long entered = 0;  // Instructions executed before the first state of the cycle (after measure)
+    long long length = 0;   // Instructions per round of the cycle (after measure)
+
+private:
+    struct State {
+        int pc = 0;
+        long long a = 0;
+        long long b = 0;
+        int zero = 0;
+        int overflow = 0;
+        std::vector<long long> memory;  // Slot of every symbol
+        long long executed = 0;
+    };
+
+    State initial;           // State the first run started from
+    long long base = 0;      // Instructions executed before the current run
+    bool haveSaved = false;
+    State saved;             // State Brent's algorithm compares with
+    long long power = 1;     // Back edges until saved is replaced
+    long long since = 0;     // Back edges since it was saved
+
+    // Copies the state of hw into state (executed is left alone)
+    static void save(const Hardware& hw, const Program& program, State& state);
+
+    // Puts the state back into hw
+    static void load(const State& state, Hardware& hw, const Program& program);
+
+    // True if hw is in the state
+    static bool isState(const Hardware& hw, const Program& program, const State& state);
+
+    // Finds the first state that comes back length instructions later, the
+    // entry of the cycle (hw is left anywhere)
+    void findEntry(Hardware& hw, const Program& program);
+};
+//
+// End of CycleDetector
+//
+
+#endif //MINICPU_CYCLES_H
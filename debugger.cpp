@@ -0,0 +1,321 @@
+#include <cctype>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "debugger.h"
+
+using namespace std;
+
+//
+// Start of debugger helpers
+//
+// Runs the plain code (never superinstructions or loop skipping), so a
+// budget of 1 runs exactly the instruction at pc
+struct PlainStep {
+    static const bool enabled = true;
+    static const bool backEdges = false;
+    void step(const Hardware&, const Program&, int) {}
+    bool backEdge(const Hardware&, const Program&, long long) { return true; }
+};
+
+// Text without the blanks around it
+static string trimmed(const string& text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == string::npos) {
+        return "";
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+// Same name, ignoring case
+static bool sameName(const string& text, const char* name) {
+    size_t i = 0;
+    for (; i < text.size() && name[i] != '\0'; i++) {
+        if (tolower((unsigned char) text[i]) != name[i]) {
+            return false;
+        }
+    }
+    return i == text.size() && name[i] == '\0';
+}
+
+// True if value compares to the breakpoint's value as it asks
+static bool compares(const Breakpoint& point, long long value) {
+    const string& op = point.comparison;
+    return op == "==" ? value == point.value :
+           op == "!=" ? value != point.value :
+           op == "<" ? value < point.value :
+           op == "<=" ? value <= point.value :
+           op == ">" ? value > point.value : value >= point.value;
+}
+//
+// End of debugger helpers
+//
+
+
+
+//
+// Start of Debugger definitions
+//
+Debugger::Debugger(const Program& code, bool fuse, bool skipLoops)
+    : program(code), fusion(fuse), loopSkip(skipLoops) {}
+
+// Adds a breakpoint, parsing its condition
+int Debugger::addBreakpoint(int pc, const string& condition, string& error) {
+    if (pc < 0 || pc >= program.length || program.code[pc].opcode == OP_NONE) {
+        error = "no instruction at pc " + to_string(pc);
+        return -1;
+    }
+
+    Breakpoint point;
+    point.pc = pc;
+    point.condition = trimmed(condition);
+
+    if (!point.condition.empty()) {
+        // NAME OP NUMBER, the operator is the first of = ! < >
+        const string& text = point.condition;
+        size_t op = text.find_first_of("=!<>");
+        size_t opEnd = op == string::npos ? op : op + (op + 1 < text.size() && text[op + 1] == '=' ? 2 : 1);
+        string name = op == string::npos ? text : trimmed(text.substr(0, op));
+        point.comparison = op == string::npos ? "" : text.substr(op, opEnd - op);
+
+        if (point.comparison != "==" && point.comparison != "!=" && point.comparison != "<" &&
+            point.comparison != "<=" && point.comparison != ">" && point.comparison != ">=") {
+            error = "a condition is NAME OP NUMBER with OP one of == != < <= > >=";
+            return -1;
+        }
+
+        // A symbol of that name comes before the registers and bits
+        auto symbol = program.symbolIds.find(name);
+        if (symbol != program.symbolIds.end() && program.addresses[symbol->second] >= 0) {
+            point.operand = CONDITION_SYMBOL;
+            point.symbol = name;
+            point.slot = program.addresses[symbol->second];
+        } else if (sameName(name, "a")) {
+            point.operand = CONDITION_A;
+        } else if (sameName(name, "b")) {
+            point.operand = CONDITION_B;
+        } else if (sameName(name, "zero")) {
+            point.operand = CONDITION_ZERO;
+        } else if (sameName(name, "overflow")) {
+            point.operand = CONDITION_OVERFLOW;
+        } else {
+            error = "no symbol, register or bit called \"" + name + "\"";
+            return -1;
+        }
+
+        string number = trimmed(text.substr(opEnd));
+        try {
+            size_t used = 0;
+            point.value = stoll(number, &used);
+            if (used != number.size()) {
+                throw invalid_argument(number);
+            }
+        } catch (const logic_error&) {
+            error = "\"" + number + "\" is not a number";
+            return -1;
+        }
+    }
+
+    point.id = nextId++;
+    points.push_back(point);
+    dirty = true;
+    return point.id;
+}
+
+// Adds a watchpoint on the symbol's slot
+int Debugger::addWatchpoint(const string& symbol, string& error) {
+    auto id = program.symbolIds.find(symbol);
+    if (id == program.symbolIds.end() || program.addresses[id->second] < 0) {
+        error = "no symbol called \"" + symbol + "\"";
+        return -1;
+    }
+
+    Breakpoint point;
+    point.id = nextId++;
+    point.symbol = symbol;
+    point.slot = program.addresses[id->second];
+    points.push_back(point);
+    dirty = true;
+    return point.id;
+}
+
+// Removes the breakpoint or watchpoint with the id
+bool Debugger::remove(int id) {
+    for (size_t i = 0; i < points.size(); i++) {
+        if (points[i].id == id) {
+            points.erase(points.begin() + i);
+            dirty = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Prints every breakpoint and watchpoint
+void Debugger::list(ostream& out) const {
+    if (points.empty()) {
+        out << "No breakpoints or watchpoints." << '\n';
+    }
+    for (const Breakpoint& point : points) {
+        out << point.id << ": ";
+        if (point.pc >= 0) {
+            out << "breakpoint at pc " << point.pc << " (" << opcodeName(program.code[point.pc].opcode) << ")";
+            if (!point.condition.empty()) {
+                out << " if " << point.condition;
+            }
+        } else {
+            out << "watchpoint on " << point.symbol;
+        }
+        out << ", hit " << point.hits << (point.hits == 1 ? " time" : " times") << '\n';
+    }
+}
+
+// Copies the program and patches OP_BREAK over the instructions to stop at
+void Debugger::patch() {
+    breakAt.assign(program.code.size(), 0);
+    watched.assign(1, 0);
+    for (const Breakpoint& point : points) {
+        if (point.pc >= 0) {
+            breakAt[point.pc] = 1;
+        } else {
+            if ((size_t) point.slot >= watched.size()) {
+                watched.resize(point.slot + 1, 0);
+            }
+            watched[point.slot] = 1;
+        }
+    }
+
+    patched = program;
+    for (int pc = 0; pc < program.length; pc++) {
+        const DecodedInstruction& instruction = program.code[pc];
+        bool watchedStore = instruction.opcode == OP_STR && (size_t) instruction.operand < watched.size() &&
+                            watched[instruction.operand] != 0;
+        if (breakAt[pc] != 0 || watchedStore) {
+            patched.code[pc].opcode = OP_BREAK;
+        }
+    }
+
+    // A run stops before an OP_BREAK, and no superinstruction or counted
+    // loop is made over one
+    computeRunLengths(patched);
+    if (fusion || loopSkip) {
+        fuseProgram(patched, fusion, loopSkip);
+    }
+    dirty = false;
+}
+
+// Checks the breakpoints at hw.pc
+bool Debugger::breaks(const Hardware& hw) {
+    if (breakAt[hw.pc] == 0) {
+        return false;
+    }
+
+    bool stops = false;
+    for (Breakpoint& point : points) {
+        if (point.pc != hw.pc) {
+            continue;
+        }
+
+        long long value = point.operand == CONDITION_A ? hw.a :
+                          point.operand == CONDITION_B ? hw.b :
+                          point.operand == CONDITION_ZERO ? hw.zero_bit :
+                          point.operand == CONDITION_OVERFLOW ? hw.overflow_bit :
+                          point.operand == CONDITION_SYMBOL ? hw.value_memory[point.slot] : 0;
+        if (point.operand != CONDITION_NONE && !compares(point, value)) {
+            continue;
+        }
+
+        // The first one that holds is reported, every one that holds is counted
+        point.hits++;
+        if (!stops) {
+            report = "Breakpoint " + to_string(point.id) + " at pc " + to_string(point.pc);
+            if (!point.condition.empty()) {
+                report += " (" + point.condition + ")";
+            }
+        }
+        stops = true;
+    }
+    return stops;
+}
+
+// Runs the unpatched instruction at hw.pc, budget is at least 1
+ExecStatus Debugger::stepOver(Hardware& hw, long long& budget, bool& changed) {
+    const DecodedInstruction instruction = program.code[hw.pc];
+    const int pc = hw.pc;
+    const long long before = instruction.opcode == OP_STR ? hw.value_memory[instruction.operand] : 0;
+
+    long long one = 1;
+    PlainStep step;
+    ExecStatus status = runDecoded(hw, program, one, step);
+    budget -= 1 - one;
+
+    changed = false;
+    if (instruction.opcode != OP_STR || (size_t) instruction.operand >= watched.size() ||
+        watched[instruction.operand] == 0 || hw.value_memory[instruction.operand] == before) {
+        return status;
+    }
+
+    for (Breakpoint& point : points) {
+        if (point.pc < 0 && point.slot == instruction.operand) {
+            point.hits++;
+            if (!changed) {
+                report = "Watchpoint " + to_string(point.id) + ": " + point.symbol + " changed from " +
+                         to_string(before) + " to " + to_string(hw.value_memory[point.slot]) + " at pc " +
+                         to_string(pc);
+            }
+            changed = true;
+        }
+    }
+    return status;
+}
+
+// Runs the patched program, stepping over the patched instructions that do not stop it
+ExecStatus Debugger::run(Hardware& hw, long long& budget) {
+    if (dirty) {
+        patch();
+    }
+    report.clear();
+
+    NoTrace trace;
+    bool resuming = hw.pc == resumePc;  // The breakpoint there was hit already
+    resumePc = -1;
+    while (true) {
+        if ((size_t) hw.pc < patched.code.size() && patched.code[hw.pc].opcode == OP_BREAK) {
+            if (!resuming && breaks(hw)) {
+                resumePc = hw.pc;
+                return EXEC_STOPPED;
+            }
+            resuming = false;
+            if (budget <= 0) {
+                return EXEC_BUDGET;
+            }
+
+            // Runs the real instruction. With one instruction of budget, a
+            // jump to an empty slot or a STR right before one ends the run
+            // there already, like it does in the engine.
+            bool changed = false;
+            ExecStatus status = stepOver(hw, budget, changed);
+            if (changed) {
+                return status == EXEC_BUDGET ? EXEC_STOPPED : status;
+            }
+            if (status != EXEC_BUDGET) {
+                return status;
+            }
+            continue;
+        }
+        resuming = false;
+
+        // Stops at the next OP_BREAK, or with the budget used up before one
+        ExecStatus status = runDecoded(hw, patched, budget, trace);
+        if (status != EXEC_STOPPED) {
+            return status;
+        }
+    }
+}
+//
+// End of Debugger definitions
+//
@@ -0,0 +1,125 @@
+//
+// Created by Michal
+//
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+
+#ifndef MINICPU_DEBUGGER_H
+#define MINICPU_DEBUGGER_H
+
+//
+// Start of Breakpoint
+//
+// What a conditional breakpoint compares
+enum ConditionOperand {
+    CONDITION_NONE,      // No condition, the breakpoint always stops
+    CONDITION_A,         // Register A
+    CONDITION_B,         // Register B
+    CONDITION_ZERO,      // Zero bit
+    CONDITION_OVERFLOW,  // Overflow bit
+    CONDITION_SYMBOL     // Value of a symbol (Breakpoint::slot)
+};
+
+struct Breakpoint {
+    // A breakpoint stops before the instruction at pc runs (if its condition
+    // holds), a watchpoint stops after a STR changed the value of its symbol
+    int id = 0;
+    int pc = -1;              // Breakpoint: where it stops, -1 for a watchpoint
+    std::string symbol;       // Watchpoint: name of the symbol, condition: symbol compared
+    int slot = -1;            // value_memory slot of symbol
+    std::string condition;    // Condition as given ("A == 5"), empty for none
+    int operand = CONDITION_NONE;  // One of ConditionOperand
+    std::string comparison;   // "==", "!=", "<", "<=", ">" or ">="
+    long long value = 0;      // Compared with
+    long long hits = 0;       // Times it stopped the program
+};
+//
+// End of Breakpoint
+//
+
+
+
+//
+// Start of Debugger
+//
+class Debugger {
+    // Runs a program until one of its breakpoints or watchpoints is hit.
+    //
+    // Nothing is checked per instruction. The Debugger runs a copy of the
+    // program with OP_BREAK patched over every instruction that has a
+    // breakpoint and over every STR whose slot is set in the write-watch
+    // bitmap (the slots of the watched symbols; STR is the only instruction
+    // that writes value_memory and its slot is fixed at link time). The
+    // engine runs the copy at its normal speed, superinstructions and loop
+    // skipping included wherever no patch is in the way, and stops at an
+    // OP_BREAK before running it. Only then the condition is looked at or
+    // the STR is run from the original program and its slot compared.
+    //
+    // The copy is made again only when a breakpoint or watchpoint is added
+    // or removed. The program must not change while the Debugger is used.
+public:
+    // fusion and loopSkip as fuseProgram was called for the program
+    explicit Debugger(const Program& program, bool fusion = true, bool loopSkip = true);
+
+    // Stops before the instruction at pc runs, if condition ("NAME OP
+    // NUMBER", NAME a symbol, A, B, zero or overflow, OP one of == != < <=
+    // > >=) holds or is empty. Returns the id, or -1 and sets error.
+    int addBreakpoint(int pc, const std::string& condition, std::string& error);
+
+    // Stops after an instruction changed the value of the symbol. Returns
+    // the id, or -1 and sets error.
+    int addWatchpoint(const std::string& symbol, std::string& error);
+
+    // Removes the breakpoint or watchpoint. Returns false if there is none with the id.
+    bool remove(int id);
+
+    // Prints one line per breakpoint and watchpoint
+    void list(std::ostream& out) const;
+
+    // Runs the program on hw from hw.pc like runDecoded (budget is decreased
+    // by the instructions executed). Returns EXEC_STOPPED with report set
+    // when a breakpoint or watchpoint is hit (a breakpoint even with no
+    // budget left), also one at hw.pc unless the run goes on from resumePc.
+    ExecStatus run(Hardware& hw, long long& budget);
+
+    std::string report;  // What stopped the last run ("Breakpoint 1 at pc 7 (A == 5)")
+
+    // pc the last run stopped at a breakpoint, -1 if it did not. A run
+    // starting there steps over that breakpoint. Set it to -1 when hw is
+    // changed between runs.
+    int resumePc = -1;
+
+private:
+    const Program& program;
+    bool fusion;
+    bool loopSkip;
+    std::vector<Breakpoint> points;
+    int nextId = 1;
+
+    Program patched;               // program with OP_BREAK patched in
+    bool dirty = true;             // points changed since patched was made
+    std::vector<char> breakAt;     // Per pc: a breakpoint is there
+    std::vector<char> watched;     // Per value_memory slot: a watchpoint is on it
+
+    // Makes patched, breakAt and watched from points
+    void patch();
+
+    // True if a breakpoint at hw.pc stops the run (counts its hit and sets report)
+    bool breaks(const Hardware& hw);
+
+    // Runs the instruction at hw.pc of the unpatched program (budget has to
+    // be at least 1). Returns EXEC_BUDGET if it ran and the run can go on,
+    // otherwise why not. Sets changed if it was a STR that changed a watched
+    // symbol (and report).
+    ExecStatus stepOver(Hardware& hw, long long& budget, bool& changed);
+};
+//
+// End of Debugger
+//
+
+#endif //MINICPU_DEBUGGER_H
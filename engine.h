@@ -0,0 +1,411 @@
+//
+// Created by Michal
+//
+
+#include <string>
+#include "hardware.h"
+#include "bytecode.h"
+#include "loops.h"
+
+#ifndef MINICPU_ENGINE_H
+#define MINICPU_ENGINE_H
+
+//
+// Start of ExecStatus
+//
+// Why the engine stopped running
+enum ExecStatus {
+    EXEC_HALTED,  // HLT was executed
+    EXEC_BUDGET,  // The instruction budget ran out
+    EXEC_FAULT,   // pc reached a slot without an instruction
+    EXEC_STOPPED  // The hook stopped the run at a back edge (see Hook::backEdges),
+                  // or pc reached an OP_BREAK (before running it)
+};
+//
+// End of ExecStatus
+//
+
+
+
+//
+// Start of trace hooks
+//
+// The engine calls hook.step(hw, program, pc) after every instruction when
+// Hook::enabled is true. The hook is a template parameter, so for NoTrace the
+// engine is compiled without any per instruction hook code at all.
+//
+// When Hook::backEdges is true the engine also calls
+// hook.backEdge(hw, program, executed) after every jump that goes back (to
+// the same or an earlier pc), with hw holding the state before the target
+// runs and executed the instructions of this call so far. Returning false
+// stops the run there with EXEC_STOPPED. Back edges are seen by the untraced
+// engine too, so such a hook does not need enabled.
+// The hooks that print something are in trace.h.
+struct NoTrace {
+    static const bool enabled = false;
+    static const bool backEdges = false;
+    void step(const Hardware&, const Program&, int) {}
+    bool backEdge(const Hardware&, const Program&, long long) { return true; }
+};
+//
+// End of trace hooks
+//
+
+
+
+//
+// Start of instruction helpers
+//
+// Adds register b to register a with the rules of ADD::execute: the result has
+// to stay strictly between -2^31 and 2^31 - 1, otherwise only the overflow bit
+// is set and A is kept. A zero result sets the zero bit without clearing the
+// overflow bit; any other result clears both bits.
+inline void addRegisters(long long& a, long long b, int& zero_bit, int& overflow_bit) {
+    long long result = a + b;
+
+    if (result <= -2147483648LL || result >= 2147483647LL) {
+        overflow_bit = 1;
+    } else if (result == 0) {
+        a = result;
+        zero_bit = 1;
+    } else {
+        a = result;
+        overflow_bit = 0;
+        zero_bit = 0;
+    }
+}
+
+// DEC only makes the symbol visible, its address was chosen by linkProgram
+inline void declareSymbol(Hardware& hw, const Program& program, int symbol) {
+    // The address is fixed at link time, so only the first run of a DEC
+    // has to touch symbol_table; DECs inside loops are a flag test
+    if ((size_t) symbol < hw.bound_symbols.size() && hw.bound_symbols[symbol] != 0) {
+        return;
+    }
+    hw.symbol_table[program.symbols[symbol]] = program.addresses[symbol];
+    if (hw.bound_symbols.size() < program.symbols.size()) {
+        hw.bound_symbols.resize(program.symbols.size(), 0);
+    }
+    hw.bound_symbols[symbol] = 1;
+}
+//
+// End of instruction helpers
+//
+
+
+
+//
+// Start of runDecoded
+//
+// GCC and Clang support taking the address of a label, which the engine uses
+// for direct threading. Other compilers get the switch based dispatch.
+#if defined(__GNUC__) && !defined(MINICPU_NO_COMPUTED_GOTO)
+#define MINICPU_COMPUTED_GOTO 1
+#else
+#define MINICPU_COMPUTED_GOTO 0
+#endif
+
+// Writes the registers back to the hardware and calls the hook (traced engines only)
+#define ENGINE_STEP(executed_pc)                                          \
+    if (Hook::enabled) {                                                  \
+        hw.a = a;                                                         \
+        hw.b = b;                                                         \
+        hw.zero_bit = zero_bit;                                           \
+        hw.overflow_bit = overflow_bit;                                   \
+        hw.pc = pc;                                                       \
+        hook.step(hw, program, executed_pc);                              \
+    }
+
+// Calls the back edge hook if the jump at from went back (hooks with
+// backEdges only) and stops if the hook says so
+#define ENGINE_BACK_EDGE(from)                                            \
+    if (Hook::backEdges && pc <= (from)) {                                \
+        hw.a = a;                                                         \
+        hw.b = b;                                                         \
+        hw.zero_bit = zero_bit;                                           \
+        hw.overflow_bit = overflow_bit;                                   \
+        hw.pc = pc;                                                       \
+        if (!hook.backEdge(hw, program, budget - left)) {                 \
+            status = EXEC_STOPPED;                                        \
+            goto done;                                                    \
+        }                                                                 \
+    }
+
+// Jumps to the handler of the instruction at pc
+#if MINICPU_COMPUTED_GOTO
+#define ENGINE_NEXT()                                                     \
+    do {                                                                  \
+        if (Threaded) goto *handlers[pc];                                 \
+        goto dispatch;                                                    \
+    } while (0)
+#else
+#define ENGINE_NEXT() goto dispatch
+#endif
+
+// Starts a new straight line run at pc. The whole run is charged to the
+// budget at once, so the budget is only checked after jumps, not per instruction.
+#define ENGINE_ENTER_RUN()                                                \
+    do {                                                                  \
+        if (runLength[pc] > left) goto out_of_budget;                     \
+        left -= runLength[pc];                                            \
+        ENGINE_NEXT();                                                    \
+    } while (0)
+
+// Runs the decoded program on the hardware starting at hw.pc until HLT is
+// executed, an empty slot is reached, or budget instructions have run.
+// budget is decreased by the number of instructions executed.
+//
+// Registers live in local variables while running. With Threaded (GCC/Clang)
+// every pc gets the address of its handler once (Program::handlers) and each
+// handler jumps straight to the next one; otherwise a switch is used. HLT and
+// empty slots have their own handlers, so there is no per instruction check
+// for them, and the budget is charged per run (see ENGINE_ENTER_RUN). OP_BREAK
+// stops the run the same way, so a program with breakpoints patched in runs
+// at full speed between them.
+//
+// Untraced engines run Program::fused, traced engines (and the budget tail)
+// run the plain code so every instruction is still seen one by one.
+//
+// The program is only read, so any number of machines (each with its own
+// Hardware) can run the same Program at the same time.
+template <typename Hook, bool Threaded = MINICPU_COMPUTED_GOTO>
+ExecStatus runDecoded(Hardware& hw, const Program& program, long long& budget, Hook& hook) {
+    const DecodedInstruction* const plain = program.code.data();
+    const DecodedInstruction* const code =
+        Hook::enabled || program.fused.empty() ? plain : program.fused.data();
+    const int* const runLength = program.runLength.data();
+    long long* const memory = hw.value_memory.data();
+
+    long long a = hw.a;
+    long long b = hw.b;
+    int zero_bit = hw.zero_bit;
+    int overflow_bit = hw.overflow_bit;
+    int pc = hw.pc;
+    long long left = budget;
+    ExecStatus status = EXEC_BUDGET;
+
+#if MINICPU_COMPUTED_GOTO
+    // Handler of every opcode, in Opcode order
+    static const void* const labels[] = {
+        &&do_dec, &&do_lda, &&do_ldb, &&do_ldi, &&do_str, &&do_xch,
+        &&do_jmp, &&do_jzs, &&do_jvs, &&do_add, &&do_hlt, &&do_none,
+        &&do_add_str, &&do_add_jzs, &&do_add_jvs, &&do_loop, &&do_break
+    };
+
+    // Handler address of every pc, built the first time this engine runs the program
+    const void* const* const handlers =
+        Threaded ? program.handlers.table(labels, OP_BREAK + 1, code, program.code.size()) : nullptr;
+#endif
+
+    if (left <= 0) {
+        return EXEC_BUDGET;
+    }
+
+    ENGINE_ENTER_RUN();
+
+dispatch:
+    switch (code[pc].opcode) {
+        case OP_DEC:
+        do_dec:
+            declareSymbol(hw, program, code[pc].operand);
+            pc++;
+            ENGINE_STEP(pc - 1);
+            ENGINE_NEXT();
+
+        case OP_LDA:
+        do_lda:
+            a = memory[code[pc].operand];
+            pc++;
+            ENGINE_STEP(pc - 1);
+            ENGINE_NEXT();
+
+        case OP_LDB:
+        do_ldb:
+            b = memory[code[pc].operand];
+            pc++;
+            ENGINE_STEP(pc - 1);
+            ENGINE_NEXT();
+
+        case OP_LDI:
+        do_ldi:
+            a = code[pc].operand;
+            pc++;
+            ENGINE_STEP(pc - 1);
+            ENGINE_NEXT();
+
+        case OP_STR:
+        do_str:
+            memory[code[pc].operand] = a;
+            pc++;
+            ENGINE_STEP(pc - 1);
+            ENGINE_NEXT();
+
+        case OP_XCH:
+        do_xch: {
+            long long temp = a;
+            a = b;
+            b = temp;
+            pc++;
+            ENGINE_STEP(pc - 1);
+            ENGINE_NEXT();
+        }
+
+        case OP_ADD:
+        do_add:
+            addRegisters(a, b, zero_bit, overflow_bit);
+            pc++;
+            ENGINE_STEP(pc - 1);
+            ENGINE_NEXT();
+
+        case OP_JMP:
+        do_jmp: {
+            const int from = pc;
+            pc = code[pc].operand;
+            ENGINE_STEP(from);
+            ENGINE_BACK_EDGE(from);
+            ENGINE_ENTER_RUN();
+        }
+
+        case OP_JZS:
+        do_jzs: {
+            const int from = pc;
+            pc = zero_bit == 1 ? code[pc].operand : pc + 1;
+            ENGINE_STEP(from);
+            ENGINE_BACK_EDGE(from);
+            ENGINE_ENTER_RUN();
+        }
+
+        case OP_JVS:
+        do_jvs: {
+            const int from = pc;
+            pc = overflow_bit == 1 ? code[pc].operand : pc + 1;
+            ENGINE_STEP(from);
+            ENGINE_BACK_EDGE(from);
+            ENGINE_ENTER_RUN();
+        }
+
+        // Superinstructions, only found in Program::fused (never traced)
+        case OP_ADD_STR:
+        do_add_str:
+            a = memory[code[pc].operand];
+            b = memory[code[pc + 1].operand];
+            addRegisters(a, b, zero_bit, overflow_bit);
+            memory[code[pc + 3].operand] = a;
+            pc += 4;
+            ENGINE_NEXT();
+
+        case OP_ADD_JZS:
+        do_add_jzs: {
+            const int from = pc + 3;
+            a = memory[code[pc].operand];
+            b = memory[code[pc + 1].operand];
+            addRegisters(a, b, zero_bit, overflow_bit);
+            pc = zero_bit == 1 ? code[from].operand : pc + 4;
+            ENGINE_BACK_EDGE(from);
+            ENGINE_ENTER_RUN();
+        }
+
+        case OP_ADD_JVS:
+        do_add_jvs: {
+            const int from = pc + 3;
+            a = memory[code[pc].operand];
+            b = memory[code[pc + 1].operand];
+            addRegisters(a, b, zero_bit, overflow_bit);
+            pc = overflow_bit == 1 ? code[from].operand : pc + 4;
+            ENGINE_BACK_EDGE(from);
+            ENGINE_ENTER_RUN();
+        }
+
+        // Back edge of a counted loop: skip the iterations that provably end
+        // normally, then jump like JMP and run the rest one by one. A back
+        // edge hook only lets it skip half the budget at a time, so a loop
+        // that never changes anything still comes back to its back edge.
+        case OP_LOOP:
+        do_loop: {
+            const LoopSummary& loop = program.loops[code[pc].operand];
+            pc = loop.header;
+            ENGINE_BACK_EDGE(loop.backEdge);
+            left -= skipLoopIterations(loop, memory, a, b, zero_bit, overflow_bit, Hook::backEdges ? left / 2 : left);
+            ENGINE_ENTER_RUN();
+        }
+
+        // Breakpoint of the Debugger: nothing of it has run or been charged
+        // (it starts a run of length 0), the Debugger decides what happens
+        case OP_BREAK:
+        do_break:
+            status = EXEC_STOPPED;
+            goto done;
+
+        case OP_HLT:
+        do_hlt:
+            ENGINE_STEP(pc);
+            status = EXEC_HALTED;
+            goto done;
+
+        case OP_NONE:
+        default:
+        do_none:
+            status = EXEC_FAULT;
+            goto done;
+    }
+
+out_of_budget:
+    // The budget ends inside the current run, so everything that still fits is
+    // straight line code (no jumps, HLT or empty slots). Run it one by one.
+    while (left > 0) {
+        const DecodedInstruction instruction = plain[pc];
+
+        switch (instruction.opcode) {
+            case OP_DEC:
+                declareSymbol(hw, program, instruction.operand);
+                break;
+            case OP_LDA:
+                a = memory[instruction.operand];
+                break;
+            case OP_LDB:
+                b = memory[instruction.operand];
+                break;
+            case OP_LDI:
+                a = instruction.operand;
+                break;
+            case OP_STR:
+                memory[instruction.operand] = a;
+                break;
+            case OP_XCH: {
+                long long temp = a;
+                a = b;
+                b = temp;
+                break;
+            }
+            case OP_ADD:
+                addRegisters(a, b, zero_bit, overflow_bit);
+                break;
+            default:
+                break;
+        }
+
+        pc++;
+        left--;
+        ENGINE_STEP(pc - 1);
+    }
+    status = EXEC_BUDGET;
+
+done:
+    hw.a = a;
+    hw.b = b;
+    hw.zero_bit = zero_bit;
+    hw.overflow_bit = overflow_bit;
+    hw.pc = pc;
+    budget = left;
+    return status;
+}
+
+#undef ENGINE_STEP
+#undef ENGINE_BACK_EDGE
+#undef ENGINE_NEXT
+#undef ENGINE_ENTER_RUN
+//
+// End of runDecoded
+//
+
+#endif //MINICPU_ENGINE_H
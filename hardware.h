@@ -3,7 +3,9 @@
 //
 
 #include <string>
+#include <vector>
 #include <map>
+#include <ostream>
 
 #ifndef MINICPU_HARDWARE_H
 #define MINICPU_HARDWARE_H
@@ -16,25 +18,53 @@ class Instruction;
 // Start of Hardware class
 //
 class Hardware{
-    // Hardware class that holds all the registers, bits, memory, and symbol tables
+    // Hardware class that holds all the registers, bits, memory, and symbol tables.
+    // The program itself is not part of it (see Program in bytecode.h), so many
+    // Hardware instances can run one shared, read-only Program.
 public:
-    // Instruction array that hold pointers to instances of Instructions
-    Instruction* instruction_memory[128];
+    // Number of memory slots unless --memory says otherwise
+    static const int defaultMemorySize = 128;
 
-    // Value array that holds Instruction's values
-    long long value_memory[128];
+    // Largest number of memory slots (the JIT addresses a slot with a 32 bit
+    // byte offset)
+    static const int maximumMemorySize = 1 << 28;
+
+    // Instruction array that hold pointers to instances of Instructions.
+    // One slot per line of the SAL file. Empty unless the reference
+    // Instruction objects were built (ALI::buildInstructions).
+    std::vector<Instruction*> instruction_memory;
+
+    // Value array that holds Instruction's values, one per memory slot.
+    // The engines index it directly: linkProgram only hands out addresses
+    // inside it.
+    std::vector<long long> value_memory;
 
     // Symbol table holding the Instruction's name as key and where it is stored in memory as a value
     std::map<std::string, int> symbol_table;
 
+    // Per symbol id of the running program: 1 once its DEC has been run, so
+    // running that DEC again does not look the name up in symbol_table.
+    // Cleared together with symbol_table (clearSymbols).
+    std::vector<char> bound_symbols;
+
     long long a;       // Accumulator (Register A)
     long long b;       // Register B
     int pc;            // Program Counter
     int zero_bit;      // Zero bit
     int overflow_bit;  // Overflow bit
 
-    // Default constructor that sets everything to 0 or nullptr
-    Hardware();
+    // Constructor that sets everything to 0, with size memory slots
+    explicit Hardware(int size = defaultMemorySize);
+
+    // Forgets every declared symbol (symbol_table and bound_symbols)
+    void clearSymbols();
+
+    // Writes the instruction followed by the registers, bits and all the
+    // symbols with their values (the state printed after every instruction)
+    void dump(std::ostream& out, const std::string& name, const std::string& arg) const;
+
+    // Writes only the registers, bits and symbols part of dump()
+    void dumpState(std::ostream& out) const;
 };
 //
 // End of Hardware class
@@ -18,10 +18,14 @@ public:
     Hardware* hardware_pointer;  // Pointer to Hardware class (on heap)
     std::string printString;     // Instruction name
     std::string argValue;        // Instruction value (if applicable)
+    int address;                 // value_memory address of the symbol (set by linkProgram)
 
     // Default constructor for Instruction class
     Instruction();
 
+    // Instructions are deleted through Instruction pointers (ALI::~ALI)
+    virtual ~Instruction() = default;
+
     // Abstract execute function that will be implemented in the
     // derived classes (each instruction). Each instruction
     // will have its own definition.
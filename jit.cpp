@@ -0,0 +1,433 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "jit.h"
+
+#if MINICPU_JIT
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+#if MINICPU_JIT
+
+//
+// Start of Assembler
+//
+namespace {
+
+// x86-64 register numbers
+enum Register {
+    RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11
+};
+
+// Where a rel32 jump has to point once all code is laid out
+enum FixupKind {
+    TO_BODY,  // Native body of a pc
+    TO_STUB,  // Entry stub of a pc (charges the budget first)
+    TO_EXIT   // Common exit that writes the registers back
+};
+
+struct Fixup {
+    size_t at;       // Offset of the rel32 field
+    FixupKind kind;  // What it points to
+    int pc;          // pc for TO_BODY and TO_STUB
+};
+
+class Assembler {
+    // Writes x86-64 machine code into a byte vector
+public:
+    vector<unsigned char> bytes;
+    vector<Fixup> fixups;
+
+    size_t size() const {
+        return bytes.size();
+    }
+
+    void byte(unsigned value) {
+        bytes.push_back((unsigned char) value);
+    }
+
+    void bytes3(unsigned first, unsigned second, unsigned third) {
+        byte(first);
+        byte(second);
+        byte(third);
+    }
+
+    void int32(int32_t value) {
+        uint32_t raw = (uint32_t) value;
+        for (int i = 0; i < 4; i++) {
+            byte((raw >> (8 * i)) & 0xFF);
+        }
+    }
+
+    // REX prefix with W set for a reg field and an r/m (base) field
+    void rexW(int reg, int base) {
+        byte(0x48 | (reg >= 8 ? 0x04 : 0) | (base >= 8 ? 0x01 : 0));
+    }
+
+    // ModRM byte for [base + disp32]
+    void memory(int reg, int base, int32_t disp) {
+        byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        int32(disp);
+    }
+
+    // mov reg, [base + disp]
+    void load(int reg, int base, int32_t disp) {
+        rexW(reg, base);
+        byte(0x8B);
+        memory(reg, base, disp);
+    }
+
+    // mov [base + disp], reg
+    void store(int base, int32_t disp, int reg) {
+        rexW(reg, base);
+        byte(0x89);
+        memory(reg, base, disp);
+    }
+
+    // mov dword [rdi + disp], imm32
+    void storeState32(int32_t disp, int32_t value) {
+        byte(0xC7);
+        memory(0, RDI, disp);
+        int32(value);
+    }
+
+    // mov r8, imm32 (sign extended)
+    void loadImmediateA(int32_t value) {
+        bytes3(0x49, 0xC7, 0xC0);
+        int32(value);
+    }
+
+    // cmp rcx, imm32 / sub rcx, imm32 / add rcx, imm32
+    void budgetOp(unsigned extension, int32_t value) {
+        bytes3(0x48, 0x81, 0xC0 | (extension << 3) | RCX);
+        int32(value);
+    }
+
+    // Near jump or conditional jump (0x0F 0x8? opcode) with a fixup
+    void jump(FixupKind kind, int pc) {
+        byte(0xE9);
+        fixups.push_back(Fixup{size(), kind, pc});
+        int32(0);
+    }
+
+    void jumpIf(unsigned condition, FixupKind kind, int pc) {
+        byte(0x0F);
+        byte(0x80 | condition);
+        fixups.push_back(Fixup{size(), kind, pc});
+        int32(0);
+    }
+
+    // Short conditional jump, returns the offset to patch with patchShort
+    size_t shortJump(unsigned opcode) {
+        byte(opcode);
+        byte(0);
+        return size() - 1;
+    }
+
+    void patchShort(size_t at) {
+        bytes[at] = (unsigned char) (size() - (at + 1));
+    }
+};
+
+// Condition code of jnz
+const unsigned CC_NOT_ZERO = 0x5;
+
+// Extensions of the 0x81 group
+const unsigned EXT_ADD = 0;
+const unsigned EXT_SUB = 5;
+const unsigned EXT_CMP = 7;
+
+}  // namespace
+//
+// End of Assembler
+//
+
+
+
+//
+// Start of JitProgram definitions
+//
+JitProgram::JitProgram(const Program& program) {
+    compile(program);
+}
+
+JitProgram::~JitProgram() {
+    if (code != nullptr) {
+        munmap(code, codeSize);
+    }
+}
+
+bool JitProgram::ready() const {
+    return code != nullptr;
+}
+
+// Generates the native code into the buffer
+void JitProgram::compile(const Program& program) {
+    const int size = (int) program.code.size();
+    const int32_t offA = (int32_t) offsetof(JitState, a);
+    const int32_t offB = (int32_t) offsetof(JitState, b);
+    const int32_t offZero = (int32_t) offsetof(JitState, zero_bit);
+    const int32_t offOverflow = (int32_t) offsetof(JitState, overflow_bit);
+    const int32_t offMemory = (int32_t) offsetof(JitState, memory);
+    const int32_t offBudget = (int32_t) offsetof(JitState, budget);
+    const int32_t offEntries = (int32_t) offsetof(JitState, entries);
+    const int32_t offPc = (int32_t) offsetof(JitState, pc);
+    const int32_t offStatus = (int32_t) offsetof(JitState, status);
+
+    Assembler as;
+    vector<size_t> bodyAt(size);
+    vector<size_t> stubAt(size);
+
+    // Prologue: load the state into registers and jump to the entry stub of pc
+    as.load(R8, RDI, offA);
+    as.load(R9, RDI, offB);
+    as.load(R10, RDI, offZero);
+    as.load(R11, RDI, offOverflow);
+    as.load(RSI, RDI, offMemory);
+    as.load(RCX, RDI, offBudget);
+    as.load(RDX, RDI, offEntries);
+    as.bytes3(0x48, 0x63, 0x87);      // movsxd rax, dword [rdi + pc]
+    as.int32(offPc);
+    as.bytes3(0xFF, 0x24, 0xC2);      // jmp [rdx + rax*8]
+
+    // Bodies. Straight line instructions fall through to the next body.
+    for (int pc = 0; pc < size; pc++) {
+        const DecodedInstruction& instruction = program.code[pc];
+        const int32_t disp = instruction.operand * 8;
+        bodyAt[pc] = as.size();
+
+        switch (instruction.opcode) {
+            case OP_LDA:
+                as.load(R8, RSI, disp);
+                break;
+
+            case OP_LDB:
+                as.load(R9, RSI, disp);
+                break;
+
+            case OP_LDI:
+                as.loadImmediateA(instruction.operand);
+                break;
+
+            case OP_STR:
+                as.store(RSI, disp, R8);
+                break;
+
+            case OP_XCH:
+                as.bytes3(0x4D, 0x87, 0xC8);  // xchg r8, r9
+                break;
+
+            case OP_ADD: {
+                // Same rules as ADD::execute, the sum is done in 64 bits and
+                // checked against the open range (-2^31, 2^31 - 1)
+                as.byte(0x4B);                 // lea rax, [r8 + r9]
+                as.bytes3(0x8D, 0x04, 0x08);
+                as.byte(0x48);                 // cmp rax, -2^31
+                as.byte(0x3D);
+                as.int32(INT32_MIN);
+                size_t low = as.shortJump(0x7E);   // jle overflow
+                as.byte(0x48);                 // cmp rax, 2^31 - 1
+                as.byte(0x3D);
+                as.int32(INT32_MAX);
+                size_t high = as.shortJump(0x7D);  // jge overflow
+
+                as.bytes3(0x49, 0x89, 0xC0);   // mov r8, rax
+                as.bytes3(0x48, 0x85, 0xC0);   // test rax, rax
+                size_t zero = as.shortJump(0x74);  // jz zero
+                as.bytes3(0x45, 0x31, 0xD2);   // xor r10d, r10d
+                as.bytes3(0x45, 0x31, 0xDB);   // xor r11d, r11d
+                size_t done1 = as.shortJump(0xEB);
+
+                // Zero result: zero bit set, overflow bit left as it is
+                as.patchShort(zero);
+                as.bytes3(0x41, 0xBA, 0x01);   // mov r10d, 1
+                as.bytes3(0x00, 0x00, 0x00);
+                size_t done2 = as.shortJump(0xEB);
+
+                // Overflow: A and the zero bit are left as they are
+                as.patchShort(low);
+                as.patchShort(high);
+                as.bytes3(0x41, 0xBB, 0x01);   // mov r11d, 1
+                as.bytes3(0x00, 0x00, 0x00);
+
+                as.patchShort(done1);
+                as.patchShort(done2);
+                break;
+            }
+
+            case OP_JMP:
+                as.jump(TO_STUB, instruction.operand);
+                break;
+
+            case OP_JZS:
+            case OP_JVS:
+                // test r10, r10 (zero bit) or test r11, r11 (overflow bit)
+                as.bytes3(0x4D, 0x85, instruction.opcode == OP_JZS ? 0xD2 : 0xDB);
+                as.jumpIf(CC_NOT_ZERO, TO_STUB, instruction.operand);
+                as.jump(TO_STUB, pc + 1);
+                break;
+
+            case OP_DEC:
+                // Give back the part of the run that is not executed, and let
+                // the interpreter bind the symbol
+                as.budgetOp(EXT_ADD, program.runLength[pc]);
+                as.storeState32(offPc, pc);
+                as.storeState32(offStatus, JIT_DEC);
+                as.jump(TO_EXIT, 0);
+                break;
+
+            case OP_HLT:
+                as.storeState32(offPc, pc);
+                as.storeState32(offStatus, JIT_HALTED);
+                as.jump(TO_EXIT, 0);
+                break;
+
+            default:
+                as.storeState32(offPc, pc);
+                as.storeState32(offStatus, JIT_FAULT);
+                as.jump(TO_EXIT, 0);
+                break;
+        }
+    }
+
+    // Entry stubs: charge the run starting at pc, or return to the host if
+    // the budget does not cover it
+    for (int pc = 0; pc < size; pc++) {
+        stubAt[pc] = as.size();
+        as.budgetOp(EXT_CMP, program.runLength[pc]);
+        size_t short_of_budget = as.shortJump(0x7C);  // jl
+        as.budgetOp(EXT_SUB, program.runLength[pc]);
+        as.jump(TO_BODY, pc);
+
+        // Not enough budget
+        as.patchShort(short_of_budget);
+        as.storeState32(offPc, pc);
+        as.storeState32(offStatus, JIT_BUDGET);
+        as.jump(TO_EXIT, 0);
+    }
+
+    // Common exit: write the registers back into the state
+    size_t exitAt = as.size();
+    as.store(RDI, offA, R8);
+    as.store(RDI, offB, R9);
+    as.store(RDI, offZero, R10);
+    as.store(RDI, offOverflow, R11);
+    as.store(RDI, offBudget, RCX);
+    as.byte(0xC3);  // ret
+
+    // Resolve the jumps
+    for (const Fixup& fixup : as.fixups) {
+        size_t target = fixup.kind == TO_EXIT ? exitAt :
+                        fixup.kind == TO_STUB ? stubAt[fixup.pc] : bodyAt[fixup.pc];
+        int32_t distance = (int32_t) ((int64_t) target - (int64_t) (fixup.at + 4));
+        memcpy(&as.bytes[fixup.at], &distance, 4);
+    }
+
+    // Copy into an executable buffer
+    void* buffer = mmap(nullptr, as.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        return;
+    }
+    memcpy(buffer, as.bytes.data(), as.size());
+    if (mprotect(buffer, as.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(buffer, as.size());
+        return;
+    }
+
+    code = (unsigned char*) buffer;
+    codeSize = as.size();
+
+    entries.resize(size);
+    for (int pc = 0; pc < size; pc++) {
+        entries[pc] = code + stubAt[pc];
+    }
+}
+
+// Runs the program on the hardware like runDecoded<NoTrace> does
+ExecStatus JitProgram::run(Hardware& hw, const Program& program, long long& budget) const {
+    typedef void (*NativeEntry)(JitState*);
+    NativeEntry native = (NativeEntry) (void*) code;
+    NoTrace trace;
+
+    if (code == nullptr) {
+        return runDecoded(hw, program, budget, trace);
+    }
+
+    while (true) {
+        if (budget <= 0) {
+            return EXEC_BUDGET;
+        }
+
+        JitState state;
+        state.a = hw.a;
+        state.b = hw.b;
+        state.zero_bit = hw.zero_bit;
+        state.overflow_bit = hw.overflow_bit;
+        state.memory = hw.value_memory.data();
+        state.budget = budget;
+        state.entries = entries.data();
+        state.pc = hw.pc;
+        state.status = JIT_FAULT;
+
+        native(&state);
+
+        hw.a = state.a;
+        hw.b = state.b;
+        hw.zero_bit = (int) state.zero_bit;
+        hw.overflow_bit = (int) state.overflow_bit;
+        hw.pc = state.pc;
+        budget = state.budget;
+
+        if (state.status == JIT_HALTED) {
+            return EXEC_HALTED;
+        } else if (state.status == JIT_FAULT) {
+            return EXEC_FAULT;
+        } else if (state.status == JIT_BUDGET) {
+            // The budget ends inside the next run, the interpreter does the exact tail
+            return runDecoded(hw, program, budget, trace);
+        }
+
+        // JIT_DEC: one instruction in the interpreter, then back to native code
+        long long one = 1;
+        runDecoded(hw, program, one, trace);
+        budget--;
+    }
+}
+//
+// End of JitProgram definitions
+//
+
+#else
+
+//
+// Start of JitProgram definitions (no JIT on this platform)
+//
+JitProgram::JitProgram(const Program&) {
+}
+
+JitProgram::~JitProgram() {
+}
+
+bool JitProgram::ready() const {
+    return false;
+}
+
+void JitProgram::compile(const Program&) {
+}
+
+ExecStatus JitProgram::run(Hardware& hw, const Program& program, long long& budget) const {
+    NoTrace trace;
+    return runDecoded(hw, program, budget, trace);
+}
+//
+// End of JitProgram definitions
+//
+
+#endif
@@ -0,0 +1,93 @@
+//
+// Created by Michal
+//
+
+#include <cstddef>
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+
+#ifndef MINICPU_JIT_H
+#define MINICPU_JIT_H
+
+// The JIT emits x86-64 code for the System V calling convention and needs
+// mmap/mprotect for the executable buffer
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define MINICPU_JIT 1
+#else
+#define MINICPU_JIT 0
+#endif
+
+//
+// Start of JitState
+//
+struct JitState {
+    // Machine state handed to and from the native code. The native code keeps
+    // A, B and the bits in machine registers and only writes them back here
+    // when it exits. Layout is used by the code generator (offsetof).
+    long long a;                  // Register A
+    long long b;                  // Register B
+    long long zero_bit;           // Zero bit (0 or 1)
+    long long overflow_bit;       // Overflow bit (0 or 1)
+    long long* memory;            // value_memory of the hardware
+    long long budget;             // Instructions left
+    const void* const* entries;   // Native entry point of every pc
+    int pc;                       // pc to start at, and pc the code stopped at
+    int status;                   // Why the native code returned (JitExit)
+};
+
+// Why the native code returned to the host
+enum JitExit {
+    JIT_HALTED,  // HLT was executed
+    JIT_FAULT,   // pc reached an empty slot
+    JIT_BUDGET,  // Not enough budget left for the next run
+    JIT_DEC      // DEC has to be run by the interpreter (it updates symbol_table)
+};
+//
+// End of JitState
+//
+
+
+
+//
+// Start of JitProgram
+//
+class JitProgram {
+    // Native x86-64 translation of a decoded program.
+    //
+    // A and B live in r8 and r9, the zero and overflow bits in r10 and r11,
+    // value_memory in rsi and the budget in rcx. Every pc has a native body;
+    // jumps go through a small entry stub per pc that charges the run length
+    // to the budget (same scheme as runDecoded) and leaves to the host when
+    // it runs out. The interpreter finishes anything the native code hands back.
+public:
+    explicit JitProgram(const Program& program);
+    ~JitProgram();
+
+    JitProgram(const JitProgram&) = delete;
+    JitProgram& operator=(const JitProgram&) = delete;
+
+    // True if native code was generated (false on other platforms or if the
+    // executable buffer could not be mapped)
+    bool ready() const;
+
+    // Runs the program on the hardware like runDecoded<NoTrace> does.
+    // Uses the interpreter when no native code is ready. The native code is
+    // never changed after compiling, so one JitProgram can run any number of
+    // machines at once.
+    ExecStatus run(Hardware& hw, const Program& program, long long& budget) const;
+
+private:
+    unsigned char* code = nullptr;    // mmap'd executable buffer
+    size_t codeSize = 0;              // Size of the buffer
+    std::vector<const void*> entries; // Native entry stub of every pc
+
+    // Generates the native code into the buffer
+    void compile(const Program& program);
+};
+//
+// End of JitProgram
+//
+
+#endif //MINICPU_JIT_H
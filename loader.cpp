@@ -0,0 +1,209 @@
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <string>
+#include "bytecode.h"
+#include "loader.h"
+
+using namespace std;
+
+//
+// Start of loader helpers
+//
+// The three bytes of a mnemonic as one integer, so a line is identified with
+// a single load and compare instead of eleven string prefix checks
+constexpr uint32_t mnemonicKey(char first, char second, char third) {
+    return (uint32_t) (unsigned char) first |
+           (uint32_t) (unsigned char) second << 8 |
+           (uint32_t) (unsigned char) third << 16;
+}
+
+// Opcode of the line starting at text (at least three bytes), OP_NONE if the
+// line does not start with a mnemonic
+static int lineOpcode(const char* text) {
+    switch (mnemonicKey(text[0], text[1], text[2])) {
+        case mnemonicKey('D', 'E', 'C'): return OP_DEC;
+        case mnemonicKey('L', 'D', 'A'): return OP_LDA;
+        case mnemonicKey('L', 'D', 'B'): return OP_LDB;
+        case mnemonicKey('L', 'D', 'I'): return OP_LDI;
+        case mnemonicKey('S', 'T', 'R'): return OP_STR;
+        case mnemonicKey('X', 'C', 'H'): return OP_XCH;
+        case mnemonicKey('J', 'M', 'P'): return OP_JMP;
+        case mnemonicKey('J', 'Z', 'S'): return OP_JZS;
+        case mnemonicKey('J', 'V', 'S'): return OP_JVS;
+        case mnemonicKey('A', 'D', 'D'): return OP_ADD;
+        case mnemonicKey('H', 'L', 'T'): return OP_HLT;
+        default: return OP_NONE;
+    }
+}
+
+// Blanks allowed around a number ('\r' is left over from CRLF files)
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Parses the decimal number in [begin, end). Returns nullptr on success,
+// otherwise the first character that does not belong to the number.
+static const char* parseNumber(const char* begin, const char* end, int& value) {
+    const char* p = begin;
+    while (p < end && isBlank(*p)) {
+        p++;
+    }
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    const char* digits = p;
+    long long number = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        number = number * 10 + (*p - '0');
+        if (number > (long long) INT_MAX + 1) {
+            return digits;  // Does not fit an int
+        }
+        p++;
+    }
+    if (p == digits) {
+        return p;
+    }
+    if (negative) {
+        number = -number;
+    }
+    if (number > INT_MAX) {
+        return digits;
+    }
+
+    while (p < end && isBlank(*p)) {
+        p++;
+    }
+    if (p != end) {
+        return p;
+    }
+
+    value = (int) number;
+    return nullptr;
+}
+
+// "line L, column C: " for the character at position in the line
+static string location(int line, const char* lineStart, const char* position) {
+    return "line " + to_string(line) + ", column " + to_string(position - lineStart + 1) + ": ";
+}
+// Decodes the line [lineStart, lineEnd) as record pc of the program
+static inline bool decodeLine(const char* lineStart, const char* lineEnd, int pc, Program& program,
+                              DecodedInstruction& decoded, OperandText& text, string& error) {
+    const int line = pc + 1;
+
+    // Lines that do not start with a mnemonic are empty slots
+    int opcode = lineEnd - lineStart >= 3 ? lineOpcode(lineStart) : OP_NONE;
+    decoded.opcode = opcode;
+
+    if (opcode == OP_NONE || opcode == OP_XCH || opcode == OP_ADD || opcode == OP_HLT) {
+        text.append("N/A", 3);
+    } else {
+        // The operand starts after the first space of the line
+        const char* space = (const char*) memchr(lineStart, ' ', lineEnd - lineStart);
+        if (space == nullptr) {
+            error = location(line, lineStart, lineEnd) + opcodeName(opcode) + " needs an operand";
+            return false;
+        }
+        const char* operand = space + 1;
+
+        switch (opcode) {
+            // Symbol operands become symbol ids
+            case OP_DEC:
+            case OP_LDA:
+            case OP_LDB:
+            case OP_STR:
+                if (operand == lineEnd) {
+                    error = location(line, lineStart, operand) + opcodeName(opcode) + " needs a symbol";
+                    return false;
+                }
+                text.append(operand, lineEnd - operand);
+                decoded.operand = program.symbolId(string(operand, lineEnd));
+                break;
+
+            // Numeric operands are parsed once here instead of on every
+            // execution. The jumps keep the space in their text, as the
+            // Instruction classes always printed it.
+            default: {
+                const char* bad = parseNumber(operand, lineEnd, decoded.operand);
+                if (bad != nullptr) {
+                    error = location(line, lineStart, bad) + "invalid number '" +
+                            string(operand, lineEnd) + "'";
+                    return false;
+                }
+                const char* shown = opcode == OP_LDI ? operand : space;
+                text.append(shown, lineEnd - shown);
+
+                // Jumps outside the program go to the sentinel record
+                if (opcode != OP_LDI && (decoded.operand < 0 || decoded.operand > program.length)) {
+                    decoded.operand = program.length;
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+//
+// End of loader helpers
+//
+
+
+
+//
+// Start of loader definitions
+//
+// Parses SAL source straight into the decoded program
+bool parseProgram(const char* text, size_t size, int memorySize, Program& program, string& error) {
+    const char* const end = text + size;
+
+    // One record per line plus the sentinel
+    size_t lines = 0;
+    for (const char* p = text; p < end; lines++) {
+        const char* newline = (const char*) memchr(p, '\n', end - p);
+        p = newline == nullptr ? end : newline + 1;
+    }
+    // Operand text offsets are 32 bit (every slot without an operand adds "N/A")
+    if ((uint64_t) size + 3 * ((uint64_t) lines + 1) > UINT32_MAX) {
+        error = "file is too large (4 GiB at most)";
+        return false;
+    }
+    if (lines > (size_t) memorySize) {
+        error = "line " + to_string(memorySize + 1) + ": program does not fit in " +
+                to_string(memorySize) + " memory slots (see --memory)";
+        return false;
+    }
+
+    program = Program();
+    program.length = (int) lines;
+    program.code.assign(lines + 1, DecodedInstruction{OP_NONE, 0});
+    program.argText.text.reserve(size);
+    program.argText.offsets.reserve(lines + 2);
+
+    const char* lineStart = text;
+    for (int pc = 0; pc < program.length; pc++) {
+        const char* newline = (const char*) memchr(lineStart, '\n', end - lineStart);
+        const char* lineEnd = newline == nullptr ? end : newline;
+        if (!decodeLine(lineStart, lineEnd, pc, program, program.code[pc], program.argText, error)) {
+            return false;
+        }
+
+        lineStart = lineEnd + 1;
+    }
+    program.argText.append("N/A", 3);  // Sentinel
+
+    computeRunLengths(program);
+    return true;
+}
+
+// Decodes one line the way parseProgram does
+bool parseLine(const char* begin, const char* end, int pc, Program& program, DecodedInstruction& decoded,
+               OperandText& text, string& error) {
+    return decodeLine(begin, end, pc, program, decoded, text, error);
+}
+//
+// End of loader definitions
+//
@@ -0,0 +1,42 @@
+//
+// Created by Michal
+//
+
+#include <cstddef>
+#include <string>
+#include "bytecode.h"
+
+#ifndef MINICPU_LOADER_H
+#define MINICPU_LOADER_H
+
+//
+// Start of loader
+//
+// Parses SAL source straight into the decoded program in one pass over the
+// bytes, without building Instruction objects or a string per line. Every
+// line takes one slot, exactly like the original loader:
+//     - a line starting with one of the eleven mnemonics is that instruction,
+//       anything after the mnemonic up to the first space is ignored
+//     - DEC/LDA/LDB/STR take the rest of the line after the first space as
+//       the symbol, LDI/JMP/JZS/JVS take it as a decimal number
+//     - any other line is an empty slot
+// Numbers may have blanks around them and a sign; anything else is an error.
+// Jumps outside the program go to the sentinel record.
+//
+// Returns false and sets error ("line L, column C: ...") if a line cannot be
+// parsed or the program needs more than memorySize slots. The program is
+// decoded but not linked (see linkProgram).
+bool parseProgram(const char* text, size_t size, int memorySize, Program& program, std::string& error);
+
+// Decodes the single line [begin, end) (without its newline) as record pc of
+// program, exactly like parseProgram: symbol operands get their id in program
+// (added if new), jumps outside program.length go to the sentinel and the
+// operand text is appended to text. Returns false and sets error if the line
+// cannot be parsed.
+bool parseLine(const char* begin, const char* end, int pc, Program& program, DecodedInstruction& decoded,
+               OperandText& text, std::string& error);
+//
+// End of loader
+//
+
+#endif //MINICPU_LOADER_H
@@ -0,0 +1,273 @@
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include "bytecode.h"
+#include "loops.h"
+
+using namespace std;
+
+//
+// Start of loop summary helpers
+//
+// Smallest and largest ADD result that is stored in A and clears both bits
+static const long long lowestResult = -2147483647LL;
+static const long long highestResult = 2147483646LL;
+
+// Largest step of an induction slot and largest number of iterations skipped
+// at once; together they keep every product below 2^62
+static const long long largestStep = 1LL << 31;
+static const long long largestSkip = 1LL << 31;
+
+// Sum of the constant and the invariant slots of the value
+static long long offsetOf(const LinearValue& value, const long long* memory) {
+    long long sum = value.constant;
+    for (int slot : value.invariants) {
+        sum += memory[slot];
+    }
+    return sum;
+}
+
+// Step the induction slot makes in one iteration
+static long long stepOf(const LoopSummary& loop, int slot, const long long* memory) {
+    for (size_t i = 0; i < loop.inductionSlots.size(); i++) {
+        if (loop.inductionSlots[i] == slot) {
+            return offsetOf(loop.steps[i], memory);
+        }
+    }
+    return 0;
+}
+
+// Value in iteration 0 (base) and change per iteration (slope)
+static bool linearTerms(const LoopSummary& loop, const LinearValue& value, const long long* memory,
+                        long long& base, long long& slope) {
+    base = offsetOf(value, memory);
+    slope = 0;
+
+    if (value.slot >= 0) {
+        slope = stepOf(loop, value.slot, memory);
+        if (slope > largestStep || slope < -largestStep) {
+            return false;
+        }
+        base += memory[value.slot];
+    }
+    return true;
+}
+
+// Number of iterations (at most maximum) in which base + j * slope is a
+// normal ADD result: in range and not zero
+static long long normalIterations(long long base, long long slope, long long maximum) {
+    if (base < lowestResult || base > highestResult || base == 0) {
+        return 0;
+    }
+
+    long long count = maximum;
+    if (slope > 0) {
+        count = min(count, (highestResult - base) / slope + 1);
+        if (base < 0 && -base % slope == 0) {
+            count = min(count, -base / slope);
+        }
+    } else if (slope < 0) {
+        count = min(count, (base - lowestResult) / -slope + 1);
+        if (base > 0 && base % -slope == 0) {
+            count = min(count, base / -slope);
+        }
+    }
+    return count;
+}
+
+// Value at the end of iteration j
+static long long valueAt(const LoopSummary& loop, const LinearValue& value, const long long* memory, long long j) {
+    long long base, slope;
+    linearTerms(loop, value, memory, base, slope);
+    return base + j * slope;
+}
+//
+// End of loop summary helpers
+//
+
+
+
+//
+// Start of LoopSummary definitions
+//
+// Summarizes the loop from header to the JMP at backEdge
+bool summarizeLoop(const Program& program, int header, int backEdge, LoopSummary& loop) {
+    const vector<DecodedInstruction>& code = program.code;
+    if (header < 0 || header > backEdge) {
+        return false;
+    }
+
+    // The body has to be straight line code that only leaves through JZS/JVS.
+    // DEC changes symbol_table, HLT, empty slots and breakpoints stop the program.
+    set<int> written;  // Slots stored to somewhere in the body
+    for (int pc = header; pc < backEdge; pc++) {
+        int opcode = code[pc].opcode;
+        if (opcode == OP_DEC || opcode == OP_JMP || opcode == OP_HLT || opcode == OP_NONE || opcode == OP_BREAK) {
+            return false;
+        }
+        if (opcode == OP_STR) {
+            written.insert(code[pc].operand);
+        }
+    }
+
+    map<int, LinearValue> values;  // Value of every slot stored to so far
+    set<int> readFirst;            // Written slots read before the first store
+    LinearValue a, b;              // Registers, unknown until loaded
+    a.known = false;
+    b.known = false;
+    bool swapped = false;          // Unknown register values have been exchanged
+    loop = LoopSummary();
+
+    // Value of a slot read at this point of the iteration
+    auto load = [&](int slot) {
+        LinearValue value;
+        if (written.count(slot) == 0) {
+            value.invariants.push_back(slot);
+        } else if (values.count(slot) != 0) {
+            value = values[slot];
+        } else {
+            readFirst.insert(slot);
+            value.slot = slot;
+        }
+        return value;
+    };
+
+    for (int pc = header; pc < backEdge; pc++) {
+        const DecodedInstruction& instruction = code[pc];
+
+        switch (instruction.opcode) {
+            case OP_LDA:
+                a = load(instruction.operand);
+                break;
+            case OP_LDB:
+                b = load(instruction.operand);
+                break;
+            case OP_LDI:
+                a = LinearValue();
+                a.constant = instruction.operand;
+                break;
+            case OP_STR:
+                // Storing a register from before the loop changes the slot
+                // in a way that is not the same every iteration
+                if (!a.known) {
+                    return false;
+                }
+                values[instruction.operand] = a;
+                break;
+            case OP_XCH:
+                swap(a, b);
+                swapped = !swapped;
+                break;
+            case OP_ADD: {
+                // Only one changing slot per value keeps it linear in the iteration
+                if (!a.known || !b.known || (a.slot >= 0 && b.slot >= 0)) {
+                    return false;
+                }
+                LinearValue sum = a;
+                sum.slot = a.slot >= 0 ? a.slot : b.slot;
+                sum.constant += b.constant;
+                sum.invariants.insert(sum.invariants.end(), b.invariants.begin(), b.invariants.end());
+                loop.adds.push_back(sum);
+                a = sum;
+                break;
+            }
+            default:
+                // JZS/JVS: never taken while every ADD is normal (both bits 0)
+                break;
+        }
+    }
+
+    // A value from before the loop that moves between A and B every
+    // iteration depends on how many iterations ran
+    if (swapped && (!a.known || !b.known)) {
+        return false;
+    }
+
+    // Without an ADD nothing clears the bits and nothing can end the loop
+    if (loop.adds.empty()) {
+        return false;
+    }
+
+    // Slots read before they are stored have to move by the same step every
+    // iteration; all other stored slots follow from those
+    for (int slot : written) {
+        const LinearValue& value = values[slot];
+
+        if (readFirst.count(slot) != 0) {
+            if (value.slot != slot) {
+                return false;
+            }
+            LinearValue step = value;
+            step.slot = -1;
+            loop.inductionSlots.push_back(slot);
+            loop.steps.push_back(step);
+        } else {
+            loop.derivedSlots.push_back(slot);
+            loop.derived.push_back(value);
+        }
+    }
+
+    loop.header = header;
+    loop.backEdge = backEdge;
+    loop.length = backEdge - header + 1;
+    loop.a = a;
+    loop.b = b;
+    return true;
+}
+
+// Applies as many whole iterations of the loop as provably stay normal
+long long skipLoopIterations(const LoopSummary& loop, long long* memory, long long& a, long long& b,
+                             int& zero_bit, int& overflow_bit, long long budget) {
+    // A set bit could make a JZS/JVS before the first ADD jump out
+    if (zero_bit != 0 || overflow_bit != 0) {
+        return 0;
+    }
+
+    long long count = min(budget / loop.length, largestSkip);
+    for (const LinearValue& value : loop.adds) {
+        if (count <= 0) {
+            return 0;
+        }
+
+        long long base, slope;
+        if (!linearTerms(loop, value, memory, base, slope)) {
+            return 0;
+        }
+        count = min(count, normalIterations(base, slope, count));
+    }
+    if (count <= 0) {
+        return 0;
+    }
+
+    // Everything is worked out from the memory before the skip
+    vector<long long> derived(loop.derived.size());
+    for (size_t i = 0; i < loop.derived.size(); i++) {
+        derived[i] = valueAt(loop, loop.derived[i], memory, count - 1);
+    }
+    if (loop.a.known) {
+        a = valueAt(loop, loop.a, memory, count - 1);
+    }
+    if (loop.b.known) {
+        b = valueAt(loop, loop.b, memory, count - 1);
+    }
+
+    vector<long long> steps(loop.inductionSlots.size());
+    for (size_t i = 0; i < loop.inductionSlots.size(); i++) {
+        steps[i] = offsetOf(loop.steps[i], memory);
+    }
+    for (size_t i = 0; i < loop.inductionSlots.size(); i++) {
+        memory[loop.inductionSlots[i]] += count * steps[i];
+    }
+    for (size_t i = 0; i < loop.derivedSlots.size(); i++) {
+        memory[loop.derivedSlots[i]] = derived[i];
+    }
+
+    // The last ADD of the last iteration was normal and cleared both bits
+    zero_bit = 0;
+    overflow_bit = 0;
+    return count * loop.length;
+}
+//
+// End of LoopSummary definitions
+//
@@ -0,0 +1,69 @@
+//
+// Created by Michal
+//
+
+#include <vector>
+
+#ifndef MINICPU_LOOPS_H
+#define MINICPU_LOOPS_H
+
+class Program;
+
+//
+// Start of LinearValue
+//
+struct LinearValue {
+    // Value of a register, memory slot or ADD result inside one loop iteration,
+    // written in terms of the memory at the start of the iteration:
+    //     memory[slot] + constant + sum of memory[invariants]
+    // slot is a slot that changes every iteration (-1 if there is none) and the
+    // invariants are slots the loop never writes.
+    bool known = true;            // false: comes from a register value from before the loop
+    int slot = -1;                // Changing slot the value depends on, or -1
+    long long constant = 0;       // Constant part
+    std::vector<int> invariants;  // Slots the loop never writes that are added in
+};
+//
+// End of LinearValue
+//
+
+
+
+//
+// Start of LoopSummary
+//
+struct LoopSummary {
+    // Effect of one iteration of a straight line loop (header .. JMP header)
+    // whose every iteration does the same thing as long as each ADD in it
+    // stays in range and is not zero. Built by fuseProgram for every backward
+    // JMP whose body passes the checks in summarizeLoop.
+    int header = 0;                   // First pc of the loop (JMP target)
+    int backEdge = 0;                 // pc of the JMP
+    int length = 0;                   // Instructions per iteration
+
+    std::vector<int> inductionSlots;  // Slots read before written: x' = x + step
+    std::vector<LinearValue> steps;   // Step of every induction slot (no slot part)
+    std::vector<int> derivedSlots;    // Other written slots
+    std::vector<LinearValue> derived; // Their value at the end of an iteration
+    std::vector<LinearValue> adds;    // Result of every ADD, in program order
+    LinearValue a;                    // Register A at the end of an iteration
+    LinearValue b;                    // Register B at the end of an iteration
+};
+
+// Summarizes the loop from header to the JMP at backEdge.
+// Returns false if the loop is not a simple counted loop.
+bool summarizeLoop(const Program& program, int header, int backEdge, LoopSummary& loop);
+
+// Called at the back edge with the state at the start of the next iteration.
+// Works out how many whole iterations provably do nothing but move the
+// induction slots (no ADD overflows or gives 0, so no branch inside the loop
+// is taken and both bits stay 0), at most budget / loop.length of them, and
+// applies them at once. Returns the number of instructions skipped (0 if the
+// loop has to run normally).
+long long skipLoopIterations(const LoopSummary& loop, long long* memory, long long& a, long long& b,
+                             int& zero_bit, int& overflow_bit, long long budget);
+//
+// End of LoopSummary
+//
+
+#endif //MINICPU_LOOPS_H
@@ -1,27 +1,43 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <map>
+#include <climits>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <thread>
 #include "hardware.h"
 #include "instructions.h"
+#include "trace.h"
+#include "options.h"
 #include "ali.h"
+#include "bench.h"
+#include "batch.h"
+#include "cycles.h"
+#include "scheduler.h"
+#include "server.h"
+#include "reload.h"
+#include "optimize.h"
+#include "transpile.h"
+#include "debugger.h"
+#include "jit.h"
+#include "profile.h"
+#include "tracefile.h"
+#include "checkpoint.h"
+#include "loader.h"
+#include "salb.h"
+#include "mappedfile.h"
 
 using namespace std;
 
 //
 // Start of Hardware definitions
 //
-// Default constructor of Hardware class that sets everything to 0 or nullptr
-Hardware::Hardware() {
-    // Set all pointers of instruction_memory array to nullptr
-    for (auto &e : instruction_memory) {
-        e = nullptr;
-    }
-
-    // Set all elements of value_memory array to 0
-    for (auto &e : value_memory) {
-        e = 0;
-    }
+// Constructor of Hardware class that sets everything to 0
+Hardware::Hardware(int size)
+    : value_memory(size, 0) {  // All elements of value_memory are 0
 
     // Default values of 0 assigned to all hardware
     a = 0;
@@ -30,6 +46,45 @@ Hardware::Hardware() {
     zero_bit = 0;
     overflow_bit = 0;
 }
+
+// Forgets every declared symbol
+void Hardware::clearSymbols() {
+    symbol_table.clear();
+    bound_symbols.clear();
+}
+
+// Writes the instruction followed by the registers, bits and all the
+// symbols with their values. '\n' is used instead of endl so callers
+// decide when the stream gets flushed.
+void Hardware::dump(ostream& out, const string& name, const string& arg) const {
+    out << "Instruction: " << name << " ";
+
+    // Print out the instructions value if it exists
+    if (arg != "N/A") {
+        out << arg;
+    }
+    out << '\n';
+
+    dumpState(out);
+}
+
+// Writes only the registers, bits and symbols part of dump()
+void Hardware::dumpState(ostream& out) const {
+    out << "Register A: " << a << '\n';
+    out << "Register B: " << b << '\n';
+    out << "Overflow bit: " << overflow_bit << '\n';
+    out << "Zero bit: " << zero_bit << '\n';
+    out << "Symbols and values: " << '\n';
+
+    // Loops through the symbol table containing all the symbols
+    // and their values. The symbols are their values are printed
+    // out into the console.
+    for (const auto& elem : symbol_table) {
+        out << elem.first << ": " << value_memory[elem.second] << '\n';
+    }
+
+    out << '\n';
+}
 //
 // End of Hardware definitions
 //
@@ -44,33 +99,13 @@ Instruction::Instruction() {
     hardware_pointer = nullptr;
     printString = "N/A";
     argValue = "N/A";
+    address = -1;
 }
 
 // Prints everything needed
 void Instruction::print() const{
-    cout << "Instruction: " << printString << " ";
-
-    // Print out the instructions value if it exists
-    if (argValue == "N/A") {
-        cout << endl;
-    } else {
-        cout << argValue << endl;
-    }
-
-    cout << "Register A: " << hardware_pointer->a << endl;
-    cout << "Register B: " << hardware_pointer->b << endl;
-    cout << "Overflow bit: " << hardware_pointer->overflow_bit << endl;
-    cout << "Zero bit: " << hardware_pointer->zero_bit << endl;
-    cout << "Symbols and values: " << endl;
-
-    // Loops through the symbol table containing all the symbols
-    // and their values. The symbols are their values are printed
-    // out into the console.
-    for (const auto& elem : hardware_pointer->symbol_table) {
-        cout << elem.first << ": " << hardware_pointer->value_memory[elem.second] << endl;
-    }
-
-    cout << endl;
+    hardware_pointer->dump(cout, printString, argValue);
+    cout.flush();
 }
 //
 // End of Instruction definitions
@@ -83,28 +118,8 @@ void Instruction::print() const{
 void DEC::execute() {
     printString = "DEC";  // Assign name
 
-    // Loop through the memory to check if the location is empty and if the address
-    // is not yet used in the map.
-    for (int i = 0; i < 128; i++) {
-        bool found = false;  // Index (address in array) not found yet
-
-        // If the current index of the instruction array is empty,
-        // check if the map (symbol_table) does not have that address
-        // If so, then assign symbol to according spot in memory
-        if (hardware_pointer->instruction_memory[i] == nullptr) {
-            for (auto &e : hardware_pointer->symbol_table) {
-                if (e.second == i) {
-                    found = true;
-                    break;
-                }
-            }
-            // Index not found in hash, so you cna put it in.
-            if (!found) {
-                hardware_pointer->symbol_table[argValue] = i;
-                break;
-            }
-        }
-    }
+    // Make the symbol visible at the address chosen when the program was linked
+    hardware_pointer->symbol_table[argValue] = address;
 
     hardware_pointer->pc++;  // Update pc
     print();
@@ -121,11 +136,8 @@ void DEC::execute() {
 void LDA::execute() {
     printString = "LDA";  // Name instruction LDA
 
-    // Gets address of symbol in memory
-    int symbol_address = hardware_pointer->symbol_table[argValue];
-
     // Assign accumulator (register a) with symbol's value
-    hardware_pointer->a = hardware_pointer->value_memory[symbol_address];
+    hardware_pointer->a = hardware_pointer->value_memory[address];
 
     hardware_pointer->pc++;  // Update pc
 
@@ -143,11 +155,8 @@ void LDA::execute() {
 void LDB::execute() {
     printString = "LDB";  // Name instruction LDB
 
-    // Gets address of symbol in memory
-    int symbol_address = hardware_pointer->symbol_table[argValue];
-
     // Assign register b with symbol's value
-    hardware_pointer->b = hardware_pointer->value_memory[symbol_address];
+    hardware_pointer->b = hardware_pointer->value_memory[address];
 
     hardware_pointer->pc++;  // Update pc
 
@@ -186,11 +195,8 @@ void LDI::execute() {
 void STR::execute() {
     printString = "STR";  // Assign name to STR
 
-    // Gets the index (address) of the symbol from the hash of symbol -> index
-    int symbol_index = hardware_pointer->symbol_table[argValue];
-
     // Stores the value of accumulator into the address of the symbol
-    hardware_pointer->value_memory[symbol_index] = hardware_pointer->a;
+    hardware_pointer->value_memory[address] = hardware_pointer->a;
 
     hardware_pointer->pc++;  // Update program counter
 
@@ -355,6 +361,14 @@ void HLT::execute() {
 //
 // START OF ALI definitions
 //
+// Deletes the Instruction objects the loader created
+ALI::~ALI() {
+    for (auto &instruction : hw.instruction_memory) {
+        delete instruction;
+        instruction = nullptr;
+    }
+}
+
 // Runs the main command loop and executes the instructions
 void ALI::startExecution() {
     cout << "Please enter a filename that contains the SAL instructions: " << endl;
@@ -383,281 +397,584 @@ void ALI::startExecution() {
         }
     }
 
-    // Loop through the inputted SAL file line by line.
-    // Each line contains an instruction.
-    // Each instruction is put into memory.
-    while(getline(inputFile, currentLine)) {
-        // If the current line's instruction starts with DEC,
-        // then make a DEC instruction and put it into memory
-        if (currentLine.rfind("DEC", 0) == 0) {
-            DEC* dec = new DEC();  // New instance of DEC instruction
+    // Read, decode and link the instructions
+    inputFile.close();
+    string error;
+    if (!loadFile(filename, error)) {
+        cout << "Could not load the SAL instructions: " << error << endl;
+        return;
+    }
 
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            dec->hardware_pointer = &hw;
+    // Breakpoints and watchpoints of the c command
+    Debugger debugger(program);
 
-            // String manipulation to get the Instruction value after the Instruction
-            size_t index_of_space = currentLine.find(' ');
-            string instruction_value = currentLine.substr(index_of_space + 1);
+    // Main command loop
+    while (true) {
+        string command;
+        // b, w, d, l and c (breakpoints) are not in the prompt, it stays as it always was
+        cout << "Commands are q (quit), s (single), or a (all). Please enter a command: " << endl;
+        cin >> command;  // Get user input
 
-            // Update the DEC instruction value
-            dec->argValue = instruction_value;
+        // Quit the program if the user inputs q
+        if (command == "q"){
+            cout << "You have chosen to quit the program." << endl;
+            exit(0);
 
-            // Add the DEC instruction into memory
-            hw.instruction_memory[currentIndex] = dec;
+            // Execute a single line of code if user inputs s
+        } else if (command == "s" ){
+            // Execute the current instruction (a breakpoint there stops the next c again)
+            debugger.resumePc = -1;
+            if (run(1) == EXEC_FAULT) {
+                break;
+            }
 
-            // Check if the current line's string starts with LDA
-            // If so, we add LDA instruction into Hardware's memory
-        } else if (currentLine.rfind("LDA", 0) == 0) {
-            LDA* lda = new LDA();  // New instance of LDA instruction
+        } else if (command == "a"){
+            // Run until HLT. If it takes more than 1000 instructions (possible infinite
+            // loop), the user is asked once whether to continue or not.
+            // Nothing is run if HLT was already executed by s.
+            if (!halted && run(1000) == EXEC_BUDGET) {
+                string user_choice;
 
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            lda->hardware_pointer = &hw;
+                cout << "1000 instructions have been executed already in this a command." << endl;
+                cout << "Do you want to continue execution? Please enter n for no." << endl;
+                cout << "Any other input will continue execution." << endl;
 
-            // String manipulation to get the Instruction value after the Instruction
-            size_t index_of_space = currentLine.find(' ');
-            string instruction_value = currentLine.substr(index_of_space + 1);
+                cin >> user_choice;  // Get user input
 
-            // Update the LDA instruction value
-            lda->argValue = instruction_value;
+                // Anything but n runs the rest of the program
+                if (user_choice != "n") {
+                    run(LLONG_MAX);
+                }
+            }
 
-            // Put the instance of LDA we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = lda;
+            // After running through all instructions
+            // Break the input prompt loop as there are no more instructions left
+            break;
 
-            // If the current line's instruction starts with LDB,
-            // then make a LDB instruction and put it into memory
-        } else if (currentLine.rfind("LDB", 0) == 0) {
-            LDB* ldb = new LDB();  // New instance of LDB instruction
+            // Set a breakpoint, with a condition if anything follows the pc
+        } else if (command == "b") {
+            error.clear();
+            string rest;
+            getline(cin, rest);
+            istringstream line(rest);
+            int pc = 0;
+            string condition;
+            if (!(line >> pc)) {
+                error = "b needs a pc";
+            }
+            getline(line, condition);
 
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            ldb->hardware_pointer = &hw;
+            int id = error.empty() ? debugger.addBreakpoint(pc, condition, error) : -1;
+            if (id < 0) {
+                cout << "Could not set the breakpoint: " << error << endl;
+            } else {
+                cout << "Breakpoint " << id << " at pc " << pc << endl;
+            }
 
-            // String manipulation to get the Instruction value after the Instruction
-            size_t index_of_space = currentLine.find(' ');
-            string instruction_value = currentLine.substr(index_of_space + 1);
+            // Watch a symbol (the rest of the line is its name, like in DEC)
+        } else if (command == "w") {
+            string symbol;
+            error.clear();
+            getline(cin, symbol);
+            symbol.erase(0, symbol.find_first_not_of(' '));
+
+            int id = debugger.addWatchpoint(symbol, error);
+            if (id < 0) {
+                cout << "Could not set the watchpoint: " << error << endl;
+            } else {
+                cout << "Watchpoint " << id << " on " << symbol << endl;
+            }
 
-            // Update the LDB instruction value
-            ldb->argValue = instruction_value;
+        } else if (command == "d") {
+            int id = 0;
+            cin >> id;
+            if (!cin) {
+                cin.clear();
+            }
+            cout << (debugger.remove(id) ? "Deleted " : "There is no breakpoint or watchpoint ") << id << endl;
+
+        } else if (command == "l") {
+            debugger.list(cout);
+            cout.flush();
+
+        } else if (command == "c") {
+            // Run at full speed until a breakpoint or watchpoint is hit, HLT or an empty slot
+            long long budget = LLONG_MAX;
+            ExecStatus status = halted ? EXEC_HALTED : debugger.run(hw, budget);
+
+            if (status == EXEC_STOPPED) {
+                cout << debugger.report << endl;
+                cout << "Program counter: " << hw.pc << endl;
+                hw.dumpState(cout);
+                cout.flush();
+                continue;
+            }
+            if (status == EXEC_FAULT) {
+                cout << "No instruction at pc " << hw.pc << ", execution stopped." << endl;
+            } else if (!halted) {
+                halted = true;
+                cout << "HLT reached at pc " << hw.pc << endl;
+                hw.dumpState(cout);
+                cout.flush();
+            }
+            break;
+        }
+    }
+}
 
-            // Put the instance of LDB we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = ldb;
+// Runs the decoded program with the hook, counting every instruction into
+// the profile first if there is one
+template <typename Hook>
+static ExecStatus runHooked(Hardware& hw, const Program& program, long long& budget, Hook& hook, Profile* profile) {
+    if (profile == nullptr) {
+        return runDecoded(hw, program, budget, hook);
+    }
 
-            // If the current line's instruction starts with LDI,
-            // then make a LDI instruction and put it into memory
-        } else if (currentLine.rfind("LDI", 0) == 0) {
-            LDI* ldi = new LDI();  // New instance of LDI instruction
+    ProfileHook<Hook> profiled(*profile, hook);
+    return runDecoded(hw, program, budget, profiled);
+}
 
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            ldi->hardware_pointer = &hw;
+// Runs the file given on the command line without any prompts
+int ALI::runHeadless(const Options& options) {
+    string error;
+    bool atBreakpoint = false;  // The checkpoint stopped at a breakpoint at its pc
+
+    if (!options.restoreFile.empty()) {
+        // Continue a checkpointed run instead of loading a SAL file
+        filename = options.restoreFile;
+        if (!restoreCheckpoint(filename, hw, program, halted, atBreakpoint, error)) {
+            cerr << "minicpu: " << filename << ": " << error << endl;
+            return 1;
+        }
+    } else {
+        filename = options.filename;
 
-            // String manipulation to get the Instruction value after the Instruction
-            size_t index_of_space = currentLine.find(' ');
-            string instruction_value = currentLine.substr(index_of_space + 1);
+        if (!loadFile(filename, error)) {
+            cerr << "minicpu: " << filename << ": " << error << endl;
+            return 1;
+        }
+    }
 
-            // Update the LDI instruction value
-            ldi->argValue = instruction_value;
+    // Only write the program as C++
+    if (!options.transpileFile.empty()) {
+        if (!writeTranspiled(options.transpileFile, filename, program, error)) {
+            cerr << "minicpu: " << error << endl;
+            return 1;
+        }
+        return 0;
+    }
 
-            // Put the instance of LDI we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = ldi;
+    // Only write the precompiled program
+    if (!options.assembleFile.empty()) {
+        if (!saveBinaryProgram(options.assembleFile, program, (int) hw.value_memory.size(), error)) {
+            cerr << "minicpu: " << error << endl;
+            return 1;
+        }
+        return 0;
+    }
 
-            // If the current line's instruction starts with STR,
-            // then make STR instruction and put it into memory
-        } else if (currentLine.rfind("STR", 0) == 0) {
-            STR* str = new STR();  // New instance of STR instruction
+    // The pc the run stops at is reported as a line of the file
+    vector<int> origin;
+    if (options.optimize) {
+        OptimizeStats stats;
+        origin = optimizeProgram(program, stats);
+        fuseProgram(program, options.fusion, options.loopSkip);
+        cerr << "minicpu: " << filename << ": optimized: removed " << stats.removed() << " of "
+             << stats.instructions << " instructions (" << stats.loads << " loads, " << stats.stores
+             << " stores, " << stats.declarations << " declarations, " << stats.jumps << " jumps), "
+             << stats.branches << " branches always taken" << endl;
+    } else if (!options.fusion || !options.loopSkip) {
+        fuseProgram(program, options.fusion, options.loopSkip);
+    }
 
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            str->hardware_pointer = &hw;
+    // Breakpoints and watchpoints run a patched copy of the program (see Debugger)
+    unique_ptr<Debugger> debugger;
+    if (!options.breakpoints.empty() || !options.watchpoints.empty()) {
+        debugger.reset(new Debugger(program, options.fusion, options.loopSkip));
+        for (const auto& point : options.breakpoints) {
+            if (debugger->addBreakpoint(point.first, point.second, error) < 0) {
+                cerr << "minicpu: --break: " << error << endl;
+                return 1;
+            }
+        }
+        for (const string& symbol : options.watchpoints) {
+            if (debugger->addWatchpoint(symbol, error) < 0) {
+                cerr << "minicpu: --watchpoint: " << error << endl;
+                return 1;
+            }
+        }
+        if (atBreakpoint) {
+            debugger->resumePc = hw.pc;
+        }
+    }
 
-            // String manipulation to get the Instruction value after the Instruction
-            size_t index_of_space = currentLine.find(' ');
-            string instruction_value = currentLine.substr(index_of_space + 1);
+    // All output goes through one large buffer instead of a flush per line
+    OutputBuffer buffer(stdout);
+    ostream out(&buffer);
 
-            // Update the STR instruction value
-            str->argValue = instruction_value;
+    Profile profile(program);
+    Profile* profiling = options.profile ? &profile : nullptr;
 
-            // Put the instance of STR we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = str;
-
-            // If the current line's instruction starts with XCH,
-            // then make a XCH instruction and put it into memory
-        } else if (currentLine.rfind("XCH", 0) == 0) {
-            XCH* xch= new XCH();  // New instance of XCH instruction
+    TraceWriter writer;
+    if (!options.recordFile.empty() && !writer.open(options.recordFile, hw, program, error)) {
+        cerr << "minicpu: " << error << endl;
+        return 1;
+    }
 
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            xch->hardware_pointer = &hw;
+    // run() uses the interpreter if no native code could be generated
+    unique_ptr<JitProgram> jit;
+    if (options.engine == ENGINE_JIT && options.trace != TRACE_FULL && options.trace != TRACE_SUMMARY &&
+        !options.profile && options.recordFile.empty() && !options.detectCycles && !debugger) {
+        jit.reset(new JitProgram(program));
+        if (!jit->ready()) {
+            cerr << "minicpu: JIT not available, using the interpreter" << endl;
+        }
+    }
 
-            // Put the instance of XCH we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = xch;
+    // Looks for a repeated state at every back edge
+    CycleDetector cycles(hw, program);
+
+    // Each trace level runs its own instance of the engine, so the untraced
+    // run has no per instruction printing (or profiling) code at all
+    auto execute = [&](long long& left) {
+        if (debugger) {
+            return debugger->run(hw, left);
+        } else if (options.detectCycles) {
+            return runDecoded(hw, program, left, cycles);
+        } else if (!options.recordFile.empty()) {
+            RecordTrace trace(writer);
+            return runHooked(hw, program, left, trace, profiling);
+        } else if (options.trace == TRACE_FULL) {
+            DumpTrace trace(out);
+            return runHooked(hw, program, left, trace, profiling);
+        } else if (options.trace == TRACE_SUMMARY) {
+            SummaryTrace trace(out, program);
+            return runHooked(hw, program, left, trace, profiling);
+        } else if (options.profile) {
+            NoTrace trace;
+            return runHooked(hw, program, left, trace, profiling);
+        } else if (jit) {
+            return jit->run(hw, program, left);
+        } else if (options.engine == ENGINE_SWITCH) {
+            NoTrace trace;
+            return runDecoded<NoTrace, false>(hw, program, left, trace);
+        }
+        NoTrace trace;
+        return runDecoded(hw, program, left, trace);
+    };
+
+    // With --checkpoint-every the run is cut into slices and the checkpoint
+    // is written after each one. A program that already halted does not run.
+    long long budget = options.maxSteps;
+    ExecStatus status = halted ? EXEC_HALTED : EXEC_BUDGET;
+    auto start = chrono::steady_clock::now();
+
+    while (status == EXEC_BUDGET && budget > 0) {
+        long long slice = options.checkpointEvery > 0 ? min(budget, options.checkpointEvery) : budget;
+        long long left = slice;
+        cycles.startRun(options.maxSteps - budget);
+        status = execute(left);
+        budget -= slice - left;
+        halted = status == EXEC_HALTED;
+        atBreakpoint = debugger && debugger->resumePc == hw.pc;
+
+        if (options.checkpointEvery > 0 &&
+            !saveCheckpoint(options.checkpointFile, hw, program, halted, atBreakpoint, error)) {
+            cerr << "minicpu: " << error << endl;
+            return 1;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-            // If the current line's instruction starts with JMP,
-            // then make a JMP instruction and put it into memory
-        } else if (currentLine.rfind("JMP", 0) == 0) {
-            JMP* jmp = new JMP();  // New instance of JMP instruction
-
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            jmp->hardware_pointer = &hw;
-
-            // String manipulation to get the Instruction value after the Instruction
-            size_t index_of_space = currentLine.find(' ');
-            string instruction_value = currentLine.substr(index_of_space);
-
-            // Update the JMP instruction value
-            jmp->argValue = instruction_value;
+    // The detection run may have skipped loop iterations inside the cycle,
+    // and stopped anywhere in it
+    cycles.measure(hw, program);
+    if (!origin.empty()) {
+        hw.pc = origin[hw.pc];
+    }
+    if (debugger && !debugger->report.empty()) {
+        cerr << "minicpu: " << filename << ": " << debugger->report << " after "
+             << options.maxSteps - budget << " instructions" << endl;
+    }
 
-            // Put the instance of JMP we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = jmp;
+    if (!writer.close(error)) {
+        cerr << "minicpu: " << options.recordFile << ": " << error << endl;
+    }
+    if (!options.checkpointFile.empty() &&
+        !saveCheckpoint(options.checkpointFile, hw, program, halted, atBreakpoint, error)) {
+        cerr << "minicpu: " << error << endl;
+        return 1;
+    }
 
-            // If the current line's instruction starts with JZS,
-            // then make a JZS instruction and put it into memory
-        } else if (currentLine.rfind("JZS", 0) == 0) {
-            JZS* jzs = new JZS();  // New instance of JZS instruction
-
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            jzs->hardware_pointer = &hw;
-
-            // String manipulation to get the Instruction value after the Instruction
-            size_t index_of_space = currentLine.find(' ');
-            string instruction_value = currentLine.substr(index_of_space);
-
-            // Update the JZS instruction value
-            jzs->argValue = instruction_value;
+    if (options.trace != TRACE_NONE) {
+        printFinalState(out, hw, status, options.maxSteps - budget);
+        if (cycles.found) {
+            out << "Cycle: entered at pc " << cycles.pc << " after " << cycles.entered << " instructions, the state"
+                << " comes back every " << cycles.length << (cycles.length == 1 ? " instruction" : " instructions")
+                << ", the program never ends\n";
+        }
+    }
+    if (options.profile) {
+        if (options.trace != TRACE_NONE) {
+            out << "\n";
+        }
+        printProfile(out, program, profile, seconds);
+    }
+    out.flush();
 
-            // Put the instance of JZS we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = jzs;
+    if (status == EXEC_HALTED) {
+        return 0;
+    }
+    if (status == EXEC_STOPPED) {
+        return debugger ? 5 : 4;
+    }
+    return status == EXEC_FAULT ? 2 : 3;
+}
 
-            // If the current line's instruction starts with JVS,
-            // then make a JVS instruction and put it into memory
-        } else if (currentLine.rfind("JVS", 0) == 0) {
-            JVS* jvs = new JVS();  // New instance of JVS instruction
-
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            jvs->hardware_pointer = &hw;
-
-            // String manipulation to get the Instruction value after the Instruction
-            size_t index_of_space = currentLine.find(' ');
-            string instruction_value = currentLine.substr(index_of_space);
-
-            // Update the JVS instruction value
-            jvs->argValue = instruction_value;
+// Runs the file, then applies every edit of it and runs it again
+int ALI::runWatch(const Options& options) {
+    filename = options.filename;
+    string error;
+
+    // The stamp is taken first, so an edit made while loading is not missed
+    FileStamp stamp = fileStamp(filename);
+    ProgramSource source;
+    {
+        MappedFile file(filename);
+        if (!file.isOpen()) {
+            cerr << "minicpu: " << filename << ": could not open " << filename << endl;
+            return 1;
+        }
+        if (isBinaryProgram(file)) {
+            cerr << "minicpu: " << filename << ": --watch needs SAL source, not a precompiled program" << endl;
+            return 1;
+        }
+        if (!loadSource(file.data(), file.size(), error)) {
+            cerr << "minicpu: " << filename << ": " << error << endl;
+            return 1;
+        }
+        source.assign(file.data(), file.size());
+    }
+    if (!options.fusion || !options.loopSkip) {
+        fuseProgram(program, options.fusion, options.loopSkip);
+    }
 
-            // Put the instance of JVS we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = jvs;
+    OutputBuffer buffer(stdout);
+    ostream out(&buffer);
+
+    for (;;) {
+        long long left = options.maxSteps;
+        ExecStatus status;
+        if (options.trace == TRACE_FULL) {
+            DumpTrace trace(out);
+            status = runDecoded(hw, program, left, trace);
+        } else if (options.trace == TRACE_SUMMARY) {
+            SummaryTrace trace(out, program);
+            status = runDecoded(hw, program, left, trace);
+        } else if (options.engine == ENGINE_SWITCH) {
+            NoTrace trace;
+            status = runDecoded<NoTrace, false>(hw, program, left, trace);
+        } else {
+            NoTrace trace;
+            status = runDecoded(hw, program, left, trace);
+        }
+        if (options.trace != TRACE_NONE) {
+            printFinalState(out, hw, status, options.maxSteps - left);
+        }
+        out.flush();
+
+        // Wait for a version of the file that loads. A change is only taken
+        // once the file has stopped changing for a moment, so a save in
+        // progress (or an empty file while an editor rewrites it) is never
+        // applied.
+        ReloadStats stats;
+        double seconds;
+        for (;;) {
+            this_thread::sleep_for(chrono::milliseconds(100));
+            FileStamp now = fileStamp(filename);
+            if (now == stamp || now.size <= 0) {
+                continue;
+            }
+            this_thread::sleep_for(chrono::milliseconds(50));
+            if (fileStamp(filename) != now) {
+                continue;
+            }
+            stamp = now;
 
-            // If the current line's instruction starts with ADD,
-            // then make ADD instruction and put it into memory
-        } else if (currentLine.rfind("ADD", 0) == 0) {
-            ADD* add = new ADD();  // New instance of ADD instruction
-
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            add->hardware_pointer = &hw;
-
-            // Put the instance of ADD we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = add;
-
-            // The last instruction is
-        } else if (currentLine.rfind("HLT", 0) == 0) {
-            HLT* hlt = new HLT();  // New instance of HLT instruction
-
-            // Update the instruction's hardware pointer
-            // with the address of the hw instance
-            hlt->hardware_pointer = &hw;
-
-            // Put the instance of HLT we just made into the instruction memory
-            // found of the Hardware Class
-            hw.instruction_memory[currentIndex] = hlt;
+            MappedFile file(filename);
+            if (!file.isOpen()) {
+                continue;
+            }
+            auto start = chrono::steady_clock::now();
+            bool reloaded = source.reload(file.data(), file.size(), hw, program, options.fusion,
+                                          options.loopSkip, stats, error);
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (reloaded) {
+                break;
+            }
+            cerr << "minicpu: " << filename << ": " << error << " (keeping the loaded version)" << endl;
         }
+        currentIndex = program.length;
 
-        currentIndex++;  // Increase the current index of the memory array by one
+        // A pc past the end stops at the sentinel like a jump out of the program
+        if (options.resumePc >= 0) {
+            hw.pc = options.resumePc;
+        }
+        hw.pc = min(hw.pc, program.length);
+        out << "\nReloaded " << filename << " in " << (long long) (seconds * 1e6) << " us: "
+            << stats.decoded << " lines decoded, symbols " << stats.kept << " kept, " << stats.moved
+            << " moved, " << stats.added << " added, " << stats.dropped << " dropped; resuming at pc "
+            << hw.pc << "\n\n";
     }
+}
 
-    // Main command loop
-    while (true) {
-        string command;
-        cout << "Commands are q (quit), s (single), or a (all). Please enter a command: " << endl;
-        cin >> command;  // Get user input
-
-        // Quit the program if the user inputs q
-        if (command == "q"){
-            cout << "You have chosen to quit the program." << endl;
-            exit(0);
+// Maps the SAL file into memory, then decodes and links it
+bool ALI::loadFile(const string& name, string& error) {
+    MappedFile file(name);
+    if (!file.isOpen()) {
+        error = "could not open " + name;
+        return false;
+    }
+    if (!isBinaryProgram(file)) {
+        return loadSource(file.data(), file.size(), error);
+    }
 
-            // Execute a single line of code if user inputs s
-        } else if (command == "s" ){
-            // Execute the current instruction
-            hw.instruction_memory[hw.pc]->execute();
+    // Precompiled program: already decoded and linked, it decides the memory
+    // size like a checkpoint does
+    int memorySize;
+    if (!loadBinaryProgram(file, program, memorySize, error)) {
+        return false;
+    }
+    hw.value_memory.assign(memorySize, 0);
+    currentIndex = program.length;
+    return true;
+}
 
-        } else if (command == "a"){
-            // Counter that stores the number of instruction executed in this a command
-            // This is for infinite instruction loops. If it hits 1000 (1000 instructions)
-            // then, I will prompt user to continue or not with automatic all instructions.
-            int counter = 0;
-
-            // Used for checking if the user wants to continue this a loop after 1000 instructions
-            // If so, it will become true, meaning the user wants to continue the loop
-            bool continue_loop = false;
-
-            // Loop through memory until we find a HLT instruction
-            while (hw.instruction_memory[hw.pc]->printString != "HLT"){
-                // After 1000 instructions executed in the loop, it will prompt the user
-                // to continue the automatic instruction execution. If not, then the current
-                // loop will break. The can choose to do other commands or quit after in
-                // the normal command loop.
-                if (counter >= 1000 && !continue_loop) {
-                    string user_choice;
-
-                    cout << "1000 instructions have been executed already in this a command." << endl;
-                    cout << "Do you want to continue execution? Please enter n for no." << endl;
-                    cout << "Any other input will continue execution." << endl;
-
-                    cin >> user_choice;  // Get user input
-
-                    // Breaks the automatic instruction execution loop
-                    if (user_choice == "n") {
-                        break;
-                    }
-
-                    continue_loop = true;  // User wants to continue automatic cmd loop
-                }
+// Decodes and links the SAL source
+bool ALI::loadSource(const char* text, size_t size, string& error) {
+    // Decode the whole file in one pass, so running it does not parse
+    // operands again, then bind every symbol to its address so memory
+    // accesses are plain array indexing
+    if (!parseProgram(text, size, (int) hw.value_memory.size(), program, error) ||
+        !linkProgram(hw, program, error)) {
+        return false;
+    }
 
-                // Execute the current instruction
-                hw.instruction_memory[hw.pc]->execute();
+    currentIndex = program.length;  // Every line took one slot
+    return true;
+}
 
-                counter++;  // Update counter by one
-            }
+// Creates the Instruction objects of the loaded program in instruction_memory
+void ALI::buildInstructions() {
+    hw.instruction_memory.resize(hw.value_memory.size(), nullptr);
+
+    for (int pc = 0; pc < program.length; pc++) {
+        const DecodedInstruction& decoded = program.code[pc];
+        Instruction* instruction;
+
+        // Make the instruction of the right class, empty slots stay nullptr
+        switch (decoded.opcode) {
+            case OP_DEC: instruction = new DEC(); break;
+            case OP_LDA: instruction = new LDA(); break;
+            case OP_LDB: instruction = new LDB(); break;
+            case OP_LDI: instruction = new LDI(); break;
+            case OP_STR: instruction = new STR(); break;
+            case OP_XCH: instruction = new XCH(); break;
+            case OP_JMP: instruction = new JMP(); break;
+            case OP_JZS: instruction = new JZS(); break;
+            case OP_JVS: instruction = new JVS(); break;
+            case OP_ADD: instruction = new ADD(); break;
+            case OP_HLT: instruction = new HLT(); break;
+            default: continue;
+        }
 
-            // After the while loop that goes through all instructions
-            // Break the input prompt loop as there are no more instructions left
-            break;
+        // Same operand text and address the decoded program uses
+        instruction->hardware_pointer = &hw;
+        instruction->argValue = program.argText[pc];
+        if (decoded.opcode == OP_DEC) {
+            instruction->address = program.addresses[decoded.operand];
+        } else if (decoded.opcode == OP_LDA || decoded.opcode == OP_LDB || decoded.opcode == OP_STR) {
+            instruction->address = decoded.operand;
         }
+
+        delete hw.instruction_memory[pc];
+        hw.instruction_memory[pc] = instruction;
+    }
+}
+
+// Runs at most budget instructions of the decoded program, printing the
+// state after each one
+ExecStatus ALI::run(long long budget) {
+    DumpTrace trace(cout);
+    ExecStatus status = runDecoded(hw, program, budget, trace);
+
+    if (status == EXEC_HALTED) {
+        halted = true;
+    } else if (status == EXEC_FAULT) {
+        cout << "No instruction at pc " << hw.pc << ", execution stopped." << endl;
     }
+
+    cout.flush();
+    return status;
 }
 //
 // END OF ALI definitions
 //
 
 
-int main(){
-    ALI my_ALI;
+int main(int argc, char* argv[]){
+    // Without arguments, ask for the file and run the command loop
+    if (argc == 1) {
+        ALI my_ALI;
+        my_ALI.startExecution();  // Runs the whole program
+        return 0;
+    }
+
+    // Otherwise run the file given on the command line without prompts
+    Options options;
+    string error;
+    if (!parseOptions(argc, argv, options, error)) {
+        cerr << "minicpu: " << error << endl;
+        printUsage(cerr);
+        return 1;
+    }
+
+    if (options.help) {
+        printUsage(cout);
+        return 0;
+    }
 
-    my_ALI.startExecution();  // Runs the whole program
+    if (options.decodeTrace) {
+        OutputBuffer buffer(stdout);
+        ostream out(&buffer);
+        if (!decodeTrace(options.filename, options.traceFirst, options.traceCount, out, error)) {
+            cerr << "minicpu: " << options.filename << ": " << error << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (!options.batchFile.empty() || options.batchFiles) {
+        return runBatch(options);
+    }
+    if (!options.scheduleFile.empty()) {
+        return runSchedule(options);
+    }
+    if (!options.serveSocket.empty()) {
+        return runServer(options);
+    }
+    if (!options.clientSocket.empty()) {
+        return runClient(options);
+    }
+    if (options.benchSuite) {
+        return runBenchmarkSuite(options);
+    }
+    if (options.bench) {
+        return runBenchmark(options);
+    }
 
-    return 0;
+    ALI my_ALI(options.memorySize);
+    if (options.watch) {
+        return my_ALI.runWatch(options);
+    }
+    return my_ALI.runHeadless(options);
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "mappedfile.h"
+
+using namespace std;
+
+//
+// Start of MappedFile definitions
+//
+MappedFile::MappedFile(const string& filename) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        open = true;
+        length = (size_t) info.st_size;
+
+        if (length > 0) {
+            void* region = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (region != MAP_FAILED) {
+                bytes = (const char*) region;
+                mapped = true;
+            } else {
+                open = false;
+            }
+        }
+    }
+    ::close(fd);
+#else
+    ifstream in(filename, ios::binary);
+    if (!in.is_open()) {
+        return;
+    }
+    copy.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    open = true;
+    bytes = copy.data();
+    length = copy.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapped) {
+        munmap((void*) bytes, length);
+    }
+#endif
+}
+//
+// End of MappedFile definitions
+//
+
+
+
+//
+// Start of section file definitions
+//
+// Appends the bytes of the array at the next 8 byte boundary and returns its offset
+uint64_t appendSection(string& file, const void* data, size_t size) {
+    file.resize((file.size() + 7) & ~(size_t) 7, '\0');
+    uint64_t offset = file.size();
+    file.append((const char*) data, size);
+    return offset;
+}
+
+// Writes contents next to filename and renames it over filename once complete
+bool replaceFile(const string& filename, const string& contents, string& error) {
+    string temporary = filename + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if (out == nullptr) {
+        error = "could not create " + temporary;
+        return false;
+    }
+    bool written = fwrite(contents.data(), 1, contents.size(), out) == contents.size();
+    written = fclose(out) == 0 && written;
+    if (!written || rename(temporary.c_str(), filename.c_str()) != 0) {
+        remove(temporary.c_str());
+        error = "could not write " + filename;
+        return false;
+    }
+    return true;
+}
+//
+// End of section file definitions
+//
@@ -0,0 +1,68 @@
+//
+// Created by Michal
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef MINICPU_MAPPEDFILE_H
+#define MINICPU_MAPPEDFILE_H
+
+//
+// Start of MappedFile
+//
+class MappedFile {
+    // Read only view of a whole file: mmap'd where the platform has mmap,
+    // otherwise read into memory. The bytes stay valid until the object is
+    // destroyed.
+public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // True if the file could be opened (an empty file is open with size 0)
+    bool isOpen() const { return open; }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    // True if count entries of size bytes at offset lie inside the file
+    bool contains(uint64_t offset, uint64_t count, uint64_t size) const {
+        return offset <= length && count <= (length - offset) / size;
+    }
+
+private:
+    bool open = false;           // File was opened
+    bool mapped = false;         // bytes points into an mmap'd region
+    const char* bytes = nullptr; // Contents of the file
+    size_t length = 0;           // Size of the file
+    std::vector<char> copy;      // Contents when they could not be mapped
+};
+//
+// End of MappedFile
+//
+
+
+
+//
+// Start of section files
+//
+// Checkpoints and binary programs are a fixed header followed by sections,
+// each 8 byte aligned so MappedFile data can be read in place.
+
+// Appends the bytes of the array at the next 8 byte boundary and returns its offset
+uint64_t appendSection(std::string& file, const void* data, size_t size);
+
+// Writes contents next to filename and renames it over filename once
+// complete, so an interrupted write never leaves a broken file behind.
+// Returns false and sets error if it cannot be written.
+bool replaceFile(const std::string& filename, const std::string& contents, std::string& error);
+//
+// End of section files
+//
+
+#endif //MINICPU_MAPPEDFILE_H
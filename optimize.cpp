@@ -0,0 +1,499 @@
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include "bytecode.h"
+#include "optimize.h"
+
+using namespace std;
+
+//
+// Start of optimizer helpers
+//
+// Largest number of (block, symbol) pairs the passes keep state for. Bigger
+// programs are left as they are.
+static const size_t largestState = 1 << 24;
+
+// What happens to an instruction
+enum Action {
+    KEEP,
+    REMOVE_LOAD,
+    REMOVE_STORE,
+    REMOVE_DEC,
+    REMOVE_JUMP,
+    MAKE_JMP  // JZS/JVS that always jumps
+};
+
+// A register, bit or memory slot whose value may be known
+struct Known {
+    bool known = false;
+    long long value = 0;
+};
+
+static bool sameKnown(const Known& x, const Known& y) {
+    return x.known && y.known && x.value == y.value;
+}
+
+static Known knownValue(long long value) {
+    Known result;
+    result.known = true;
+    result.value = value;
+    return result;
+}
+
+// What holds at one point of the program on every path that reaches it
+struct FlowState {
+    bool reached = false;
+    Known a, b, zero, overflow;
+    vector<Known> memory;  // Per symbol id
+    vector<char> aHolds;   // Per symbol id: A is equal to the symbol's value
+    vector<char> bHolds;   // Per symbol id: B is equal to the symbol's value
+    vector<char> bound;    // Per symbol id: its DEC ran
+};
+
+// After a register changed: the symbols known to hold the same constant
+static void matchConstant(vector<char>& holds, const Known& value, const vector<Known>& memory) {
+    for (size_t symbol = 0; symbol < holds.size(); symbol++) {
+        holds[symbol] = sameKnown(value, memory[symbol]) ? 1 : 0;
+    }
+}
+
+// Keeps only what also holds in other. Returns true if anything was dropped.
+static bool meet(Known& known, const Known& other) {
+    if (known.known && !sameKnown(known, other)) {
+        known.known = false;
+        return true;
+    }
+    return false;
+}
+
+static bool meet(vector<char>& flags, const vector<char>& other) {
+    bool changed = false;
+    for (size_t i = 0; i < flags.size(); i++) {
+        if (flags[i] != 0 && other[i] == 0) {
+            flags[i] = 0;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Merges the state at the end of a predecessor into the state of a block.
+// Returns true if the block has to be looked at (again).
+static bool merge(FlowState& state, const FlowState& incoming) {
+    if (!state.reached) {
+        state = incoming;
+        return true;
+    }
+    bool changed = meet(state.a, incoming.a);
+    changed = meet(state.b, incoming.b) || changed;
+    changed = meet(state.zero, incoming.zero) || changed;
+    changed = meet(state.overflow, incoming.overflow) || changed;
+    for (size_t symbol = 0; symbol < state.memory.size(); symbol++) {
+        changed = meet(state.memory[symbol], incoming.memory[symbol]) || changed;
+    }
+    changed = meet(state.aHolds, incoming.aHolds) || changed;
+    changed = meet(state.bHolds, incoming.bHolds) || changed;
+    changed = meet(state.bound, incoming.bound) || changed;
+    return changed;
+}
+
+// Decides what happens to the instruction in this state and moves the state
+// past it. symbol is the symbol id of the operand (-1 if none).
+static Action step(FlowState& state, const DecodedInstruction& instruction, int symbol) {
+    switch (instruction.opcode) {
+        case OP_DEC:
+            if (state.bound[symbol] != 0) {
+                return REMOVE_DEC;
+            }
+            state.bound[symbol] = 1;
+            return KEEP;
+
+        case OP_LDA:
+            if (state.aHolds[symbol] != 0 || sameKnown(state.a, state.memory[symbol])) {
+                return REMOVE_LOAD;
+            }
+            state.a = state.memory[symbol];
+            matchConstant(state.aHolds, state.a, state.memory);
+            state.aHolds[symbol] = 1;
+            return KEEP;
+
+        case OP_LDB:
+            if (state.bHolds[symbol] != 0 || sameKnown(state.b, state.memory[symbol])) {
+                return REMOVE_LOAD;
+            }
+            state.b = state.memory[symbol];
+            matchConstant(state.bHolds, state.b, state.memory);
+            state.bHolds[symbol] = 1;
+            return KEEP;
+
+        case OP_LDI:
+            if (sameKnown(state.a, knownValue(instruction.operand))) {
+                return REMOVE_LOAD;
+            }
+            state.a = knownValue(instruction.operand);
+            matchConstant(state.aHolds, state.a, state.memory);
+            return KEEP;
+
+        case OP_STR:
+            if (state.aHolds[symbol] != 0 || sameKnown(state.a, state.memory[symbol])) {
+                return REMOVE_STORE;
+            }
+            state.memory[symbol] = state.a;
+            state.aHolds[symbol] = 1;
+            state.bHolds[symbol] = sameKnown(state.a, state.b) ? 1 : 0;
+            return KEEP;
+
+        case OP_XCH: {
+            bool equal = sameKnown(state.a, state.b);
+            for (size_t s = 0; s < state.aHolds.size() && !equal; s++) {
+                equal = state.aHolds[s] != 0 && state.bHolds[s] != 0;
+            }
+            if (equal) {
+                return REMOVE_LOAD;
+            }
+            swap(state.a, state.b);
+            swap(state.aHolds, state.bHolds);
+            return KEEP;
+        }
+
+        case OP_ADD:
+            // Same rules as addRegisters, on whatever is known
+            if (state.a.known && state.b.known) {
+                long long result = state.a.value + state.b.value;
+                if (result <= -2147483648LL || result >= 2147483647LL) {
+                    state.overflow = knownValue(1);
+                    return KEEP;
+                }
+                state.a = knownValue(result);
+                if (result == 0) {
+                    state.zero = knownValue(1);
+                } else {
+                    state.zero = knownValue(0);
+                    state.overflow = knownValue(0);
+                }
+            } else {
+                state.a = Known();
+                state.zero = Known();
+                state.overflow = Known();
+            }
+            matchConstant(state.aHolds, state.a, state.memory);
+            return KEEP;
+
+        case OP_JZS:
+        case OP_JVS: {
+            const Known& bit = instruction.opcode == OP_JZS ? state.zero : state.overflow;
+            if (bit.known) {
+                return bit.value != 0 ? MAKE_JMP : REMOVE_JUMP;
+            }
+            return KEEP;
+        }
+
+        default:
+            return KEEP;
+    }
+}
+
+// Appends the pcs control can go to after the last instruction of a block
+static void successors(const DecodedInstruction& last, int pc, Action action, vector<int>& next) {
+    next.clear();
+    switch (last.opcode) {
+        case OP_HLT:
+        case OP_NONE:
+            break;
+        case OP_JMP:
+            next.push_back(last.operand);
+            break;
+        case OP_JZS:
+        case OP_JVS:
+            if (action != MAKE_JMP) {
+                next.push_back(pc + 1);
+            }
+            if (action != REMOVE_JUMP) {
+                next.push_back(last.operand);
+            }
+            break;
+        default:
+            next.push_back(pc + 1);
+            break;
+    }
+}
+
+// Liveness of one instruction, walking backwards: live holds what is read
+// later (index 0 is A, 1 is B, 2 + symbol id the symbols) and becomes what
+// is read from before the instruction on. Returns false if the instruction
+// is dead: it only writes something nobody reads.
+static bool live(vector<char>& live, const DecodedInstruction& instruction, int symbol) {
+    switch (instruction.opcode) {
+        case OP_LDA:
+        case OP_LDI:
+            if (live[0] == 0) {
+                return false;
+            }
+            live[0] = 0;
+            if (instruction.opcode == OP_LDA) {
+                live[2 + symbol] = 1;
+            }
+            return true;
+
+        case OP_LDB:
+            if (live[1] == 0) {
+                return false;
+            }
+            live[1] = 0;
+            live[2 + symbol] = 1;
+            return true;
+
+        case OP_STR:
+            if (live[2 + symbol] == 0) {
+                return false;
+            }
+            live[2 + symbol] = 0;
+            live[0] = 1;
+            return true;
+
+        case OP_XCH:
+            if (live[0] == 0 && live[1] == 0) {
+                return false;
+            }
+            swap(live[0], live[1]);
+            return true;
+
+        case OP_ADD:
+            // A is kept when the result overflows, so it is read as well
+            live[0] = 1;
+            live[1] = 1;
+            return true;
+
+        case OP_HLT:
+        case OP_NONE:
+            // The final state shows everything
+            fill(live.begin(), live.end(), 1);
+            return true;
+
+        default:
+            return true;
+    }
+}
+//
+// End of optimizer helpers
+//
+
+
+
+//
+// Start of optimizeProgram definitions
+//
+vector<int> optimizeProgram(Program& program, OptimizeStats& stats) {
+    const int length = program.length;
+    const int symbols = (int) program.symbols.size();
+    const vector<DecodedInstruction>& code = program.code;
+
+    stats = OptimizeStats();
+    vector<int> origin;
+    for (int pc = 0; pc <= length; pc++) {
+        origin.push_back(pc);
+        if (pc < length && code[pc].opcode != OP_NONE) {
+            stats.instructions++;
+        }
+    }
+
+    // Symbol id of the operand of every instruction (LDA/LDB/STR hold addresses)
+    unordered_map<int, int> symbolAt;
+    for (int symbol = 0; symbol < symbols; symbol++) {
+        symbolAt[program.addresses[symbol]] = symbol;
+    }
+    vector<int> symbolOf(length + 1, -1);
+    for (int pc = 0; pc < length; pc++) {
+        const int opcode = code[pc].opcode;
+        if (opcode == OP_DEC) {
+            symbolOf[pc] = code[pc].operand;
+        } else if (opcode == OP_LDA || opcode == OP_LDB || opcode == OP_STR) {
+            symbolOf[pc] = symbolAt[code[pc].operand];
+        }
+    }
+
+    // Basic blocks: they start at pc 0, at jump targets and after every
+    // jump, HLT and empty slot. The sentinel is a block of its own.
+    vector<char> leader(length + 1, 0);
+    leader[0] = 1;
+    leader[length] = 1;
+    for (int pc = 0; pc < length; pc++) {
+        const int opcode = code[pc].opcode;
+        if (opcode == OP_JMP || opcode == OP_JZS || opcode == OP_JVS) {
+            leader[code[pc].operand] = 1;
+        }
+        if (endsRun(opcode) || opcode == OP_NONE) {
+            leader[pc + 1] = 1;
+        }
+    }
+    vector<int> starts;                   // First pc of every block
+    vector<int> blockOf(length + 1, -1);  // Block starting at pc
+    for (int pc = 0; pc <= length; pc++) {
+        if (leader[pc] != 0) {
+            blockOf[pc] = (int) starts.size();
+            starts.push_back(pc);
+        }
+    }
+    const int blocks = (int) starts.size();
+    starts.push_back(length + 1);
+    if ((size_t) blocks * (size_t) (symbols + 2) > largestState) {
+        return origin;
+    }
+
+    // Forward pass. The machine starts with everything 0 and no symbol declared.
+    vector<FlowState> entry(blocks);
+    {
+        FlowState& first = entry[0];
+        first.reached = true;
+        first.a = first.b = first.zero = first.overflow = knownValue(0);
+        first.memory.assign(symbols, knownValue(0));
+        first.aHolds.assign(symbols, 1);
+        first.bHolds.assign(symbols, 1);
+        first.bound.assign(symbols, 0);
+    }
+    vector<Action> action(length + 1, KEEP);
+    vector<int> next;
+    vector<int> work(1, 0);
+    vector<char> queued(blocks, 0);
+    queued[0] = 1;
+    while (!work.empty()) {
+        const int block = work.back();
+        work.pop_back();
+        queued[block] = 0;
+
+        FlowState state = entry[block];
+        int last = starts[block + 1] - 1;
+        for (int pc = starts[block]; pc <= last; pc++) {
+            action[pc] = step(state, code[pc], symbolOf[pc]);
+        }
+        successors(code[last], last, action[last], next);
+        for (int target : next) {
+            const int successor = blockOf[target];
+            if (merge(entry[successor], state) && queued[successor] == 0) {
+                queued[successor] = 1;
+                work.push_back(successor);
+            }
+        }
+    }
+
+    // Backward pass on the program without what the forward pass removed,
+    // until no more dead instructions turn up
+    vector<vector<char>> liveIn(blocks, vector<char>(symbols + 2, 0));
+    vector<char> now;
+    for (bool removing = true; removing;) {
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (int block = blocks - 1; block >= 0; block--) {
+                int last = starts[block + 1] - 1;
+                now.assign(symbols + 2, 0);
+                successors(code[last], last, action[last], next);
+                for (int target : next) {
+                    const vector<char>& in = liveIn[blockOf[target]];
+                    for (int i = 0; i < symbols + 2; i++) {
+                        now[i] |= in[i];
+                    }
+                }
+                for (int pc = last; pc >= starts[block]; pc--) {
+                    if (action[pc] == KEEP || action[pc] == MAKE_JMP) {
+                        live(now, code[pc], symbolOf[pc]);
+                    }
+                }
+                if (now != liveIn[block]) {
+                    liveIn[block] = now;
+                    changed = true;
+                }
+            }
+        }
+
+        removing = false;
+        for (int block = 0; block < blocks; block++) {
+            int last = starts[block + 1] - 1;
+            now.assign(symbols + 2, 0);
+            successors(code[last], last, action[last], next);
+            for (int target : next) {
+                const vector<char>& in = liveIn[blockOf[target]];
+                for (int i = 0; i < symbols + 2; i++) {
+                    now[i] |= in[i];
+                }
+            }
+            for (int pc = last; pc >= starts[block]; pc--) {
+                if (action[pc] != KEEP) {
+                    continue;
+                }
+                if (!live(now, code[pc], symbolOf[pc])) {
+                    action[pc] = code[pc].opcode == OP_STR ? REMOVE_STORE : REMOVE_LOAD;
+                    removing = true;
+                }
+            }
+        }
+    }
+
+    // A JMP to the next instruction that is left does nothing
+    int nextKept = length;
+    for (int pc = length - 1; pc >= 0; pc--) {
+        const int opcode = code[pc].opcode;
+        if ((opcode == OP_JMP || action[pc] == MAKE_JMP) && code[pc].operand > pc &&
+            nextKept >= code[pc].operand) {
+            action[pc] = REMOVE_JUMP;
+        }
+        if (action[pc] == KEEP || action[pc] == MAKE_JMP) {
+            nextKept = pc;
+        }
+    }
+
+    // New pc of every pc: the first instruction left at or after it
+    vector<int> moved(length + 1);
+    int kept = 0;
+    for (int pc = 0; pc <= length; pc++) {
+        moved[pc] = kept;
+        if (pc < length && (action[pc] == KEEP || action[pc] == MAKE_JMP)) {
+            kept++;
+        }
+    }
+    for (int pc = length; pc >= 0; pc--) {
+        if (pc < length && action[pc] != KEEP && action[pc] != MAKE_JMP) {
+            moved[pc] = moved[pc + 1];
+        }
+    }
+
+    vector<DecodedInstruction> optimized;
+    OperandText argText;
+    origin.clear();
+    for (int pc = 0; pc < length; pc++) {
+        switch (action[pc]) {
+            case REMOVE_LOAD:  stats.loads++; continue;
+            case REMOVE_STORE: stats.stores++; continue;
+            case REMOVE_DEC:   stats.declarations++; continue;
+            case REMOVE_JUMP:  stats.jumps++; continue;
+            case MAKE_JMP:     stats.branches++; break;
+            default:           break;
+        }
+
+        DecodedInstruction instruction = code[pc];
+        if (action[pc] == MAKE_JMP) {
+            instruction.opcode = OP_JMP;
+        }
+        if (instruction.opcode == OP_JMP || instruction.opcode == OP_JZS || instruction.opcode == OP_JVS) {
+            instruction.operand = moved[instruction.operand];
+            argText.append(" " + to_string(instruction.operand));
+        } else {
+            argText.append(program.argText[pc]);
+        }
+        optimized.push_back(instruction);
+        origin.push_back(pc);
+    }
+    origin.push_back(length);
+    argText.append("N/A", 3);  // Sentinel
+    optimized.push_back(DecodedInstruction{OP_NONE, 0});
+
+    program.code = optimized;
+    program.argText = argText;
+    program.length = kept;
+    program.handlers.clear();
+    computeRunLengths(program);
+    return origin;
+}
+//
+// End of optimizeProgram definitions
+//
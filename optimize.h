@@ -0,0 +1,52 @@
+//
+// Created by Michal
+//
+
+#include <vector>
+
+#ifndef MINICPU_OPTIMIZE_H
+#define MINICPU_OPTIMIZE_H
+
+class Program;
+
+//
+// Start of optimizeProgram
+//
+// What optimizeProgram removed
+struct OptimizeStats {
+    int instructions = 0;  // Instructions before (lines that hold one)
+    int loads = 0;         // LDA/LDB/LDI/XCH that changed nothing or whose result was never used
+    int stores = 0;        // STR of a value already stored, or overwritten before it is read
+    int declarations = 0;  // DEC of a symbol every path to it had declared already
+    int jumps = 0;         // JZS/JVS that can never jump, JMPs to the next instruction
+    int branches = 0;      // JZS/JVS that always jump, now JMP (not removed)
+
+    int removed() const { return loads + stores + declarations + jumps; }
+};
+
+// Rewrites the linked program without the instructions that cannot change
+// what it does, for a run that starts on a freshly loaded machine (registers,
+// bits and memory 0). The final state (registers, bits, pc, declared symbols
+// and their values) is the same when the program halts or runs into an empty
+// slot; only fewer instructions are executed.
+//
+// The control flow graph comes from the jump targets. A forward pass works
+// out, for the start of every instruction, which registers, bits and memory
+// slots hold a known constant, which slots register A and B are equal to and
+// which symbols are declared on every path (JZS/JVS whose bit is known only
+// follow one edge). That removes loads of a value a register already holds,
+// stores of a value the slot already holds, repeated DECs and JZS/JVS that
+// never jump. A backward liveness pass then removes stores and loads whose
+// value is overwritten on every path before it is read (HLT and empty slots
+// read everything). ADD is always kept, it is the only instruction that sets
+// the bits.
+//
+// Symbol addresses stay as they are. fused is dropped, call fuseProgram
+// again. Returns the pc of the original program for every pc of the new one
+// (one more for the sentinel), to report the pc the run stopped at.
+std::vector<int> optimizeProgram(Program& program, OptimizeStats& stats);
+//
+// End of optimizeProgram
+//
+
+#endif //MINICPU_OPTIMIZE_H
@@ -0,0 +1,492 @@
+#include <string>
+#include <ostream>
+#include <stdexcept>
+#include "trace.h"
+#include "options.h"
+
+using namespace std;
+
+//
+// Start of run mode compatibility
+//
+// Options that pick what runs or change how a run goes
+enum RunMode {
+    MODE_FILE = 1 << 0,            // A SAL file (or trace file) is given, only used in ModeRule::needs
+    MODE_TRANSPILE = 1 << 1,
+    MODE_ASSEMBLE = 1 << 2,
+    MODE_DECODE_TRACE = 1 << 3,
+    MODE_BENCH = 1 << 4,
+    MODE_BENCH_SUITE = 1 << 5,
+    MODE_SERVE = 1 << 6,
+    MODE_CLIENT = 1 << 7,
+    MODE_SCHEDULE = 1 << 8,
+    MODE_BATCH = 1 << 9,           // --batch=INPUTS or --batch
+    MODE_WATCH = 1 << 10,
+    MODE_OPTIMIZE = 1 << 11,
+    MODE_BREAK = 1 << 12,
+    MODE_WATCHPOINT = 1 << 13,
+    MODE_DETECT_CYCLES = 1 << 14,
+    MODE_RECORD = 1 << 15,
+    MODE_PROFILE = 1 << 16,
+    MODE_TRACE = 1 << 17,          // --trace=full or summary
+    MODE_RESTORE = 1 << 18,
+    MODE_CHECKPOINT = 1 << 19
+};
+
+struct ModeRule {
+    int mode;              // One of RunMode
+    const char* name;      // Option as given on the command line
+    int needs;             // One of these has to be given too (MODE_FILE, MODE_RESTORE), 0 for none
+    int worksWith;         // The only other modes it can be combined with
+};
+
+// Every mode with what it works with. A combination is accepted only if the
+// rows of both modes list each other, so a new mode is refused together with
+// every other one until it is added to their rows.
+static const ModeRule modeRules[] = {
+    {MODE_TRANSPILE, "--transpile", MODE_FILE, 0},
+    {MODE_ASSEMBLE, "--assemble", MODE_FILE, 0},
+    {MODE_DECODE_TRACE, "--decode-trace", 0, 0},
+    {MODE_BENCH, "--bench", MODE_FILE, 0},
+    {MODE_BENCH_SUITE, "--bench-suite", 0, 0},
+    {MODE_SERVE, "--serve", 0, 0},
+    {MODE_CLIENT, "--client", 0, 0},
+    {MODE_SCHEDULE, "--schedule", 0, 0},
+    {MODE_BATCH, "--batch", MODE_FILE, 0},
+    {MODE_WATCH, "--watch", MODE_FILE, MODE_TRACE},
+    {MODE_OPTIMIZE, "--optimize", MODE_FILE, 0},
+    {MODE_BREAK, "--break", MODE_FILE | MODE_RESTORE, MODE_WATCHPOINT | MODE_RESTORE | MODE_CHECKPOINT},
+    {MODE_WATCHPOINT, "--watchpoint", MODE_FILE | MODE_RESTORE, MODE_BREAK | MODE_RESTORE | MODE_CHECKPOINT},
+    {MODE_DETECT_CYCLES, "--detect-cycles", 0, MODE_RESTORE | MODE_CHECKPOINT},
+    {MODE_RECORD, "--record", 0, MODE_PROFILE | MODE_RESTORE | MODE_CHECKPOINT},
+    {MODE_PROFILE, "--profile", 0, MODE_RECORD | MODE_TRACE | MODE_RESTORE | MODE_CHECKPOINT},
+    {MODE_TRACE, "--trace", 0, MODE_WATCH | MODE_PROFILE | MODE_RESTORE | MODE_CHECKPOINT},
+    {MODE_RESTORE, "--restore", 0,
+     MODE_BREAK | MODE_WATCHPOINT | MODE_DETECT_CYCLES | MODE_RECORD | MODE_PROFILE | MODE_TRACE | MODE_CHECKPOINT},
+    {MODE_CHECKPOINT, "--checkpoint", 0,
+     MODE_BREAK | MODE_WATCHPOINT | MODE_DETECT_CYCLES | MODE_RECORD | MODE_PROFILE | MODE_TRACE | MODE_RESTORE}
+};
+
+// The modes the options use
+static int givenModes(const Options& options) {
+    return (options.filename.empty() ? 0 : MODE_FILE) |
+           (options.transpileFile.empty() ? 0 : MODE_TRANSPILE) |
+           (options.assembleFile.empty() ? 0 : MODE_ASSEMBLE) |
+           (options.decodeTrace ? MODE_DECODE_TRACE : 0) |
+           (options.bench ? MODE_BENCH : 0) |
+           (options.benchSuite ? MODE_BENCH_SUITE : 0) |
+           (options.serveSocket.empty() ? 0 : MODE_SERVE) |
+           (options.clientSocket.empty() ? 0 : MODE_CLIENT) |
+           (options.scheduleFile.empty() ? 0 : MODE_SCHEDULE) |
+           (options.batchFile.empty() && !options.batchFiles ? 0 : MODE_BATCH) |
+           (options.watch ? MODE_WATCH : 0) |
+           (options.optimize ? MODE_OPTIMIZE : 0) |
+           (options.breakpoints.empty() ? 0 : MODE_BREAK) |
+           (options.watchpoints.empty() ? 0 : MODE_WATCHPOINT) |
+           (options.detectCycles ? MODE_DETECT_CYCLES : 0) |
+           (options.recordFile.empty() ? 0 : MODE_RECORD) |
+           (options.profile ? MODE_PROFILE : 0) |
+           (options.trace == TRACE_FULL || options.trace == TRACE_SUMMARY ? MODE_TRACE : 0) |
+           (options.restoreFile.empty() ? 0 : MODE_RESTORE) |
+           (options.checkpointFile.empty() ? 0 : MODE_CHECKPOINT);
+}
+
+// Name of the mode as given on the command line
+static string modeName(const ModeRule& rule, const Options& options) {
+    if (rule.mode == MODE_TRACE) {
+        return options.trace == TRACE_FULL ? "--trace=full" : "--trace=summary";
+    }
+    return rule.name;
+}
+
+// Checks every given mode against its row of modeRules
+static bool checkModes(const Options& options, string& error) {
+    const int given = givenModes(options);
+
+    for (const ModeRule& rule : modeRules) {
+        if ((given & rule.mode) == 0) {
+            continue;
+        }
+
+        int others = given & ~(rule.mode | rule.worksWith | MODE_FILE);
+        if (others != 0) {
+            for (const ModeRule& other : modeRules) {
+                if ((others & other.mode) != 0) {
+                    error = modeName(rule, options) + " cannot be combined with " + modeName(other, options);
+                    return false;
+                }
+            }
+        }
+
+        if (rule.needs != 0 && (given & rule.needs) == 0) {
+            error = modeName(rule, options) + ((rule.needs & MODE_RESTORE) != 0 ? " needs a SAL file or --restore"
+                                                                                  : " needs a SAL file");
+            return false;
+        }
+    }
+    return true;
+}
+//
+// End of run mode compatibility
+//
+
+
+
+//
+// Start of Options definitions
+//
+// Parses a positive instruction count
+static bool parseCount(const string& text, long long& count) {
+    try {
+        size_t used = 0;
+        count = stoll(text, &used);
+        return used == text.size() && count > 0;
+    } catch (const logic_error&) {
+        return false;
+    }
+}
+
+// Parses the command line into options
+bool parseOptions(int argc, char* argv[], Options& options, string& error) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        // Split --name=value options
+        string name = arg;
+        string value;
+        size_t equals = arg.find('=');
+        if (arg.rfind("--", 0) == 0 && equals != string::npos) {
+            name = arg.substr(0, equals);
+            value = arg.substr(equals + 1);
+        }
+
+        if (name == "-h" || name == "--help") {
+            options.help = true;
+        } else if (name == "--bench") {
+            options.bench = true;
+        } else if (name == "--record") {
+            if (value.empty()) {
+                error = "--record needs a file name";
+                return false;
+            }
+            options.recordFile = value;
+        } else if (name == "--decode-trace") {
+            options.decodeTrace = true;
+        } else if (name == "--from") {
+            if (value == "0") {
+                options.traceFirst = 0;
+            } else if (!parseCount(value, options.traceFirst)) {
+                error = "--from needs a record number";
+                return false;
+            }
+        } else if (name == "--count") {
+            if (!parseCount(value, options.traceCount)) {
+                error = "--count needs a positive number";
+                return false;
+            }
+        } else if (name == "--checkpoint") {
+            if (value.empty()) {
+                error = "--checkpoint needs a file name";
+                return false;
+            }
+            options.checkpointFile = value;
+        } else if (name == "--checkpoint-every") {
+            if (!parseCount(value, options.checkpointEvery)) {
+                error = "--checkpoint-every needs a positive number";
+                return false;
+            }
+        } else if (name == "--restore") {
+            if (value.empty()) {
+                error = "--restore needs a file name";
+                return false;
+            }
+            options.restoreFile = value;
+        } else if (name == "--assemble") {
+            if (value.empty()) {
+                error = "--assemble needs a file name";
+                return false;
+            }
+            options.assembleFile = value;
+        } else if (name == "--transpile") {
+            if (value.empty()) {
+                error = "--transpile needs a file name";
+                return false;
+            }
+            options.transpileFile = value;
+        } else if (name == "--watch") {
+            options.watch = true;
+        } else if (name == "--resume") {
+            long long pc = 0;
+            if (value != "0" && (!parseCount(value, pc) || pc >= Hardware::maximumMemorySize)) {
+                error = "--resume needs a pc";
+                return false;
+            }
+            options.resumePc = (int) pc;
+        } else if (name == "--break") {
+            // PC or PC:CONDITION, the condition is checked once the program is loaded
+            size_t colon = value.find(':');
+            string number = value.substr(0, colon);
+            long long pc = 0;
+            if (number != "0" && (!parseCount(number, pc) || pc >= Hardware::maximumMemorySize)) {
+                error = "--break needs a pc, optionally followed by :CONDITION";
+                return false;
+            }
+            options.breakpoints.push_back(make_pair((int) pc, colon == string::npos ? "" : value.substr(colon + 1)));
+        } else if (name == "--watchpoint") {
+            if (value.empty()) {
+                error = "--watchpoint needs a symbol name";
+                return false;
+            }
+            options.watchpoints.push_back(value);
+        } else if (arg == "--batch") {
+            options.batchFiles = true;
+        } else if (name == "--batch") {
+            if (value.empty()) {
+                error = "--batch= needs a file of initial values";
+                return false;
+            }
+            options.batchFile = value;
+        } else if (name == "--jobs") {
+            long long jobs;
+            if (!parseCount(value, jobs) || jobs > 1024) {
+                error = "--jobs needs a number of threads from 1 to 1024";
+                return false;
+            }
+            options.jobs = (int) jobs;
+        } else if (name == "--schedule") {
+            if (value.empty()) {
+                error = "--schedule needs a file of jobs";
+                return false;
+            }
+            options.scheduleFile = value;
+        } else if (name == "--serve") {
+            if (value.empty()) {
+                error = "--serve needs a socket path";
+                return false;
+            }
+            options.serveSocket = value;
+        } else if (name == "--client") {
+            if (value.empty()) {
+                error = "--client needs a socket path";
+                return false;
+            }
+            options.clientSocket = value;
+        } else if (name == "--program-id") {
+            if (value.empty()) {
+                error = "--program-id needs the ID the server returned";
+                return false;
+            }
+            options.programId = value;
+        } else if (name == "--tenant") {
+            if (value.empty() || value.find('\n') != string::npos) {
+                error = "--tenant needs a name";
+                return false;
+            }
+            options.tenant = value;
+        } else if (name == "--set") {
+            if (value.find('=') == string::npos || value.find('\n') != string::npos) {
+                error = "--set needs NAME=VALUE";
+                return false;
+            }
+            options.sets.push_back(value);
+        } else if (name == "--quantum") {
+            if (!parseCount(value, options.quantum)) {
+                error = "--quantum needs a positive number";
+                return false;
+            }
+        } else if (name == "--deadline") {
+            if (!parseCount(value, options.deadline)) {
+                error = "--deadline needs a positive number of milliseconds";
+                return false;
+            }
+        } else if (name == "--no-simd") {
+            options.simd = false;
+        } else if (name == "--memory") {
+            long long size;
+            if (!parseCount(value, size) || size > Hardware::maximumMemorySize) {
+                error = "--memory needs a number of slots from 1 to " + to_string(Hardware::maximumMemorySize);
+                return false;
+            }
+            options.memorySize = (int) size;
+        } else if (name == "--profile") {
+            options.profile = true;
+        } else if (name == "--bench-suite") {
+            options.benchSuite = true;
+        } else if (name == "--json") {
+            options.json = true;
+        } else if (name == "--scale") {
+            if (!parseCount(value, options.scale) || options.scale < 1000) {
+                error = "--scale needs a number of at least 1000";
+                return false;
+            }
+        } else if (name == "--trace") {
+            if (!parseTraceLevel(value, options.trace)) {
+                error = "unknown trace level '" + value + "' (use none, final, summary or full)";
+                return false;
+            }
+        } else if (name == "--engine") {
+            if (value == "threaded") {
+                options.engine = ENGINE_THREADED;
+            } else if (value == "switch") {
+                options.engine = ENGINE_SWITCH;
+            } else if (value == "jit") {
+                options.engine = ENGINE_JIT;
+            } else {
+                error = "unknown engine '" + value + "' (use threaded, switch or jit)";
+                return false;
+            }
+        } else if (name == "--no-fusion") {
+            options.fusion = false;
+        } else if (name == "--detect-cycles") {
+            options.detectCycles = true;
+        } else if (name == "--no-loop-skip") {
+            options.loopSkip = false;
+        } else if (name == "--optimize") {
+            options.optimize = true;
+        } else if (name == "--max-steps") {
+            if (!parseCount(value, options.maxSteps)) {
+                error = "--max-steps needs a positive number";
+                return false;
+            }
+        } else if (arg.rfind("-", 0) == 0) {
+            error = "unknown option '" + arg + "'";
+            return false;
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+
+    if (!options.files.empty()) {
+        options.filename = options.files[0];
+    }
+    if (options.files.size() > 1 && !options.batchFiles) {
+        error = "only one SAL file can be run (use --batch to run several)";
+        return false;
+    }
+
+    if (!checkModes(options, error)) {
+        return false;
+    }
+    if (!options.serveSocket.empty() && !options.files.empty()) {
+        error = "--serve takes its programs from the requests, not the command line";
+        return false;
+    }
+    if (!options.clientSocket.empty()) {
+        if (options.files.empty() == options.programId.empty()) {
+            error = "--client needs either a SAL file or --program-id";
+            return false;
+        }
+    } else if (!options.programId.empty() || !options.tenant.empty() || !options.sets.empty()) {
+        error = "--program-id, --tenant and --set need --client";
+        return false;
+    }
+    if (!options.watch && options.resumePc >= 0) {
+        error = "--resume needs --watch";
+        return false;
+    }
+    if (!options.scheduleFile.empty() && !options.files.empty()) {
+        // The jobs file names the programs
+        error = "--schedule takes its files from the jobs file, not the command line";
+        return false;
+    }
+    if (options.filename.empty() && options.restoreFile.empty() && !options.help && !options.benchSuite &&
+        options.serveSocket.empty() && options.clientSocket.empty() && options.scheduleFile.empty()) {
+        error = "no SAL file given";
+        return false;
+    }
+    if (!options.filename.empty() && !options.restoreFile.empty()) {
+        error = "give either a SAL file or --restore, not both";
+        return false;
+    }
+    if (options.batchFiles && !options.batchFile.empty()) {
+        error = "give either --batch=INPUTS with one file or --batch with files";
+        return false;
+    }
+    if (options.checkpointEvery > 0 && options.checkpointFile.empty()) {
+        error = "--checkpoint-every needs --checkpoint=FILE";
+        return false;
+    }
+    return true;
+}
+
+// Prints the command line usage
+void printUsage(ostream& out) {
+    out << "Usage: minicpu                    interactive mode (asks for the file)\n"
+        << "       minicpu [options] FILE     run FILE (SAL or .salb) without prompting\n"
+        << "       minicpu [options] --restore=SNAP  continue a checkpointed run\n"
+        << "       minicpu [--memory=N] --assemble=OUT.salb FILE\n"
+        << "                                  write FILE as a precompiled program\n"
+        << "       minicpu --transpile=OUT.cpp FILE\n"
+        << "                                  write FILE as C++ source\n"
+        << "       minicpu [options] --batch=INPUTS.csv FILE\n"
+        << "                                  run FILE once per line of INPUTS, print a CSV\n"
+        << "       minicpu [options] --batch FILE...\n"
+        << "                                  run every FILE, print one CSV line each\n"
+        << "       minicpu [options] --schedule=JOBS\n"
+        << "                                  time-slice the jobs in JOBS, print a CSV\n"
+        << "       minicpu [options] --serve=SOCKET\n"
+        << "                                  serve run requests on a Unix domain socket\n"
+        << "       minicpu [options] --client=SOCKET FILE\n"
+        << "                                  run FILE on the server, print the result\n"
+        << "       minicpu --bench-suite      benchmark the engines on generated programs\n"
+        << "       minicpu --decode-trace [--from=N] [--count=N] TRACE\n"
+        << "                                  print records of a --record file as text\n"
+        << "\n"
+        << "Options:\n"
+        << "  --trace=LEVEL     none, final (default), summary or full\n"
+        << "  --max-steps=N     stop after N instructions\n"
+        << "  --engine=NAME     threaded (default), switch or jit; traced runs\n"
+        << "                    always use the threaded interpreter\n"
+        << "  --no-fusion       do not combine LDA/LDB/ADD/STR-like groups\n"
+        << "  --no-loop-skip    run every iteration of counted loops\n"
+        << "  --optimize        remove loads, stores, DECs and jumps that change\n"
+        << "                    nothing before running (fewer instructions executed)\n"
+        << "  --detect-cycles   stop with exit code 4 as soon as the machine state\n"
+        << "                    repeats (the program can never end) and report the cycle\n"
+        << "  --record=TRACE    write every executed instruction to the binary TRACE\n"
+        << "                    file (read it back with --decode-trace)\n"
+        << "  --checkpoint=SNAP write the machine state to SNAP when the run stops\n"
+        << "  --checkpoint-every=N  also every N instructions\n"
+        << "  --restore=SNAP    continue the run saved in SNAP (instead of FILE)\n"
+        << "  --memory=N        N instruction and value memory slots (default 128);\n"
+        << "                    a .salb program keeps the size it was assembled with\n"
+        << "  --assemble=OUT    parse and link FILE, write it to OUT and stop\n"
+        << "  --transpile=OUT   write FILE to OUT as a C++ function (one label per\n"
+        << "                    instruction) and stop\n"
+        << "  --watch           run FILE, then apply every edit of it to the loaded\n"
+        << "                    program (keeping memory) and run again\n"
+        << "  --resume=PC       --watch: go on at PC after a reload (default: where\n"
+        << "                    the last run stopped)\n"
+        << "  --break=PC[:COND] stop with exit code 5 before the instruction at PC\n"
+        << "                    runs (if COND, e.g. \"A>=5\" or \"x==0\", holds);\n"
+        << "                    the run is as fast as without it until then (repeatable)\n"
+        << "  --watchpoint=NAME stop with exit code 5 after symbol NAME changed\n"
+        << "                    (repeatable)\n"
+        << "  --batch=INPUTS    run FILE for every line of INPUTS (a header of symbol\n"
+        << "                    names, then one line of initial values per run), many\n"
+        << "                    runs at once with AVX2 where the CPU has it\n"
+        << "  --batch           run every FILE on its own (many files at once)\n"
+        << "  --no-simd         run every --batch line on its own with --engine\n"
+        << "  --jobs=N          --batch, --schedule and --serve worker threads\n"
+        << "                    (default: one per core)\n"
+        << "  --schedule=JOBS   run the jobs in JOBS (\"TENANT FILE [steps=N]\n"
+        << "                    [deadline=MS]\" per line) in time slices, sharing the\n"
+        << "                    workers fairly between tenants\n"
+        << "  --quantum=N       instructions per --schedule/--serve slice (default 100000)\n"
+        << "  --deadline=MS     stop --schedule/--serve jobs still running MS milliseconds\n"
+        << "                    after they were submitted\n"
+        << "  --program-id=ID   --client: run the program the server cached as ID\n"
+        << "  --tenant=NAME     --client: tenant whose share the request uses\n"
+        << "  --set=NAME=VALUE  --client: start with VALUE in symbol NAME (repeatable)\n"
+        << "  --profile         print per instruction, opcode and loop counts at the\n"
+        << "                    end (runs the plain interpreter, not the JIT)\n"
+        << "  --bench           compare the speed of the execution engines on FILE\n"
+        << "  --bench-suite     same for generated loop, nested loop and Fibonacci\n"
+        << "                    programs of 10^3 iterations up to --scale (no FILE)\n"
+        << "  --scale=N         largest --bench-suite scale (default 1000000000)\n"
+        << "  --json            print benchmark, --batch and --schedule results as JSON\n"
+        << "  -h, --help        show this help\n";
+}
+//
+// End of Options definitions
+//
@@ -0,0 +1,81 @@
+//
+// Created by Michal
+//
+
+#include <climits>
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+#include "hardware.h"
+#include "trace.h"
+
+#ifndef MINICPU_OPTIONS_H
+#define MINICPU_OPTIONS_H
+
+//
+// Start of Options
+//
+// Which execution engine runs the program in the headless mode
+enum EngineKind {
+    ENGINE_THREADED,  // runDecoded with direct threading (switch if the compiler has no computed goto)
+    ENGINE_SWITCH,    // runDecoded with switch dispatch
+    ENGINE_JIT        // Native x86-64 code (jit.h), falls back to the interpreter elsewhere
+};
+
+struct Options {
+    // Command line options of the headless run mode
+    std::string filename;            // SAL (or .salb) file to run
+    std::vector<std::string> files;  // Every file given, only --batch takes more than one
+    TraceLevel trace = TRACE_FINAL;  // What to print while and after running
+    long long maxSteps = LLONG_MAX;  // Stop after this many instructions
+    EngineKind engine = ENGINE_THREADED;  // Engine for untraced runs (none/final)
+    bool fusion = true;              // Run superinstructions (Program::fused)
+    bool loopSkip = true;            // Skip ahead in counted loops (OP_LOOP)
+    bool optimize = false;           // Remove instructions that change nothing (optimize.h)
+    bool detectCycles = false;       // Stop as soon as the machine state repeats
+    std::string recordFile;          // Write a binary trace of the run to this file
+    bool decodeTrace = false;        // filename is a binary trace to print as text
+    long long traceFirst = 0;        // First record --decode-trace prints
+    long long traceCount = LLONG_MAX;  // Number of records --decode-trace prints
+    std::string checkpointFile;      // Write a checkpoint of the machine to this file
+    long long checkpointEvery = 0;   // Also every this many instructions (0: only at the end)
+    std::string restoreFile;         // Start from this checkpoint instead of a SAL file
+    std::string assembleFile;        // Write the loaded program to this .salb file and stop
+    std::string transpileFile;       // Write the loaded program to this file as C++ and stop
+    bool watch = false;              // Rerun FILE with its edits applied whenever it changes
+    int resumePc = -1;               // --watch: pc to go on at after a reload, -1 for where it stopped
+    std::vector<std::pair<int, std::string>> breakpoints;  // --break: pc and condition (may be empty)
+    std::vector<std::string> watchpoints;  // --watchpoint: symbols to stop at when they change
+    int memorySize = Hardware::defaultMemorySize;  // Slots in each memory
+    bool profile = false;            // Count executions per pc and print a profile report
+    bool bench = false;              // Benchmark the execution engines instead of running once
+    bool benchSuite = false;         // Benchmark generated workloads instead of a file
+    bool json = false;               // Benchmark, batch and schedule results as JSON
+    long long scale = 1000000000LL;  // Largest workload scale of the benchmark suite
+    std::string batchFile;           // Run FILE once for every line of initial values in this CSV
+    bool batchFiles = false;         // Run every one of files on its own (--batch without inputs)
+    bool simd = true;                // Run --batch lanes with the vector engine
+    int jobs = 0;                    // Worker threads of --batch, --schedule and --serve, 0 for one per core
+    std::string scheduleFile;        // Run the jobs listed in this file with the scheduler
+    long long quantum = 100000;      // Instructions per --schedule time slice
+    long long deadline = 0;          // Default --schedule job deadline in milliseconds, 0 for none
+    std::string serveSocket;         // Serve requests on this Unix domain socket
+    std::string clientSocket;        // Send FILE to the server on this socket
+    std::string programId;           // --client: run this cached program instead of FILE
+    std::string tenant;              // --client: tenant the request runs for
+    std::vector<std::string> sets;   // --client: NAME=VALUE initial symbol values
+    bool help = false;               // Only print the usage
+};
+
+// Parses the command line into options.
+// Returns false and sets error if an option is unknown or malformed.
+bool parseOptions(int argc, char* argv[], Options& options, std::string& error);
+
+// Prints the command line usage
+void printUsage(std::ostream& out);
+//
+// End of Options
+//
+
+#endif //MINICPU_OPTIONS_H
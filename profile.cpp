@@ -0,0 +1,143 @@
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include "bytecode.h"
+#include "profile.h"
+
+using namespace std;
+
+//
+// Start of Profile definitions
+//
+// Instruction as written in the file ("LDA counter", "JMP 9", "ADD")
+static string instructionText(const Program& program, int pc) {
+    string text = opcodeName(program.code[pc].opcode);
+    const string& arg = program.argText[pc];
+
+    if (arg != "N/A") {
+        size_t start = arg.find_first_not_of(' ');
+        text += " " + (start == string::npos ? arg : arg.substr(start));
+    }
+    return text;
+}
+
+// Percentage of part in total
+static double share(long long part, long long total) {
+    return total > 0 ? 100.0 * part / total : 0;
+}
+
+// Prints the profile report
+void printProfile(ostream& out, const Program& program, const Profile& profile, double seconds) {
+    const vector<DecodedInstruction>& code = program.code;
+    const int size = (int) code.size();
+
+    long long total = 0;
+    for (long long count : profile.counts) {
+        total += count;
+    }
+
+    out << fixed << setprecision(3);
+    out << "Profile: " << total << " instructions in " << seconds * 1000 << " ms\n";
+    out << setprecision(1);
+
+    // Hottest instructions first, pc order for equal counts
+    vector<int> order;
+    for (int pc = 0; pc < size; pc++) {
+        if (profile.counts[pc] > 0) {
+            order.push_back(pc);
+        }
+    }
+    stable_sort(order.begin(), order.end(), [&profile](int left, int right) {
+        return profile.counts[left] > profile.counts[right];
+    });
+    if (order.size() > 10) {
+        order.resize(10);
+    }
+
+    out << "\nHottest instructions:\n";
+    out << setw(6) << "pc" << "  " << left << setw(20) << "instruction" << right
+        << setw(14) << "count" << setw(8) << "share" << "\n";
+    for (int pc : order) {
+        out << setw(6) << pc << "  " << left << setw(20) << instructionText(program, pc) << right
+            << setw(14) << profile.counts[pc] << setw(7) << share(profile.counts[pc], total) << "%";
+
+        int opcode = code[pc].opcode;
+        if (opcode == OP_JZS || opcode == OP_JVS) {
+            out << "  taken " << profile.taken[pc] << ", not taken " << profile.counts[pc] - profile.taken[pc];
+        }
+        out << "\n";
+    }
+
+    // Per opcode totals, in Opcode order
+    vector<long long> opcodes(OP_NONE, 0);
+    vector<long long> taken(OP_NONE, 0);
+    for (int pc = 0; pc < size; pc++) {
+        int opcode = code[pc].opcode;
+        if (opcode >= 0 && opcode < OP_NONE) {
+            opcodes[opcode] += profile.counts[pc];
+            taken[opcode] += profile.taken[pc];
+        }
+    }
+
+    out << "\nOpcodes:\n";
+    for (int opcode = 0; opcode < OP_NONE; opcode++) {
+        if (opcodes[opcode] == 0) {
+            continue;
+        }
+        out << "  " << left << setw(6) << opcodeName(opcode) << right
+            << setw(14) << opcodes[opcode] << setw(7) << share(opcodes[opcode], total) << "%";
+        if (opcode == OP_JZS || opcode == OP_JVS) {
+            out << "  taken " << taken[opcode] << ", not taken " << opcodes[opcode] - taken[opcode];
+        }
+        out << "\n";
+    }
+
+    // A jump to itself or further up that was taken closes a loop from its
+    // target to the jump. Time is estimated from the loop's share of the
+    // executed instructions.
+    struct Loop {
+        int header;
+        int backEdge;
+        long long iterations;
+        long long instructions;
+    };
+    vector<Loop> loops;
+    for (int pc = 0; pc < size; pc++) {
+        int opcode = code[pc].opcode;
+        if ((opcode != OP_JMP && opcode != OP_JZS && opcode != OP_JVS) || code[pc].operand > pc) {
+            continue;
+        }
+
+        Loop loop;
+        loop.header = code[pc].operand;
+        loop.backEdge = pc;
+        loop.iterations = opcode == OP_JMP ? profile.counts[pc] : profile.taken[pc];
+        loop.instructions = 0;
+        for (int i = loop.header; i <= pc; i++) {
+            loop.instructions += profile.counts[i];
+        }
+        if (loop.iterations > 0) {
+            loops.push_back(loop);
+        }
+    }
+    stable_sort(loops.begin(), loops.end(), [](const Loop& left, const Loop& right) {
+        return left.instructions > right.instructions;
+    });
+
+    out << "\nLoops:\n";
+    if (loops.empty()) {
+        out << "  none\n";
+    }
+    for (const Loop& loop : loops) {
+        double part = share(loop.instructions, total);
+        out << "  pc " << loop.header << "-" << loop.backEdge
+            << " (" << instructionText(program, loop.backEdge) << "): "
+            << loop.iterations << " iterations, " << loop.instructions << " instructions, "
+            << part << "%, ~" << setprecision(3) << seconds * 10 * part << setprecision(1) << " ms\n";
+    }
+}
+//
+// End of Profile definitions
+//
@@ -0,0 +1,72 @@
+//
+// Created by Michal
+//
+
+#include <vector>
+#include <ostream>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+
+#ifndef MINICPU_PROFILE_H
+#define MINICPU_PROFILE_H
+
+//
+// Start of Profile
+//
+struct Profile {
+    // Execution counts collected by ProfileHook, indexed by pc
+    std::vector<long long> counts;  // Times the instruction at pc was executed
+    std::vector<long long> taken;   // Times the JZS/JVS at pc jumped
+
+    explicit Profile(const Program& program)
+        : counts(program.code.size(), 0), taken(program.code.size(), 0) {}
+};
+
+// Prints the hottest instructions, the count of every opcode, taken/not taken
+// counts of JZS/JVS and every loop (found from the back edges that were
+// taken) with its iterations and estimated share of the seconds the run took
+void printProfile(std::ostream& out, const Program& program, const Profile& profile, double seconds);
+//
+// End of Profile
+//
+
+
+
+//
+// Start of ProfileHook
+//
+template <typename Inner>
+struct ProfileHook {
+    // Counts every instruction into the profile, then hands it on to the
+    // inner hook (NoTrace, DumpTrace or SummaryTrace). Being a hook, it only
+    // exists in the engine instance that runs with --profile; the other
+    // instances have no profiling code at all.
+    static const bool enabled = true;
+    static const bool backEdges = false;  // Sees every instruction anyway
+    Profile& profile;
+    Inner& inner;
+
+    ProfileHook(Profile& data, Inner& hook) : profile(data), inner(hook) {}
+
+    void step(const Hardware& hw, const Program& program, int pc) {
+        profile.counts[pc]++;
+
+        // Jumps do not change the bits, so they still tell if it jumped
+        int opcode = program.code[pc].opcode;
+        if ((opcode == OP_JZS && hw.zero_bit == 1) || (opcode == OP_JVS && hw.overflow_bit == 1)) {
+            profile.taken[pc]++;
+        }
+
+        if (Inner::enabled) {
+            inner.step(hw, program, pc);
+        }
+    }
+
+    bool backEdge(const Hardware&, const Program&, long long) { return true; }
+};
+//
+// End of ProfileHook
+//
+
+#endif //MINICPU_PROFILE_H
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+#include "hardware.h"
+#include "bytecode.h"
+#include "loader.h"
+#include "loops.h"
+#include "reload.h"
+
+using namespace std;
+
+//
+// Start of ProgramSource definitions
+//
+// Lines of the source the way parseProgram counts them: a last line without
+// a newline is still a line, a newline at the very end does not start one
+static vector<string> splitLines(const char* text, size_t size) {
+    vector<string> lines;
+    const char* const end = text + size;
+    for (const char* p = text; p < end;) {
+        const char* newline = (const char*) memchr(p, '\n', end - p);
+        const char* lineEnd = newline == nullptr ? end : newline;
+        lines.emplace_back(p, lineEnd);
+        p = lineEnd + 1;
+    }
+    return lines;
+}
+
+// True for the records whose operand is a symbol
+static bool usesSymbol(int opcode) {
+    return opcode == OP_DEC || opcode == OP_LDA || opcode == OP_LDB || opcode == OP_STR;
+}
+
+void ProgramSource::assign(const char* text, size_t size) {
+    lines = splitLines(text, size);
+}
+
+// Applies the edited source to the linked program
+bool ProgramSource::reload(const char* text, size_t size, Hardware& hw, Program& program, bool superinstructions,
+                           bool loops, ReloadStats& stats, string& error) {
+    stats = ReloadStats();
+    vector<string> next = splitLines(text, size);
+    const int memorySize = (int) hw.value_memory.size();
+    if (next.size() > (size_t) memorySize) {
+        error = "line " + to_string(memorySize + 1) + ": program does not fit in " +
+                to_string(memorySize) + " memory slots (see --memory)";
+        return false;
+    }
+    const int oldLength = program.length;
+    const int length = (int) next.size();
+
+    // Records of the new program: unchanged lines are copied, the others
+    // decoded. A jump to the sentinel (or outside the program) is decoded
+    // again when the length changes, its target may be inside now.
+    Program decoding;  // Only gives parseLine the length and throwaway symbol ids
+    decoding.length = length;
+    vector<DecodedInstruction> code(length + 1, DecodedInstruction{OP_NONE, 0});
+    OperandText argText;
+    argText.text.reserve(program.argText.text.size());
+    argText.offsets.reserve(length + 2);
+    vector<char> dirty(length + 1, 0);  // Records that differ from the old ones
+    const vector<uint32_t>& offsets = program.argText.offsets;
+
+    for (int pc = 0; pc < length; pc++) {
+        bool same = pc < oldLength && next[pc] == lines[pc];
+        if (same) {
+            const int opcode = program.code[pc].opcode;
+            if ((opcode == OP_JMP || opcode == OP_JZS || opcode == OP_JVS) && length != oldLength &&
+                program.code[pc].operand >= min(oldLength, length)) {
+                same = false;
+            }
+        }
+
+        if (same) {
+            code[pc] = program.code[pc];
+            argText.append(program.argText.text.data() + offsets[pc], offsets[pc + 1] - offsets[pc]);
+            continue;
+        }
+        const string& line = next[pc];
+        if (!parseLine(line.data(), line.data() + line.size(), pc, decoding, code[pc], argText, error)) {
+            return false;
+        }
+        dirty[pc] = 1;
+        stats.decoded++;
+    }
+    argText.append("N/A", 3);  // Sentinel
+    dirty[length] = length != oldLength;
+
+    // Symbols in order of first use, as a fresh load numbers them. The
+    // names come from the operand text, so kept records need no decoding.
+    vector<string> symbols;
+    unordered_map<string, int> symbolIds;
+    vector<int> ids(length, -1);        // Symbol id of every record that uses one
+    vector<char> declared;              // Per symbol id, 1 if a DEC declares it
+    for (int pc = 0; pc < length; pc++) {
+        if (!usesSymbol(code[pc].opcode)) {
+            continue;
+        }
+        string name = argText[pc];
+        auto found = symbolIds.find(name);
+        if (found == symbolIds.end()) {
+            found = symbolIds.emplace(name, (int) symbols.size()).first;
+            symbols.push_back(name);
+            declared.push_back(0);
+        }
+        ids[pc] = found->second;
+        if (code[pc].opcode == OP_DEC) {
+            declared[found->second] = 1;
+        }
+    }
+
+    // Symbols that were declared before keep their slot if it is still free
+    vector<int> addresses(symbols.size(), -1);
+    vector<int> oldAddresses(symbols.size(), -1);
+    SlotAllocator slots(code, length, memorySize);
+    for (size_t symbol = 0; symbol < symbols.size(); symbol++) {
+        auto old = program.symbolIds.find(symbols[symbol]);
+        if (old == program.symbolIds.end() || program.addresses[old->second] < 0) {
+            continue;
+        }
+        const int slot = program.addresses[old->second];
+        oldAddresses[symbol] = slot;
+        if (declared[symbol] && slots.reserve(slot)) {
+            addresses[symbol] = slot;
+        }
+    }
+
+    // The others take the first free slot, in program order like linkProgram
+    for (int pc = 0; pc < length; pc++) {
+        if (code[pc].opcode != OP_DEC || addresses[ids[pc]] != -1) {
+            continue;
+        }
+        addresses[ids[pc]] = slots.allocate();
+        if (addresses[ids[pc]] == -1) {
+            error = "line " + to_string(pc + 1) + ": no free memory for symbol '" + symbols[ids[pc]] + "'";
+            return false;
+        }
+    }
+    for (int pc = 0; pc < length; pc++) {
+        if (ids[pc] >= 0 && addresses[ids[pc]] == -1) {
+            error = "line " + to_string(pc + 1) + ": undefined symbol '" + symbols[ids[pc]] + "'";
+            return false;
+        }
+    }
+
+    // From here on nothing can fail.
+    // Moved symbols take their value along; the slots of symbols that moved
+    // or are gone are cleared, new symbols start at 0 like after a load.
+    vector<long long> values(symbols.size(), 0);
+    for (size_t symbol = 0; symbol < symbols.size(); symbol++) {
+        if (oldAddresses[symbol] >= 0) {
+            values[symbol] = hw.value_memory[oldAddresses[symbol]];
+        }
+    }
+    for (size_t symbol = 0; symbol < program.symbols.size(); symbol++) {
+        const int slot = program.addresses[symbol];
+        auto now = symbolIds.find(program.symbols[symbol]);
+        const bool stays = now != symbolIds.end() && addresses[now->second] == slot;
+        if (slot >= 0 && !stays) {
+            hw.value_memory[slot] = 0;
+        }
+        if (slot >= 0 && (now == symbolIds.end() || !declared[now->second])) {
+            stats.dropped++;
+        }
+    }
+    for (size_t symbol = 0; symbol < symbols.size(); symbol++) {
+        if (!declared[symbol]) {
+            continue;
+        }
+        if (addresses[symbol] == oldAddresses[symbol]) {
+            stats.kept++;
+        } else {
+            hw.value_memory[addresses[symbol]] = values[symbol];
+            if (oldAddresses[symbol] >= 0) {
+                stats.moved++;
+            } else {
+                stats.added++;
+            }
+        }
+    }
+
+    // DECs that already ran stay bound, at the new slot. Symbol ids changed,
+    // so the next run of a DEC looks its name up again.
+    hw.bound_symbols.clear();
+    for (auto binding = hw.symbol_table.begin(); binding != hw.symbol_table.end();) {
+        auto now = symbolIds.find(binding->first);
+        if (now == symbolIds.end() || !declared[now->second]) {
+            binding = hw.symbol_table.erase(binding);
+        } else {
+            binding->second = addresses[now->second];
+            ++binding;
+        }
+    }
+
+    // Link. A kept record whose slot changed counts as changed for the
+    // run lengths and fused code below.
+    for (int pc = 0; pc < length; pc++) {
+        if (ids[pc] < 0) {
+            continue;
+        }
+        code[pc].operand = code[pc].opcode == OP_DEC ? ids[pc] : addresses[ids[pc]];
+        if (!dirty[pc] && code[pc].operand != program.code[pc].operand) {
+            dirty[pc] = 1;
+        }
+    }
+
+    // Nothing else has to be worked out again if no record changed
+    int lastDirty = -1;
+    int firstDirty = length + 1;
+    for (int pc = 0; pc <= length; pc++) {
+        if (dirty[pc]) {
+            firstDirty = min(firstDirty, pc);
+            lastDirty = pc;
+        }
+    }
+
+    vector<DecodedInstruction> oldFused = move(program.fused);
+    vector<LoopSummary> oldLoops = move(program.loops);
+    vector<int> runLength = move(program.runLength);
+    program.code = move(code);
+    program.argText = move(argText);
+    program.symbols = move(symbols);
+    program.symbolIds = move(symbolIds);
+    program.addresses = move(addresses);
+    program.length = length;
+    program.handlers.clear();
+    lines = move(next);
+    const vector<DecodedInstruction>& linked = program.code;
+
+    // Run lengths only depend on the records after them, so they are worked
+    // out backwards from the last change until one comes out as before
+    runLength.resize(length + 1, 0);
+    for (int pc = lastDirty; pc >= 0; pc--) {
+        const int opcode = linked[pc].opcode;
+        int run;
+        if (opcode == OP_NONE) {
+            run = 0;
+        } else if (endsRun(opcode) || pc + 1 == length + 1) {
+            run = 1;
+        } else {
+            run = runLength[pc + 1] + 1;
+        }
+        if (pc < firstDirty && pc < oldLength && run == runLength[pc]) {
+            break;
+        }
+        runLength[pc] = run;
+    }
+    program.runLength = move(runLength);
+
+    // Superinstructions: the records of a group and the three before it
+    // can change with a record
+    vector<DecodedInstruction> fused(length + 1);
+    vector<char> refuse(length + 1, 0);
+    for (int pc = 0; pc <= length; pc++) {
+        if (pc >= (int) oldFused.size()) {
+            refuse[pc] = 1;
+        } else if (dirty[pc]) {
+            for (int first = max(0, pc - 3); first <= pc; first++) {
+                refuse[first] = 1;
+            }
+        }
+    }
+    for (int pc = 0; pc <= length; pc++) {
+        fused[pc] = refuse[pc] ? linked[pc] : oldFused[pc];
+        if (!refuse[pc]) {
+            continue;
+        }
+        stats.fused++;
+        if (superinstructions && pc + 3 < length && linked[pc].opcode == OP_LDA &&
+            linked[pc + 1].opcode == OP_LDB && linked[pc + 2].opcode == OP_ADD) {
+            const int last = linked[pc + 3].opcode;
+            if (last == OP_STR) {
+                fused[pc].opcode = OP_ADD_STR;
+            } else if (last == OP_JZS) {
+                fused[pc].opcode = OP_ADD_JZS;
+            } else if (last == OP_JVS) {
+                fused[pc].opcode = OP_ADD_JVS;
+            }
+        }
+    }
+
+    // Counted loops: a summary stays valid while nothing from its header to
+    // its back edge changed. OP_LOOP operands are renumbered in pc order.
+    vector<int> dirtyBefore(length + 2, 0);  // Changed records in [0, pc)
+    for (int pc = 0; pc <= length; pc++) {
+        dirtyBefore[pc + 1] = dirtyBefore[pc] + dirty[pc];
+    }
+    for (int pc = 0; loops && pc < length; pc++) {
+        const DecodedInstruction& jump = linked[pc];
+        if (jump.opcode != OP_JMP || jump.operand > pc) {
+            continue;
+        }
+        const bool changed = dirtyBefore[pc + 1] - dirtyBefore[jump.operand] > 0;
+
+        LoopSummary loop;
+        bool counted;
+        if (changed) {
+            counted = summarizeLoop(program, jump.operand, pc, loop);
+            stats.loops++;
+        } else {
+            counted = pc < (int) oldFused.size() && oldFused[pc].opcode == OP_LOOP;
+            if (counted) {
+                loop = oldLoops[oldFused[pc].operand];
+            }
+        }
+
+        fused[pc] = jump;
+        if (counted) {
+            fused[pc].opcode = OP_LOOP;
+            fused[pc].operand = (int) program.loops.size();
+            program.loops.push_back(loop);
+        }
+    }
+    program.fused = move(fused);
+    return true;
+}
+//
+// End of ProgramSource definitions
+//
+
+
+
+//
+// Start of file watching definitions
+//
+FileStamp fileStamp(const string& filename) {
+    FileStamp stamp;
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) {
+        return stamp;
+    }
+    stamp.size = (long long) info.st_size;
+    stamp.inode = (long long) info.st_ino;
+#if defined(__APPLE__)
+    stamp.modified = (long long) info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#elif defined(__linux__) || defined(__FreeBSD__)
+    stamp.modified = (long long) info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#else
+    stamp.modified = (long long) info.st_mtime * 1000000000LL;
+#endif
+#else
+    (void) filename;
+#endif
+    return stamp;
+}
+//
+// End of file watching definitions
+//
@@ -0,0 +1,83 @@
+//
+// Created by Michal
+//
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+
+#ifndef MINICPU_RELOAD_H
+#define MINICPU_RELOAD_H
+
+//
+// Start of ProgramSource
+//
+// What a reload changed
+struct ReloadStats {
+    int decoded = 0;   // Lines decoded again (edited, new, or jumps whose target moved)
+    int kept = 0;      // Symbols still in their slot, with their value
+    int moved = 0;     // Symbols whose slot became code, moved with their value
+    int added = 0;     // Symbols declared for the first time, starting at 0
+    int dropped = 0;   // Symbols no longer declared
+    int fused = 0;     // Records whose superinstruction was worked out again
+    int loops = 0;     // Loops summarized again
+};
+
+class ProgramSource {
+    // The source lines a linked program was decoded from, so an edited
+    // version of the file is applied to the running program instead of
+    // loading it again. Every line is one slot, so the diff is line by line:
+    // only lines whose text differs are decoded, every other record is kept
+    // as it is. Symbols that are still declared keep their slot and value
+    // (and symbol_table binding) as long as that slot is still free.
+    //
+    // runLength, the superinstructions and the counted loops of
+    // Program::fused are only worked out again where a record changed: a
+    // superinstruction only depends on its own four records and a loop
+    // summary on the records from its header to its back edge. The result is
+    // the same program a fresh load gives, apart from symbol addresses.
+public:
+    // Remembers the source the program was loaded from
+    void assign(const char* text, size_t size);
+
+    // Applies the new source to the program and the machine running it
+    // (value_memory, symbol_table; registers and pc are left alone). fused
+    // gets superinstructions and counted loops as fuseProgram would. Returns
+    // false and sets error if the new source cannot be loaded; nothing is
+    // changed then.
+    bool reload(const char* text, size_t size, Hardware& hw, Program& program, bool superinstructions,
+                bool loops, ReloadStats& stats, std::string& error);
+
+private:
+    std::vector<std::string> lines;  // Text of every line, without the newline
+};
+//
+// End of ProgramSource
+//
+
+
+
+//
+// Start of file watching
+//
+// What tells two versions of a file apart without reading it
+struct FileStamp {
+    long long size = -1;
+    long long modified = 0;  // Modification time in nanoseconds where the system has them
+    long long inode = 0;     // Editors that write a new file and rename it change it
+
+    bool operator==(const FileStamp& other) const {
+        return size == other.size && modified == other.modified && inode == other.inode;
+    }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+// Stamp of the file now, size -1 if it does not exist
+FileStamp fileStamp(const std::string& filename);
+//
+// End of file watching
+//
+
+#endif //MINICPU_RELOAD_H
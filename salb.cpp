@@ -0,0 +1,173 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+#include "hardware.h"
+#include "bytecode.h"
+#include "mappedfile.h"
+#include "salb.h"
+
+using namespace std;
+
+//
+// Start of binary program helpers
+//
+// First bytes of every binary program
+static const char binaryProgramMagic[8] = "MCSALB";
+
+// 64 bit checksum of the bytes: FNV-1a over 8 byte words, mixed after every
+// word so changes in the high bytes reach the whole hash
+static uint64_t checksum(const char* data, size_t size) {
+    const uint64_t prime = 1099511628211ULL;
+    uint64_t hash = 14695981039346656037ULL;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ (unsigned char) data[i]) * prime;
+    }
+    return hash;
+}
+//
+// End of binary program helpers
+//
+
+
+
+//
+// Start of binary program definitions
+//
+// True if the file starts like a binary program
+bool isBinaryProgram(const MappedFile& file) {
+    return file.size() >= sizeof(binaryProgramMagic) &&
+           memcmp(file.data(), binaryProgramMagic, sizeof(binaryProgramMagic)) == 0;
+}
+
+// Writes the linked program to filename
+bool saveBinaryProgram(const string& filename, const Program& program, int memorySize, string& error) {
+    const uint32_t codeSize = (uint32_t) program.code.size();
+    const uint32_t symbolCount = (uint32_t) program.symbols.size();
+
+    BinaryProgramHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, binaryProgramMagic, sizeof(header.magic));
+    header.version = binaryProgramVersion;
+    header.headerSize = sizeof(BinaryProgramHeader);
+    header.recordSize = sizeof(DecodedInstruction);
+    header.opcodeCount = OP_LOOP + 1;
+    header.memorySize = (uint32_t) memorySize;
+    header.codeSize = codeSize;
+    header.symbolCount = symbolCount;
+
+    // The operand text block as it is, then the names
+    string text = program.argText.text;
+    vector<BinarySymbol> symbols(symbolCount);
+    for (uint32_t i = 0; i < symbolCount; i++) {
+        symbols[i].address = program.addresses[i];
+        symbols[i].nameOffset = text.size();
+        symbols[i].nameSize = (uint32_t) program.symbols[i].size();
+        text += program.symbols[i];
+    }
+
+    // Build the file in memory; the header is filled in last
+    const vector<uint32_t>& offsets = program.argText.offsets;
+    string file(sizeof(header), '\0');
+    header.codeOffset = appendSection(file, program.code.data(), codeSize * sizeof(DecodedInstruction));
+    header.symbolsOffset = appendSection(file, symbols.data(), symbols.size() * sizeof(BinarySymbol));
+    header.offsetsOffset = appendSection(file, offsets.data(), offsets.size() * sizeof(uint32_t));
+    header.textOffset = appendSection(file, text.data(), text.size());
+    header.fileSize = file.size();
+    header.checksum = checksum(file.data() + sizeof(header), file.size() - sizeof(header));
+    memcpy(&file[0], &header, sizeof(header));
+
+    return replaceFile(filename, file, error);
+}
+
+// Reads the program back from the mapped file
+bool loadBinaryProgram(const MappedFile& file, Program& program, int& memorySize, string& error) {
+    BinaryProgramHeader header;
+    if (file.size() < sizeof(header) || !isBinaryProgram(file)) {
+        error = "not a MiniCPU binary program";
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (header.version != binaryProgramVersion || header.headerSize != sizeof(BinaryProgramHeader) ||
+        header.recordSize != sizeof(DecodedInstruction) || header.opcodeCount != OP_LOOP + 1) {
+        error = "binary program was written by a different version, assemble it again";
+        return false;
+    }
+    if (header.fileSize != file.size() ||
+        header.checksum != checksum(file.data() + sizeof(header), file.size() - sizeof(header))) {
+        error = "binary program is damaged (checksum mismatch)";
+        return false;
+    }
+
+    const uint32_t slots = header.memorySize;
+    if (slots == 0 || slots > (uint32_t) Hardware::maximumMemorySize ||
+        header.codeSize == 0 || header.codeSize > slots + 1 || header.textOffset > file.size() ||
+        !file.contains(header.codeOffset, header.codeSize, sizeof(DecodedInstruction)) ||
+        !file.contains(header.symbolsOffset, header.symbolCount, sizeof(BinarySymbol)) ||
+        !file.contains(header.offsetsOffset, header.codeSize + 1, sizeof(uint32_t))) {
+        error = "binary program is damaged";
+        return false;
+    }
+
+    // Copy everything into a new program first, so a bad file changes nothing.
+    // Every table is one block copy.
+    const char* text = file.data() + header.textOffset;
+    const uint64_t textSize = file.size() - header.textOffset;
+    Program loaded;
+    loaded.length = (int) header.codeSize - 1;
+    const DecodedInstruction* code = (const DecodedInstruction*) (file.data() + header.codeOffset);
+    loaded.code.assign(code, code + header.codeSize);
+
+    const uint32_t* offsets = (const uint32_t*) (file.data() + header.offsetsOffset);
+    loaded.argText.offsets.assign(offsets, offsets + header.codeSize + 1);
+    for (uint32_t pc = 0; pc < header.codeSize; pc++) {
+        if (offsets[pc] > offsets[pc + 1]) {
+            error = "binary program is damaged";
+            return false;
+        }
+    }
+    if (offsets[0] != 0 || offsets[header.codeSize] > textSize) {
+        error = "binary program is damaged";
+        return false;
+    }
+    loaded.argText.text.assign(text, offsets[header.codeSize]);
+
+    const BinarySymbol* symbols = (const BinarySymbol*) (file.data() + header.symbolsOffset);
+    loaded.symbols.reserve(header.symbolCount);
+    loaded.addresses.reserve(header.symbolCount);
+    for (uint32_t i = 0; i < header.symbolCount; i++) {
+        if (symbols[i].nameOffset > textSize || symbols[i].nameSize > textSize - symbols[i].nameOffset) {
+            error = "binary program is damaged";
+            return false;
+        }
+        loaded.symbols.emplace_back(text + symbols[i].nameOffset, symbols[i].nameSize);
+        loaded.symbolIds.emplace(loaded.symbols.back(), (int) i);
+        loaded.addresses.push_back(symbols[i].address);
+    }
+
+    // The checksum only says the file is what was written; it still has to
+    // be safe to run
+    if (!checkProgram(loaded, (int) slots)) {
+        error = "binary program is damaged";
+        return false;
+    }
+
+    computeRunLengths(loaded);
+    fuseProgram(loaded);
+    program = move(loaded);
+    memorySize = (int) slots;
+    return true;
+}
+//
+// End of binary program definitions
+//
@@ -0,0 +1,69 @@
+//
+// Created by Michal
+//
+
+#include <cstdint>
+#include <string>
+#include "bytecode.h"
+#include "mappedfile.h"
+
+#ifndef MINICPU_SALB_H
+#define MINICPU_SALB_H
+
+//
+// Start of binary program files
+//
+// A .salb file is a program that has already been parsed and linked
+// (--assemble), so running it only maps the file and copies the records. The
+// file is a fixed header followed by sections the header points to, each 8
+// byte aligned, in the byte order of the machine:
+//     code     DecodedInstruction per record (linked, including the sentinel)
+//     symbols  BinarySymbol per symbol
+//     offsets  uint32 per record plus one: OperandText::offsets
+//     text     OperandText::text, then the symbol names
+// The checksum covers everything after the header, so a damaged or truncated
+// file is rejected before any of it is used.
+const uint32_t binaryProgramVersion = 1;
+
+struct BinaryProgramHeader {
+    char magic[8];          // "MCSALB" and zeros
+    uint32_t version;       // binaryProgramVersion
+    uint32_t headerSize;    // sizeof(BinaryProgramHeader)
+    uint32_t recordSize;    // sizeof(DecodedInstruction)
+    uint32_t opcodeCount;   // Opcodes of the build that wrote it (OP_LOOP + 1)
+    uint32_t memorySize;    // Slots the program was linked for
+    uint32_t codeSize;      // Records in the code section
+    uint32_t symbolCount;   // Entries in the symbols section
+    uint32_t unused;
+    uint64_t codeOffset;    // File offsets of the sections
+    uint64_t symbolsOffset;
+    uint64_t offsetsOffset;
+    uint64_t textOffset;
+    uint64_t fileSize;      // Size of the whole file
+    uint64_t checksum;      // Checksum of the bytes after the header
+};
+
+struct BinarySymbol {
+    int32_t address;        // value_memory address
+    uint32_t nameSize;
+    uint64_t nameOffset;    // Name, relative to the text section
+};
+
+// True if the file starts like a binary program (it may still be damaged)
+bool isBinaryProgram(const MappedFile& file);
+
+// Writes the linked program, linked for memorySize slots, to filename.
+// Returns false and sets error if it cannot be written.
+bool saveBinaryProgram(const std::string& filename, const Program& program, int memorySize,
+                       std::string& error);
+
+// Reads the program back from the mapped file and builds its run lengths and
+// fused code. memorySize is set to the slots it was linked for, the machine
+// that runs it needs exactly that many. Returns false and sets error if the
+// file is not a valid binary program of this build; program is unchanged then.
+bool loadBinaryProgram(const MappedFile& file, Program& program, int& memorySize, std::string& error);
+//
+// End of binary program files
+//
+
+#endif //MINICPU_SALB_H
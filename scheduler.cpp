@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "trace.h"
+#include "options.h"
+#include "ali.h"
+#include "mappedfile.h"
+#include "scheduler.h"
+
+using namespace std;
+
+//
+// Start of Job definitions
+//
+const char* jobStatusName(JobStatus status) {
+    static const char* const names[] = {"halted", "budget", "fault", "deadline"};
+    return names[status];
+}
+
+Job::Job(int number, const string& owner, const string& label, shared_ptr<const Program> code,
+         int memorySize, const JobLimits& limits, const vector<long long>& values)
+    : id(number), tenant(owner), name(label), program(move(code)), hw(memorySize), left(limits.budget),
+      hasDeadline(limits.deadline > 0) {
+    for (size_t symbol = 0; symbol < values.size(); symbol++) {
+        hw.value_memory[program->addresses[symbol]] = values[symbol];
+    }
+    readySince = Clock::now();
+    if (hasDeadline) {
+        deadline = readySince + chrono::duration_cast<Clock::duration>(chrono::duration<double>(limits.deadline));
+    }
+}
+//
+// End of Job definitions
+//
+
+
+
+//
+// Start of Scheduler definitions
+//
+// Seconds between two points in time
+static double secondsBetween(Job::Clock::time_point from, Job::Clock::time_point to) {
+    return chrono::duration<double>(to - from).count();
+}
+
+Scheduler::Scheduler(int workers, long long sliceLength) : quantum(max(sliceLength, 1LL)) {
+    if (workers <= 0) {
+        workers = (int) thread::hardware_concurrency();
+    }
+    if (workers <= 0) {
+        workers = 1;  // The number of cores is not known
+    }
+    for (int worker = 0; worker < workers; worker++) {
+        threads.emplace_back(&Scheduler::workLoop, this);
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    work.notify_all();
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+// Adds a job and wakes a worker for it
+int Scheduler::submit(const string& tenant, const string& name, shared_ptr<const Program> program,
+                      int memorySize, const JobLimits& limits, Callback done, const vector<long long>& values) {
+    // The machine is set up before taking the lock, it can be large
+    lock.lock();
+    const int id = nextId++;
+    lock.unlock();
+    unique_ptr<Job> job(new Job(id, tenant, name, move(program), memorySize, limits, values));
+
+    {
+        lock_guard<mutex> guard(lock);
+        Job* queued = job.get();
+        Tenant& owner = tenants[tenant];
+        owner.stats.name = tenant;
+        owner.stats.jobs++;
+        jobs[id] = make_pair(move(job), move(done));
+        makeReady(queued, queued->readySince);
+    }
+    work.notify_one();
+    return id;
+}
+
+// Waits for the jobs map to empty
+void Scheduler::wait() {
+    unique_lock<mutex> guard(lock);
+    idle.wait(guard, [this] { return jobs.empty(); });
+}
+
+vector<TenantStats> Scheduler::tenantStats() {
+    lock_guard<mutex> guard(lock);
+    vector<TenantStats> stats;
+    for (const auto& tenant : tenants) {
+        stats.push_back(tenant.second.stats);
+    }
+    return stats;
+}
+
+// Queues the job; a tenant that had nothing ready joins at the current virtual time
+void Scheduler::makeReady(Job* job, Job::Clock::time_point now) {
+    Tenant& tenant = tenants[job->tenant];
+    if (tenant.ready.empty()) {
+        tenant.served = max(tenant.served, virtualTime);
+    }
+    job->readySince = now;
+    tenant.ready.push_back(job);
+    readyJobs++;
+}
+
+// Picks the tenant with ready jobs that was served least, ties by name
+Job* Scheduler::takeNext() {
+    Tenant* next = nullptr;
+    for (auto& tenant : tenants) {
+        if (!tenant.second.ready.empty() && (next == nullptr || tenant.second.served < next->served)) {
+            next = &tenant.second;
+        }
+    }
+    Job* job = next->ready.front();
+    next->ready.pop_front();
+    readyJobs--;
+    virtualTime = next->served;
+    return job;
+}
+
+// Takes the job out of the map and hands it to its callback
+void Scheduler::finish(unique_lock<mutex>& guard, Job* job, JobStatus status) {
+    job->status = status;
+    tenants[job->tenant].stats.finished[status]++;
+
+    auto entry = jobs.find(job->id);
+    unique_ptr<Job> owned = move(entry->second.first);
+    Callback done = move(entry->second.second);
+
+    // The job only leaves the map once its callback returned, so wait()
+    // does not return before the last result has been handed over
+    guard.unlock();
+    if (done) {
+        done(*owned);
+    }
+    guard.lock();
+    jobs.erase(entry);
+    if (jobs.empty()) {
+        idle.notify_all();
+    }
+}
+
+// Runs slices until the scheduler is stopped
+void Scheduler::workLoop() {
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        work.wait(guard, [this] { return stopping || readyJobs > 0; });
+        if (stopping) {
+            return;
+        }
+
+        Job* job = takeNext();
+        Tenant& tenant = tenants[job->tenant];
+        Job::Clock::time_point start = Job::Clock::now();
+        const double waited = secondsBetween(job->readySince, start);
+        job->waitSeconds += waited;
+        tenant.stats.waitSeconds += waited;
+        if (job->hasDeadline && start >= job->deadline) {
+            finish(guard, job, JOB_DEADLINE);
+            continue;
+        }
+
+        // The job is in no queue now, so it is only this worker's until it
+        // goes back into one
+        guard.unlock();
+        const long long slice = min(quantum, job->left);
+        long long left = slice;
+        NoTrace trace;
+        ExecStatus status = runDecoded(job->hw, *job->program, left, trace);
+        Job::Clock::time_point end = Job::Clock::now();
+        guard.lock();
+
+        const long long executed = slice - left;
+        const double ran = secondsBetween(start, end);
+        job->left -= executed;
+        job->executed += executed;
+        job->slices++;
+        job->runSeconds += ran;
+        tenant.stats.instructions += executed;
+        tenant.stats.slices++;
+        tenant.stats.runSeconds += ran;
+        // A slice that ends before its first instruction still costs a turn
+        tenant.served += max(executed, 1LL);
+
+        if (status == EXEC_HALTED) {
+            finish(guard, job, JOB_HALTED);
+        } else if (status == EXEC_FAULT) {
+            finish(guard, job, JOB_FAULT);
+        } else if (job->left == 0) {
+            finish(guard, job, JOB_BUDGET);
+        } else if (job->hasDeadline && end >= job->deadline) {
+            finish(guard, job, JOB_DEADLINE);
+        } else {
+            makeReady(job, end);
+            // Another worker may be idle while this one goes on with it
+            work.notify_one();
+        }
+    }
+}
+//
+// End of Scheduler definitions
+//
+
+
+
+//
+// Start of schedule command
+//
+// One line of the jobs file
+struct ScheduledJob {
+    string tenant;
+    string filename;
+    JobLimits limits;
+};
+
+// Parses a count, true if it is a whole number from 1 to LLONG_MAX
+static bool parsePositive(const string& text, long long& value) {
+    char* stop = nullptr;
+    errno = 0;
+    value = strtoll(text.c_str(), &stop, 10);
+    return !text.empty() && *stop == '\0' && errno == 0 && value > 0;
+}
+
+// Reads the jobs file: "TENANT FILE [steps=N] [deadline=MS]" per line, blank
+// lines and lines starting with # are skipped
+static bool readJobs(const Options& options, vector<ScheduledJob>& jobs, string& error) {
+    MappedFile file(options.scheduleFile);
+    if (!file.isOpen()) {
+        error = "could not open " + options.scheduleFile;
+        return false;
+    }
+
+    istringstream lines(string(file.data(), file.size()));
+    string line;
+    int number = 0;
+    while (getline(lines, line)) {
+        number++;
+        istringstream words(line);
+        ScheduledJob job;
+        if (!(words >> job.tenant) || job.tenant[0] == '#') {
+            continue;
+        }
+
+        const string where = options.scheduleFile + ": line " + to_string(number) + ": ";
+        if (!(words >> job.filename)) {
+            error = where + "expected a tenant and a file";
+            return false;
+        }
+        job.limits.budget = options.maxSteps;
+        job.limits.deadline = options.deadline / 1000.0;
+
+        string word;
+        while (words >> word) {
+            long long value;
+            if (word.compare(0, 6, "steps=") == 0 && parsePositive(word.substr(6), value)) {
+                job.limits.budget = value;
+            } else if (word.compare(0, 9, "deadline=") == 0 && parsePositive(word.substr(9), value)) {
+                job.limits.deadline = value / 1000.0;
+            } else {
+                error = where + "'" + word + "' is not steps=N or deadline=MS";
+                return false;
+            }
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// A program every job running the same file shares
+struct LoadedProgram {
+    shared_ptr<const Program> program;  // Null if it could not be loaded
+    int memorySize = 0;
+    string error;
+};
+
+// Final state of one job, or why it could not be loaded
+struct ScheduleResult {
+    string error;
+    JobStatus status = JOB_HALTED;
+    long long executed = 0;
+    long long slices = 0;
+    double waitSeconds = 0;
+    double runSeconds = 0;
+    int pc = 0;
+    long long a = 0;
+    long long b = 0;
+    int zero = 0;
+    int overflow = 0;
+    string memory;  // name=value per symbol, separated by blanks
+};
+
+// Writes the result of job index as a CSV line or as an element of the JSON jobs array
+static void writeJob(ostream& out, const Options& options, size_t index, const ScheduledJob& job,
+                     const ScheduleResult& result) {
+    const char* status = result.error.empty() ? jobStatusName(result.status) : "error";
+    if (options.json) {
+        out << (index == 0 ? "\n" : ",\n") << "    {\"job\": " << index << ", \"tenant\": ";
+        writeJsonString(out, job.tenant);
+        out << ", \"file\": ";
+        writeJsonString(out, job.filename);
+        out << ", \"status\": \"" << status << "\"";
+        if (!result.error.empty()) {
+            out << ", \"error\": ";
+            writeJsonString(out, result.error);
+            out << "}";
+            return;
+        }
+        out << ", \"instructions\": " << result.executed << ", \"slices\": " << result.slices
+            << ", \"wait_ms\": " << result.waitSeconds * 1000 << ", \"run_ms\": " << result.runSeconds * 1000
+            << ", \"pc\": " << result.pc << ", \"a\": " << result.a << ", \"b\": " << result.b
+            << ", \"zero\": " << result.zero << ", \"overflow\": " << result.overflow << ", \"memory\": ";
+        writeJsonString(out, result.memory);
+        out << "}";
+        return;
+    }
+
+    out << index << ',';
+    writeCsvField(out, job.tenant);
+    out << ',';
+    writeCsvField(out, job.filename);
+    out << ',' << status;
+    if (!result.error.empty()) {
+        out << ",,,,,,,,,,,";
+        writeCsvField(out, result.error);
+        out << '\n';
+        return;
+    }
+    out << ',' << result.executed << ',' << result.slices << ',' << result.waitSeconds * 1000 << ','
+        << result.runSeconds * 1000 << ',' << result.pc << ',' << result.a << ',' << result.b << ','
+        << result.zero << ',' << result.overflow << ',';
+    writeCsvField(out, result.memory);
+    out << ",\n";
+}
+
+// Writes the totals of a tenant as a CSV line or as an element of the JSON tenants array
+static void writeTenant(ostream& out, const Options& options, size_t index, const TenantStats& stats,
+                        long long errors) {
+    if (options.json) {
+        out << (index == 0 ? "\n" : ",\n") << "    {\"tenant\": ";
+        writeJsonString(out, stats.name);
+        out << ", \"jobs\": " << stats.jobs + errors;
+        for (int status = JOB_HALTED; status <= JOB_DEADLINE; status++) {
+            out << ", \"" << jobStatusName((JobStatus) status) << "\": " << stats.finished[status];
+        }
+        out << ", \"errors\": " << errors << ", \"instructions\": " << stats.instructions
+            << ", \"slices\": " << stats.slices << ", \"run_ms\": " << stats.runSeconds * 1000
+            << ", \"wait_ms\": " << stats.waitSeconds * 1000 << "}";
+        return;
+    }
+
+    writeCsvField(out, stats.name);
+    out << ',' << stats.jobs + errors;
+    for (int status = JOB_HALTED; status <= JOB_DEADLINE; status++) {
+        out << ',' << stats.finished[status];
+    }
+    out << ',' << errors << ',' << stats.instructions << ',' << stats.slices << ','
+        << stats.runSeconds * 1000 << ',' << stats.waitSeconds * 1000 << '\n';
+}
+
+// Loads every file once, submits every job and prints the results in the
+// order of the jobs file, then the totals of each tenant
+int runSchedule(const Options& options) {
+    vector<ScheduledJob> jobs;
+    string error;
+    if (!readJobs(options, jobs, error)) {
+        cerr << "minicpu: " << error << endl;
+        return 1;
+    }
+
+    // Jobs of the same file share its program, each gets its own machine
+    map<string, LoadedProgram> programs;
+    for (const ScheduledJob& job : jobs) {
+        LoadedProgram& loaded = programs[job.filename];
+        if (loaded.program || !loaded.error.empty()) {
+            continue;
+        }
+        ALI ali(options.memorySize);
+        if (ali.loadFile(job.filename, loaded.error)) {
+            if (!options.fusion || !options.loopSkip) {
+                fuseProgram(ali.program, options.fusion, options.loopSkip);
+            }
+            loaded.memorySize = (int) ali.hw.value_memory.size();
+            loaded.program = make_shared<Program>(move(ali.program));
+        }
+    }
+
+    vector<ScheduleResult> results(jobs.size());
+    map<string, long long> errors;  // Jobs per tenant whose file could not be loaded
+    bool failed = false;
+    vector<TenantStats> tenants;
+    {
+        Scheduler scheduler(options.jobs, options.quantum);
+        for (size_t index = 0; index < jobs.size(); index++) {
+            const ScheduledJob& job = jobs[index];
+            const LoadedProgram& loaded = programs[job.filename];
+            if (!loaded.program) {
+                results[index].error = loaded.error;
+                errors[job.tenant]++;
+                failed = true;
+                continue;
+            }
+
+            // Every callback writes its own element, nothing else touches it
+            ScheduleResult* result = &results[index];
+            scheduler.submit(job.tenant, job.filename, loaded.program, loaded.memorySize, job.limits,
+                             [result](const Job& done) {
+                result->status = done.status;
+                result->executed = done.executed;
+                result->slices = done.slices;
+                result->waitSeconds = done.waitSeconds;
+                result->runSeconds = done.runSeconds;
+                result->pc = done.hw.pc;
+                result->a = done.hw.a;
+                result->b = done.hw.b;
+                result->zero = done.hw.zero_bit;
+                result->overflow = done.hw.overflow_bit;
+                const Program& program = *done.program;
+                for (size_t symbol = 0; symbol < program.symbols.size(); symbol++) {
+                    result->memory += (symbol == 0 ? "" : " ") + program.symbols[symbol] + "=" +
+                                      to_string(done.hw.value_memory[program.addresses[symbol]]);
+                }
+            });
+        }
+        scheduler.wait();
+        tenants = scheduler.tenantStats();
+    }
+
+    // Tenants whose jobs all failed to load do not appear in the scheduler
+    for (const auto& tenant : errors) {
+        auto found = find_if(tenants.begin(), tenants.end(),
+                             [&](const TenantStats& stats) { return stats.name == tenant.first; });
+        if (found == tenants.end()) {
+            TenantStats stats;
+            stats.name = tenant.first;
+            tenants.insert(lower_bound(tenants.begin(), tenants.end(), stats,
+                                       [](const TenantStats& x, const TenantStats& y) { return x.name < y.name; }),
+                           stats);
+        }
+    }
+
+    OutputBuffer buffer(stdout);
+    ostream out(&buffer);
+    if (options.json) {
+        out << "{\n  \"version\": 1,\n  \"jobs\": [";
+    } else {
+        out << "job,tenant,file,status,instructions,slices,wait_ms,run_ms,pc,a,b,zero,overflow,memory,error\n";
+    }
+    for (size_t index = 0; index < jobs.size(); index++) {
+        writeJob(out, options, index, jobs[index], results[index]);
+    }
+    if (options.json) {
+        out << "\n  ],\n  \"tenants\": [";
+    } else {
+        out << "\ntenant,jobs,halted,budget,fault,deadline,errors,instructions,slices,run_ms,wait_ms\n";
+    }
+    for (size_t index = 0; index < tenants.size(); index++) {
+        writeTenant(out, options, index, tenants[index], errors[tenants[index].name]);
+    }
+    if (options.json) {
+        out << "\n  ]\n}\n";
+    }
+    out.flush();
+    return failed ? 1 : 0;
+}
+//
+// End of schedule command
+//
@@ -0,0 +1,168 @@
+//
+// Created by Michal
+//
+
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hardware.h"
+#include "bytecode.h"
+#include "options.h"
+
+#ifndef MINICPU_SCHEDULER_H
+#define MINICPU_SCHEDULER_H
+
+//
+// Start of Job
+//
+// How a job ended
+enum JobStatus {
+    JOB_HALTED,    // HLT was executed
+    JOB_BUDGET,    // It used up its instruction budget
+    JOB_FAULT,     // pc reached a slot without an instruction
+    JOB_DEADLINE   // Its wall clock deadline passed first
+};
+
+// Name of the status in results: halted, budget, fault or deadline
+const char* jobStatusName(JobStatus status);
+
+// Limits of one job
+struct JobLimits {
+    long long budget = LLONG_MAX;  // Instructions it may run in total
+    double deadline = 0;           // Seconds after submission it has to end in, 0 for none
+};
+
+struct Job {
+    // A submitted program with its own machine. The program is shared with
+    // every other job that runs the same one.
+    typedef std::chrono::steady_clock Clock;
+
+    Job(int number, const std::string& owner, const std::string& label,
+        std::shared_ptr<const Program> code, int memorySize, const JobLimits& limits,
+        const std::vector<long long>& values);
+
+    int id;                                  // Number given by Scheduler::submit
+    std::string tenant;                      // Who submitted it
+    std::string name;                        // What it is called in results (file name)
+    std::shared_ptr<const Program> program;  // Program it runs, read only
+    Hardware hw;                             // Its machine
+    long long left;                          // Instructions it may still run
+    bool hasDeadline;
+    Clock::time_point deadline;              // When it is stopped if still running
+
+    JobStatus status = JOB_HALTED;           // How it ended (once done)
+    long long executed = 0;                  // Instructions executed
+    long long slices = 0;                    // Number of times it got a worker
+    double runSeconds = 0;                   // Time spent running
+    double waitSeconds = 0;                  // Time spent ready but waiting for a worker
+    Clock::time_point readySince;            // When it was queued last
+};
+//
+// End of Job
+//
+
+
+
+//
+// Start of Scheduler
+//
+// Totals of one tenant
+struct TenantStats {
+    std::string name;
+    long long jobs = 0;                 // Jobs submitted
+    long long finished[JOB_DEADLINE + 1] = {};  // Jobs done, per JobStatus
+    long long instructions = 0;         // Instructions executed by all of its jobs
+    long long slices = 0;               // Slices run
+    double runSeconds = 0;              // Worker time used
+    double waitSeconds = 0;             // Time its jobs waited for a worker
+};
+
+class Scheduler {
+    // Runs the jobs of many tenants on a fixed number of worker threads. Each
+    // time a job gets a worker it runs a slice of at most quantum instructions
+    // with runDecoded, whose budget is only checked where a straight line
+    // run starts (after jumps), so slicing costs nothing per instruction.
+    // Jobs that are neither done nor past their budget or deadline go back to
+    // the end of their tenant's queue.
+    //
+    // Workers are shared fairly between tenants, not jobs: every tenant has a
+    // queue of ready jobs and the next slice goes to the tenant with ready
+    // jobs that has been served the fewest instructions (start time fair
+    // queueing). A tenant that becomes ready again starts at the current
+    // virtual time, so being idle does not build up credit. A tenant with a
+    // thousand jobs gets the same share as one with a single job.
+public:
+    // Called with every job once it is done, on the worker that finished it
+    typedef std::function<void(const Job&)> Callback;
+
+    // Starts workers threads (0: one per core); each slice runs at most quantum instructions
+    Scheduler(int workers, long long quantum);
+
+    // Stops the workers; jobs that are not done yet are dropped
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Adds a job running program on a new machine with memorySize slots,
+    // with values[s] in the slot of symbol s (all zero if values is empty).
+    // Can be called from any thread at any time. Returns the job id.
+    int submit(const std::string& tenant, const std::string& name, std::shared_ptr<const Program> program,
+               int memorySize, const JobLimits& limits, Callback done = nullptr,
+               const std::vector<long long>& values = std::vector<long long>());
+
+    // Waits until every job submitted so far is done
+    void wait();
+
+    // Totals of every tenant, by name
+    std::vector<TenantStats> tenantStats();
+
+private:
+    struct Tenant {
+        TenantStats stats;
+        std::deque<Job*> ready;  // Jobs waiting for a worker, oldest first
+        long long served = 0;    // Virtual time: instructions run for it (see the class comment)
+    };
+
+    long long quantum;                 // Instructions per slice
+    std::mutex lock;                   // Guards everything below
+    std::condition_variable work;      // A job became ready, or the workers have to stop
+    std::condition_variable idle;      // The last job is done
+    std::map<std::string, Tenant> tenants;
+    std::map<int, std::pair<std::unique_ptr<Job>, Callback>> jobs;  // Jobs not done yet
+    long long virtualTime = 0;         // served of the tenant picked last
+    int readyJobs = 0;                 // Jobs in the ready queues
+    int nextId = 0;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    // Worker thread
+    void workLoop();
+
+    // Queues the job at the end of its tenant's queue (lock held)
+    void makeReady(Job* job, Job::Clock::time_point now);
+
+    // Takes the next job, from the tenant served least (lock held, readyJobs > 0)
+    Job* takeNext();
+
+    // Ends the job and calls its callback (lock held, released around the callback)
+    void finish(std::unique_lock<std::mutex>& guard, Job* job, JobStatus status);
+};
+
+// Runs the jobs listed in options.scheduleFile ("TENANT FILE [steps=N]
+// [deadline=MS]" per line) on options.jobs workers and prints the result of
+// every job and the totals of every tenant. Returns the process exit code.
+int runSchedule(const Options& options);
+//
+// End of Scheduler
+//
+
+#endif //MINICPU_SCHEDULER_H
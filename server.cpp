@@ -0,0 +1,580 @@
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+#include "hardware.h"
+#include "bytecode.h"
+#include "trace.h"
+#include "options.h"
+#include "ali.h"
+#include "mappedfile.h"
+#include "scheduler.h"
+#include "server.h"
+
+using namespace std;
+
+#if defined(__unix__) || defined(__APPLE__)
+
+//
+// Start of server protocol definitions
+//
+// Reads exactly size bytes, false at the end of the stream or on an error
+static bool readAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t got = ::read(fd, data, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        size -= (size_t) got;
+    }
+    return true;
+}
+
+// Writes exactly size bytes, false on an error
+static bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t put = ::write(fd, data, size);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return false;
+        }
+        data += put;
+        size -= (size_t) put;
+    }
+    return true;
+}
+
+bool readFrame(int fd, string& body) {
+    unsigned char header[4];
+    if (!readAll(fd, (char*) header, sizeof(header))) {
+        return false;
+    }
+    const uint32_t size = (uint32_t) header[0] << 24 | (uint32_t) header[1] << 16 |
+                          (uint32_t) header[2] << 8 | (uint32_t) header[3];
+    if (size > maximumFrameSize) {
+        return false;
+    }
+    body.resize(size);
+    return size == 0 || readAll(fd, &body[0], size);
+}
+
+bool writeFrame(int fd, const string& body) {
+    if (body.size() > maximumFrameSize) {
+        return false;
+    }
+    const uint32_t size = (uint32_t) body.size();
+    string frame;
+    frame.reserve(sizeof(size) + body.size());
+    frame += (char) (size >> 24);
+    frame += (char) (size >> 16);
+    frame += (char) (size >> 8);
+    frame += (char) size;
+    frame += body;
+    return writeAll(fd, frame.data(), frame.size());
+}
+
+// Sets the address of the socket at path, false if the path is too long
+static bool socketAddress(const string& path, sockaddr_un& address, string& error) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        error = "socket path '" + path + "' is empty or too long";
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+//
+// End of server protocol definitions
+//
+
+
+
+//
+// Start of ProgramCache
+//
+// Programs kept decoded, the oldest is dropped once there are more
+static const size_t programCacheSize = 1024;
+
+class ProgramCache {
+    // Decoded and linked programs by ID, the 64 bit FNV-1a hash of their
+    // source as 16 hex digits. Jobs hold their program through a shared_ptr,
+    // so dropping one from the cache never pulls it from under a running job.
+public:
+    explicit ProgramCache(const Options& serverOptions) : options(serverOptions) {}
+
+    // The program of source, decoded now unless it is cached (cached tells
+    // which). Sets id. Returns null and sets error if it cannot be loaded.
+    shared_ptr<const Program> load(const string& source, string& id, bool& cached, string& error) {
+        id = programId(source);
+        {
+            lock_guard<mutex> guard(lock);
+            auto found = programs.find(id);
+            if (found != programs.end() && found->second.source == source) {
+                cached = true;
+                return found->second.program;
+            }
+        }
+
+        // Decoding does not need the lock, two requests with the same new
+        // program may both decode it
+        cached = false;
+        ALI ali(options.memorySize);
+        if (!ali.loadSource(source.data(), source.size(), error)) {
+            return nullptr;
+        }
+        if (!options.fusion || !options.loopSkip) {
+            fuseProgram(ali.program, options.fusion, options.loopSkip);
+        }
+        shared_ptr<const Program> program = make_shared<Program>(move(ali.program));
+
+        lock_guard<mutex> guard(lock);
+        if (programs.find(id) == programs.end()) {
+            order.push_back(id);
+            if (order.size() > programCacheSize) {
+                programs.erase(order.front());
+                order.pop_front();
+            }
+        }
+        programs[id] = Entry{source, program};
+        return program;
+    }
+
+    // The cached program id, or null
+    shared_ptr<const Program> find(const string& id) {
+        lock_guard<mutex> guard(lock);
+        auto found = programs.find(id);
+        return found == programs.end() ? nullptr : found->second.program;
+    }
+
+private:
+    struct Entry {
+        string source;                      // Compared on lookup, so a hash collision is only a miss
+        shared_ptr<const Program> program;
+    };
+
+    // 64 bit FNV-1a of the text as 16 hex digits
+    static string programId(const string& text) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+        char digits[17];
+        snprintf(digits, sizeof(digits), "%016llx", (unsigned long long) hash);
+        return digits;
+    }
+
+    const Options& options;
+    mutex lock;                                  // Guards programs and order
+    unordered_map<string, Entry> programs;
+    deque<string> order;                         // IDs from the oldest
+};
+//
+// End of ProgramCache
+//
+
+
+
+//
+// Start of server commands definitions
+//
+// Set by SIGINT and SIGTERM
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+    stopRequested = 1;
+}
+
+// State shared by the connections of a server
+struct Server {
+    explicit Server(const Options& serverOptions)
+        : options(serverOptions), cache(serverOptions), scheduler(new Scheduler(serverOptions.jobs,
+                                                                                serverOptions.quantum)) {}
+
+    const Options& options;
+    ProgramCache cache;
+    mutex lock;                         // Guards everything below
+    unique_ptr<Scheduler> scheduler;    // Null once the server stops
+    map<int, thread> connections;       // Connection threads by number
+    vector<int> finished;               // Connections whose thread is done, not joined yet
+    set<int> sockets;                   // Sockets of open connections
+};
+
+// Parses a whole number, true if all of text is one
+static bool parseNumber(const string& text, long long& value) {
+    char* stop = nullptr;
+    errno = 0;
+    value = strtoll(text.c_str(), &stop, 10);
+    return !text.empty() && *stop == '\0' && errno == 0;
+}
+
+// Response to a request that could not be run
+static string errorResponse(const string& error) {
+    ostringstream out;
+    out << "{\"status\": \"error\", \"error\": ";
+    writeJsonString(out, error);
+    out << "}";
+    return out.str();
+}
+
+// Response with the final state of a job
+static string jobResponse(const Job& job, const string& id, bool cached, double loadSeconds) {
+    const Program& program = *job.program;
+    ostringstream out;
+    out << "{\"status\": \"" << jobStatusName(job.status) << "\", \"program\": \"" << id << "\""
+        << ", \"cached\": " << (cached ? "true" : "false") << ", \"instructions\": " << job.executed
+        << ", \"slices\": " << job.slices << ", \"pc\": " << job.hw.pc << ", \"a\": " << job.hw.a
+        << ", \"b\": " << job.hw.b << ", \"zero\": " << job.hw.zero_bit << ", \"overflow\": "
+        << job.hw.overflow_bit << ", \"memory\": {";
+    for (size_t symbol = 0; symbol < program.symbols.size(); symbol++) {
+        out << (symbol == 0 ? "" : ", ");
+        writeJsonString(out, program.symbols[symbol]);
+        out << ": " << job.hw.value_memory[program.addresses[symbol]];
+    }
+    out << "}, \"load_ms\": " << loadSeconds * 1000 << ", \"wait_ms\": " << job.waitSeconds * 1000
+        << ", \"run_ms\": " << job.runSeconds * 1000 << "}";
+    return out.str();
+}
+
+// Runs one request and returns its response
+static string handleRequest(Server& server, const string& body) {
+    const auto loadStart = chrono::steady_clock::now();
+
+    // Header lines up to the first blank line, then the source
+    string tenant = "default";
+    string id;
+    JobLimits limits;
+    limits.budget = server.options.maxSteps;
+    limits.deadline = server.options.deadline / 1000.0;
+    vector<pair<string, long long>> sets;
+
+    size_t position = 0;
+    while (position < body.size()) {
+        size_t end = body.find('\n', position);
+        if (end == string::npos) {
+            end = body.size();
+        }
+        string line = body.substr(position, end - position);
+        position = end + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            break;
+        }
+
+        long long value;
+        if (line.compare(0, 4, "set ") == 0) {
+            const size_t equals = line.find('=', 4);
+            if (equals == string::npos || !parseNumber(line.substr(equals + 1), value) ||
+                value < INT32_MIN || value > INT32_MAX) {
+                return errorResponse("'" + line + "' is not set NAME=VALUE with a 32 bit VALUE");
+            }
+            sets.emplace_back(line.substr(4, equals - 4), value);
+            continue;
+        }
+
+        const size_t equals = line.find('=');
+        const string key = line.substr(0, equals);
+        const string text = equals == string::npos ? "" : line.substr(equals + 1);
+        if (key == "tenant" && !text.empty()) {
+            tenant = text;
+        } else if (key == "program" && !text.empty()) {
+            id = text;
+        } else if (key == "steps" && parseNumber(text, value) && value > 0) {
+            limits.budget = value;
+        } else if (key == "deadline" && parseNumber(text, value) && value > 0) {
+            limits.deadline = value / 1000.0;
+        } else {
+            return errorResponse("unknown request line '" + line + "'");
+        }
+    }
+
+    shared_ptr<const Program> program;
+    bool cached = true;
+    string error;
+    if (!id.empty()) {
+        program = server.cache.find(id);
+        if (!program) {
+            return errorResponse("program " + id + " is not cached, send its source");
+        }
+    } else {
+        const string source = position < body.size() ? body.substr(position) : string();
+        program = server.cache.load(source, id, cached, error);
+        if (!program) {
+            return errorResponse(error);
+        }
+    }
+
+    vector<long long> values;
+    if (!sets.empty()) {
+        values.assign(program->symbols.size(), 0);
+        for (const auto& set : sets) {
+            auto symbol = program->symbolIds.find(set.first);
+            if (symbol == program->symbolIds.end()) {
+                return errorResponse("'" + set.first + "' is not a symbol of the program");
+            }
+            values[symbol->second] = set.second;
+        }
+    }
+    const double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+
+    // The callback owns the promise: if the server stops before the job is
+    // done, dropping the job breaks the promise and get() throws
+    shared_ptr<promise<string>> response = make_shared<promise<string>>();
+    future<string> result = response->get_future();
+    {
+        lock_guard<mutex> guard(server.lock);
+        if (!server.scheduler) {
+            return errorResponse("the server is stopping");
+        }
+        server.scheduler->submit(tenant, "request", program, server.options.memorySize, limits,
+                                 [response, id, cached, loadSeconds](const Job& job) {
+            response->set_value(jobResponse(job, id, cached, loadSeconds));
+        }, values);
+    }
+    response.reset();
+    return result.get();
+}
+
+// Answers the requests of one connection until it closes
+static void serveConnection(Server& server, int number, int fd) {
+    string body;
+    try {
+        while (readFrame(fd, body)) {
+            if (!writeFrame(fd, handleRequest(server, body))) {
+                break;
+            }
+        }
+    } catch (const future_error&) {
+        // The server stopped while a job of this connection was running
+    }
+
+    lock_guard<mutex> guard(server.lock);
+    server.sockets.erase(fd);
+    ::close(fd);
+    server.finished.push_back(number);
+}
+
+// Joins the threads of connections that are done (server lock held)
+static void joinFinished(Server& server) {
+    for (int number : server.finished) {
+        server.connections[number].join();
+        server.connections.erase(number);
+    }
+    server.finished.clear();
+}
+
+int runServer(const Options& options) {
+    sockaddr_un address;
+    string error;
+    if (!socketAddress(options.serveSocket, address, error)) {
+        cerr << "minicpu: " << error << endl;
+        return 1;
+    }
+
+    // A socket file left by a server that is gone is replaced, one that
+    // still answers is not
+    struct stat info;
+    if (stat(options.serveSocket.c_str(), &info) == 0) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool answers = probe >= 0 && connect(probe, (const sockaddr*) &address, sizeof(address)) == 0;
+        if (probe >= 0) {
+            ::close(probe);
+        }
+        if (answers || !S_ISSOCK(info.st_mode)) {
+            cerr << "minicpu: " << options.serveSocket << " is in use" << endl;
+            return 1;
+        }
+        unlink(options.serveSocket.c_str());
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (const sockaddr*) &address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        cerr << "minicpu: cannot listen on " << options.serveSocket << ": " << strerror(errno) << endl;
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        return 1;
+    }
+
+    // SIGINT and SIGTERM are only let through while waiting for a
+    // connection, so every thread started from here keeps them blocked and
+    // only pselect below sees them. A client that goes away must not kill
+    // the server with SIGPIPE.
+    sigset_t stopSignals, waitMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &waitMask);
+    sigdelset(&waitMask, SIGINT);
+    sigdelset(&waitMask, SIGTERM);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    Server server(options);
+    cerr << "minicpu: serving on " << options.serveSocket << endl;
+
+    int nextConnection = 0;
+    while (!stopRequested) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listener, &readable);
+        if (pselect(listener + 1, &readable, nullptr, nullptr, nullptr, &waitMask) <= 0) {
+            continue;  // Interrupted, maybe by a stop signal
+        }
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+
+        lock_guard<mutex> guard(server.lock);
+        joinFinished(server);
+        server.sockets.insert(fd);
+        const int number = nextConnection++;
+        server.connections[number] = thread(serveConnection, ref(server), number, fd);
+    }
+
+    // Stop taking requests, wake the connections waiting for one and drop
+    // the jobs still running, then wait for every connection to end
+    ::close(listener);
+    unlink(options.serveSocket.c_str());
+    unique_ptr<Scheduler> scheduler;
+    {
+        lock_guard<mutex> guard(server.lock);
+        for (int fd : server.sockets) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        scheduler = move(server.scheduler);
+    }
+    scheduler.reset();
+    for (auto& connection : server.connections) {
+        connection.second.join();
+    }
+    return 0;
+}
+
+int runClient(const Options& options) {
+    string request;
+    if (!options.programId.empty()) {
+        request += "program=" + options.programId + "\n";
+    }
+    if (!options.tenant.empty()) {
+        request += "tenant=" + options.tenant + "\n";
+    }
+    if (options.maxSteps != LLONG_MAX) {
+        request += "steps=" + to_string(options.maxSteps) + "\n";
+    }
+    if (options.deadline > 0) {
+        request += "deadline=" + to_string(options.deadline) + "\n";
+    }
+    for (const string& set : options.sets) {
+        request += "set " + set + "\n";
+    }
+    request += "\n";
+    if (options.programId.empty()) {
+        MappedFile file(options.filename);
+        if (!file.isOpen()) {
+            cerr << "minicpu: could not open " << options.filename << endl;
+            return 1;
+        }
+        request.append(file.data(), file.size());
+    }
+
+    sockaddr_un address;
+    string error;
+    if (!socketAddress(options.clientSocket, address, error)) {
+        cerr << "minicpu: " << error << endl;
+        return 1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (const sockaddr*) &address, sizeof(address)) != 0) {
+        cerr << "minicpu: cannot connect to " << options.clientSocket << ": " << strerror(errno) << endl;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return 1;
+    }
+
+    string response;
+    const bool answered = writeFrame(fd, request) && readFrame(fd, response);
+    ::close(fd);
+    if (!answered) {
+        cerr << "minicpu: " << options.clientSocket << ": no response" << endl;
+        return 1;
+    }
+    cout << response << endl;
+
+    // The status is always the first field
+    const string status = response.substr(0, response.find(','));
+    if (status.find("\"halted\"") != string::npos) {
+        return 0;
+    }
+    if (status.find("\"fault\"") != string::npos) {
+        return 2;
+    }
+    if (status.find("\"budget\"") != string::npos || status.find("\"deadline\"") != string::npos) {
+        return 3;
+    }
+    return 1;
+}
+//
+// End of server commands definitions
+//
+
+#else
+
+bool readFrame(int, string&) {
+    return false;
+}
+
+bool writeFrame(int, const string&) {
+    return false;
+}
+
+int runServer(const Options&) {
+    cerr << "minicpu: --serve needs Unix domain sockets" << endl;
+    return 1;
+}
+
+int runClient(const Options&) {
+    cerr << "minicpu: --client needs Unix domain sockets" << endl;
+    return 1;
+}
+
+#endif
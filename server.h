@@ -0,0 +1,62 @@
+//
+// Created by Michal
+//
+
+#include <cstdint>
+#include <string>
+#include "options.h"
+
+#ifndef MINICPU_SERVER_H
+#define MINICPU_SERVER_H
+
+//
+// Start of server protocol
+//
+// Client and server talk over a Unix domain socket in frames: a 32 bit
+// length in network byte order followed by that many bytes. Every request
+// gets exactly one response frame, in order, and a connection can send any
+// number of requests.
+//
+// A request is "key=value" lines, a blank line and then the SAL source of the
+// program (nothing after the blank line if program= names a cached one):
+//     program=ID        run the cached program ID instead of the source
+//     tenant=NAME       whose share of the workers it uses (default "default")
+//     steps=N           instruction budget (default: --max-steps of the server)
+//     deadline=MS       wall clock deadline (default: --deadline of the server)
+//     set NAME=VALUE    initial value of symbol NAME (any number of them)
+// The response is one JSON object with the status (halted, budget, fault,
+// deadline or error), the program ID to send next time, whether it came from
+// the cache, the final state and the time spent loading, waiting and running.
+const uint32_t maximumFrameSize = 64 << 20;
+
+// Reads one frame from fd into body. Returns false at the end of the stream,
+// on an error or if the frame is larger than maximumFrameSize.
+bool readFrame(int fd, std::string& body);
+
+// Writes body as one frame. Returns false if it cannot be written.
+bool writeFrame(int fd, const std::string& body);
+//
+// End of server protocol
+//
+
+
+
+//
+// Start of server commands
+//
+// Serves requests on the socket options.serveSocket until SIGINT or SIGTERM.
+// Programs stay decoded in a cache between requests, and requests of all
+// connections run at the same time on the scheduler (options.jobs workers,
+// options.quantum instructions per slice). Returns the process exit code.
+int runServer(const Options& options);
+
+// Sends options.filename (or the cached program options.programId) with the
+// --tenant, --max-steps, --deadline and --set options to the server at
+// options.clientSocket and prints its response. Returns 0 halted, 1 error,
+// 2 fault, 3 budget or deadline reached.
+int runClient(const Options& options);
+//
+// End of server commands
+//
+
+#endif //MINICPU_SERVER_H
@@ -0,0 +1,377 @@
+// Checks the compile time evaluator against the interpreter: every test
+// program is run while compiling and its final state compared with what
+// "minicpu FILE" prints for it. Compiling the file is the check:
+//     g++ -std=c++11 -fsyntax-only tests/check_compiletime.cpp
+// The sources are copies of the .sal files next to this one, keep them in step.
+
+#include <climits>
+#include "../compiletime.h"
+
+//
+// Start of compile time checks
+//
+// test1_simple_add.sal
+constexpr char test1Source[] = R"(DEC x
+DEC y
+DEC sum
+LDI 5
+STR x
+LDI 10
+STR y
+LDA x
+LDB y
+ADD
+STR sum
+HLT
+)";
+constexpr auto test1 = MINICPU_EVALUATE(test1Source, LLONG_MAX);
+static_assert(test1.status == EXEC_HALTED && test1.executed == 12 &&
+              test1.pc == 11, "test1_simple_add: status");
+static_assert(test1.a == 15 && test1.b == 10 &&
+              test1.overflow_bit == 0 && test1.zero_bit == 0, "test1_simple_add: registers");
+static_assert(test1.symbols() == 3 &&
+              test1.isDeclared("sum") && test1.value("sum") == 15 &&
+              test1.isDeclared("x") && test1.value("x") == 5 &&
+              test1.isDeclared("y") && test1.value("y") == 10, "test1_simple_add: symbols");
+
+// test2_overflow.sal
+constexpr char test2Source[] = R"(DEC large1
+DEC large2
+DEC result
+LDI 2000000000
+STR large1
+LDI 2000000000
+STR large2
+LDA large1
+LDB large2
+ADD
+STR result
+HLT
+)";
+constexpr auto test2 = MINICPU_EVALUATE(test2Source, LLONG_MAX);
+static_assert(test2.status == EXEC_HALTED && test2.executed == 12 &&
+              test2.pc == 11, "test2_overflow: status");
+static_assert(test2.a == 2000000000 && test2.b == 2000000000 &&
+              test2.overflow_bit == 1 && test2.zero_bit == 0, "test2_overflow: registers");
+static_assert(test2.symbols() == 3 &&
+              test2.isDeclared("large1") && test2.value("large1") == 2000000000 &&
+              test2.isDeclared("large2") && test2.value("large2") == 2000000000 &&
+              test2.isDeclared("result") && test2.value("result") == 2000000000, "test2_overflow: symbols");
+
+// test3_zero_flag.sal
+constexpr char test3Source[] = R"(DEC num1
+DEC num2
+DEC result
+LDI 100
+STR num1
+LDI -100
+STR num2
+LDA num1
+LDB num2
+ADD
+STR result
+HLT
+)";
+constexpr auto test3 = MINICPU_EVALUATE(test3Source, LLONG_MAX);
+static_assert(test3.status == EXEC_HALTED && test3.executed == 12 &&
+              test3.pc == 11, "test3_zero_flag: status");
+static_assert(test3.a == 0 && test3.b == -100 &&
+              test3.overflow_bit == 0 && test3.zero_bit == 1, "test3_zero_flag: registers");
+static_assert(test3.symbols() == 3 &&
+              test3.isDeclared("num1") && test3.value("num1") == 100 &&
+              test3.isDeclared("num2") && test3.value("num2") == -100 &&
+              test3.isDeclared("result") && test3.value("result") == 0, "test3_zero_flag: symbols");
+
+// test4_exchange.sal
+constexpr char test4Source[] = R"(DEC val1
+DEC val2
+LDI 42
+STR val1
+LDI 99
+STR val2
+LDA val1
+LDB val2
+XCH
+STR val1
+XCH
+STR val2
+HLT
+)";
+constexpr auto test4 = MINICPU_EVALUATE(test4Source, LLONG_MAX);
+static_assert(test4.status == EXEC_HALTED && test4.executed == 13 &&
+              test4.pc == 12, "test4_exchange: status");
+static_assert(test4.a == 42 && test4.b == 99 &&
+              test4.overflow_bit == 0 && test4.zero_bit == 0, "test4_exchange: registers");
+static_assert(test4.symbols() == 2 &&
+              test4.isDeclared("val1") && test4.value("val1") == 99 &&
+              test4.isDeclared("val2") && test4.value("val2") == 42, "test4_exchange: symbols");
+
+// test5_simple_jump.sal
+constexpr char test5Source[] = R"(DEC x
+LDI 10
+STR x
+JMP 6
+LDI 999
+STR x
+LDA x
+HLT
+)";
+constexpr auto test5 = MINICPU_EVALUATE(test5Source, LLONG_MAX);
+static_assert(test5.status == EXEC_HALTED && test5.executed == 6 &&
+              test5.pc == 7, "test5_simple_jump: status");
+static_assert(test5.a == 10 && test5.b == 0 &&
+              test5.overflow_bit == 0 && test5.zero_bit == 0, "test5_simple_jump: registers");
+static_assert(test5.symbols() == 1 &&
+              test5.isDeclared("x") && test5.value("x") == 10, "test5_simple_jump: symbols");
+
+// test6_jzs.sal
+constexpr char test6Source[] = R"(DEC a
+DEC b
+DEC result
+LDI 50
+STR a
+LDI -50
+STR b
+LDA a
+LDB b
+ADD
+JZS 14
+LDI 1
+STR result
+HLT
+LDI 0
+STR result
+HLT
+)";
+constexpr auto test6 = MINICPU_EVALUATE(test6Source, LLONG_MAX);
+static_assert(test6.status == EXEC_HALTED && test6.executed == 14 &&
+              test6.pc == 16, "test6_jzs: status");
+static_assert(test6.a == 0 && test6.b == -50 &&
+              test6.overflow_bit == 0 && test6.zero_bit == 1, "test6_jzs: registers");
+static_assert(test6.symbols() == 3 &&
+              test6.isDeclared("a") && test6.value("a") == 50 &&
+              test6.isDeclared("b") && test6.value("b") == -50 &&
+              test6.isDeclared("result") && test6.value("result") == 0, "test6_jzs: symbols");
+
+// test7_jvs.sal
+constexpr char test7Source[] = R"(DEC big1
+DEC big2
+DEC overflow_flag
+LDI 2000000000
+STR big1
+LDI 2000000000
+STR big2
+LDA big1
+LDB big2
+ADD
+JVS 14
+LDI 0
+STR overflow_flag
+HLT
+LDI 1
+STR overflow_flag
+HLT
+)";
+constexpr auto test7 = MINICPU_EVALUATE(test7Source, LLONG_MAX);
+static_assert(test7.status == EXEC_HALTED && test7.executed == 14 &&
+              test7.pc == 16, "test7_jvs: status");
+static_assert(test7.a == 1 && test7.b == 2000000000 &&
+              test7.overflow_bit == 1 && test7.zero_bit == 0, "test7_jvs: registers");
+static_assert(test7.symbols() == 3 &&
+              test7.isDeclared("big1") && test7.value("big1") == 2000000000 &&
+              test7.isDeclared("big2") && test7.value("big2") == 2000000000 &&
+              test7.isDeclared("overflow_flag") && test7.value("overflow_flag") == 1, "test7_jvs: symbols");
+
+// test8_loop_100.sal
+constexpr char test8Source[] = R"(DEC counter
+DEC limit
+DEC one
+LDI 0
+STR counter
+LDI -100
+STR limit
+LDI 1
+STR one
+LDA counter
+LDB one
+ADD
+STR counter
+LDA limit
+LDB counter
+ADD
+JZS 18
+JMP 9
+HLT
+)";
+constexpr auto test8 = MINICPU_EVALUATE(test8Source, LLONG_MAX);
+static_assert(test8.status == EXEC_HALTED && test8.executed == 909 &&
+              test8.pc == 18, "test8_loop_100: status");
+static_assert(test8.a == 0 && test8.b == 100 &&
+              test8.overflow_bit == 0 && test8.zero_bit == 1, "test8_loop_100: registers");
+static_assert(test8.symbols() == 3 &&
+              test8.isDeclared("counter") && test8.value("counter") == 100 &&
+              test8.isDeclared("limit") && test8.value("limit") == -100 &&
+              test8.isDeclared("one") && test8.value("one") == 1, "test8_loop_100: symbols");
+
+// test9_loop_500.sal
+constexpr char test9Source[] = R"(DEC counter
+DEC limit
+DEC one
+LDI 0
+STR counter
+LDI -500
+STR limit
+LDI 1
+STR one
+LDA counter
+LDB one
+ADD
+STR counter
+LDA limit
+LDB counter
+ADD
+JZS 18
+JMP 9
+HLT
+)";
+constexpr auto test9 = MINICPU_EVALUATE(test9Source, LLONG_MAX);
+static_assert(test9.status == EXEC_HALTED && test9.executed == 4509 &&
+              test9.pc == 18, "test9_loop_500: status");
+static_assert(test9.a == 0 && test9.b == 500 &&
+              test9.overflow_bit == 0 && test9.zero_bit == 1, "test9_loop_500: registers");
+static_assert(test9.symbols() == 3 &&
+              test9.isDeclared("counter") && test9.value("counter") == 500 &&
+              test9.isDeclared("limit") && test9.value("limit") == -500 &&
+              test9.isDeclared("one") && test9.value("one") == 1, "test9_loop_500: symbols");
+
+// test10_nested_loop.sal
+constexpr char test10Source[] = R"(DEC outer_counter
+DEC outer_limit
+DEC inner_counter
+DEC inner_limit
+DEC one
+LDI 0
+STR outer_counter
+LDI -20
+STR outer_limit
+LDI -100
+STR inner_limit
+LDI 1
+STR one
+LDI 0
+STR inner_counter
+LDA inner_counter
+LDB one
+ADD
+STR inner_counter
+LDA inner_limit
+LDB inner_counter
+ADD
+JZS 24
+JMP 15
+LDA outer_counter
+LDB one
+ADD
+STR outer_counter
+LDA outer_limit
+LDB outer_counter
+ADD
+JZS 33
+JMP 13
+HLT
+)";
+constexpr auto test10 = MINICPU_EVALUATE(test10Source, LLONG_MAX);
+static_assert(test10.status == EXEC_HALTED && test10.executed == 18213 &&
+              test10.pc == 33, "test10_nested_loop: status");
+static_assert(test10.a == 0 && test10.b == 20 &&
+              test10.overflow_bit == 0 && test10.zero_bit == 1, "test10_nested_loop: registers");
+static_assert(test10.symbols() == 5 &&
+              test10.isDeclared("inner_counter") && test10.value("inner_counter") == 100 &&
+              test10.isDeclared("inner_limit") && test10.value("inner_limit") == -100 &&
+              test10.isDeclared("one") && test10.value("one") == 1 &&
+              test10.isDeclared("outer_counter") && test10.value("outer_counter") == 20 &&
+              test10.isDeclared("outer_limit") && test10.value("outer_limit") == -20, "test10_nested_loop: symbols");
+
+// test11_fibonacci.sal
+constexpr char test11Source[] = R"(DEC prev
+DEC curr
+DEC next
+DEC counter
+DEC limit
+DEC one
+LDI 0
+STR prev
+LDI 1
+STR curr
+LDI 0
+STR counter
+LDI -30
+STR limit
+LDI 1
+STR one
+LDA prev
+LDB curr
+ADD
+STR next
+LDA curr
+STR prev
+LDA next
+STR curr
+LDA counter
+LDB one
+ADD
+STR counter
+LDA limit
+LDB counter
+ADD
+JZS 33
+JMP 16
+HLT
+)";
+constexpr auto test11 = MINICPU_EVALUATE(test11Source, LLONG_MAX);
+static_assert(test11.status == EXEC_HALTED && test11.executed == 526 &&
+              test11.pc == 33, "test11_fibonacci: status");
+static_assert(test11.a == 0 && test11.b == 30 &&
+              test11.overflow_bit == 0 && test11.zero_bit == 1, "test11_fibonacci: registers");
+static_assert(test11.symbols() == 6 &&
+              test11.isDeclared("counter") && test11.value("counter") == 30 &&
+              test11.isDeclared("curr") && test11.value("curr") == 1346269 &&
+              test11.isDeclared("limit") && test11.value("limit") == -30 &&
+              test11.isDeclared("next") && test11.value("next") == 1346269 &&
+              test11.isDeclared("one") && test11.value("one") == 1 &&
+              test11.isDeclared("prev") && test11.value("prev") == 832040, "test11_fibonacci: symbols");
+
+// test12_loop_1000.sal
+constexpr char test12Source[] = R"(DEC counter
+DEC limit
+DEC one
+LDI 0
+STR counter
+LDI -1000
+STR limit
+LDI 1
+STR one
+LDA counter
+LDB one
+ADD
+STR counter
+LDA limit
+LDB counter
+ADD
+JZS 18
+JMP 9
+HLT
+)";
+constexpr auto test12 = MINICPU_EVALUATE(test12Source, LLONG_MAX);
+static_assert(test12.status == EXEC_HALTED && test12.executed == 9009 &&
+              test12.pc == 18, "test12_loop_1000: status");
+static_assert(test12.a == 0 && test12.b == 1000 &&
+              test12.overflow_bit == 0 && test12.zero_bit == 1, "test12_loop_1000: registers");
+static_assert(test12.symbols() == 3 &&
+              test12.isDeclared("counter") && test12.value("counter") == 1000 &&
+              test12.isDeclared("limit") && test12.value("limit") == -1000 &&
+              test12.isDeclared("one") && test12.value("one") == 1, "test12_loop_1000: symbols");
+
+//
+// End of compile time checks
+//
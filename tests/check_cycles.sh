@@ -0,0 +1,57 @@
+#!/bin/bash
+# Checks --detect-cycles: where a cycle is entered and how long it is.
+# Run from the project directory: tests/check_cycles.sh [path to minicpu]
+
+MINICPU=${1:-./minicpu}
+failed=0
+
+# expect NAME EXIT_CODE EXPECTED_EXIT_CODE OUTPUT LINE...: every LINE has to be in OUTPUT
+expect() {
+    local name=$1 code=$2 expected=$3 output=$4
+    shift 4
+    if [ "$code" != "$expected" ]; then
+        echo "FAIL $name: exit code $code, expected $expected"
+        failed=1
+        return
+    fi
+    for line in "$@"; do
+        if ! grep -qxF "$line" <<< "$output"; then
+            echo "FAIL $name: no line \"$line\" in"
+            echo "$output"
+            failed=1
+            return
+        fi
+    done
+    echo "ok   $name"
+}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# The state after 5 instructions (pc 5, A = B = 0, x = 0) comes back every
+# 3 instructions; the one after 4 (pc 4) never does
+printf 'DEC x\nLDI 0\nSTR x\nLDI 0\nJMP 5\nXCH\nXCH\nJMP 5\n' > "$work/entry.sal"
+output=$("$MINICPU" --detect-cycles "$work/entry.sal" 2>&1)
+expect "entry after a jump" $? 4 "$output" "Status: stopped" \
+    "Cycle: entered at pc 5 after 5 instructions, the state comes back every 3 instructions, the program never ends"
+
+# A loop that is a cycle from its first instruction (DEC changes nothing the
+# state is made of)
+printf 'DEC x\nJMP 0\n' > "$work/spin.sal"
+output=$("$MINICPU" --detect-cycles "$work/spin.sal" 2>&1)
+expect "cycle from the start" $? 4 "$output" \
+    "Cycle: entered at pc 0 after 0 instructions, the state comes back every 2 instructions, the program never ends"
+
+# A counter that counts up to the overflow first (loop skipping makes it fast)
+printf 'DEC x\nDEC one\nLDI 1\nSTR one\nLDA x\nLDB one\nADD\nSTR x\nJVS 10\nJMP 4\nJMP 10\n' > "$work/count.sal"
+output=$("$MINICPU" --detect-cycles "$work/count.sal" 2>&1)
+expect "entry after the overflow" $? 4 "$output" \
+    "Cycle: entered at pc 10 after 12884901885 instructions, the state comes back every 1 instruction, the program never ends"
+
+# The test programs all end
+for file in tests/*.sal; do
+    output=$("$MINICPU" --detect-cycles "$file" 2>&1)
+    expect "$(basename "$file" .sal) halts" $? 0 "$output" "Status: halted"
+done
+
+exit $failed
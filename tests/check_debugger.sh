@@ -0,0 +1,52 @@
+#!/bin/bash
+# Checks breakpoints of the headless mode and of the c command.
+# Run from the project directory: tests/check_debugger.sh [path to minicpu]
+
+MINICPU=${1:-./minicpu}
+failed=0
+
+# expect NAME EXIT_CODE EXPECTED_EXIT_CODE OUTPUT LINE...: every LINE has to be in OUTPUT
+expect() {
+    local name=$1 code=$2 expected=$3 output=$4
+    shift 4
+    if [ "$code" != "$expected" ]; then
+        echo "FAIL $name: exit code $code, expected $expected"
+        failed=1
+        return
+    fi
+    for line in "$@"; do
+        if ! grep -qxF "$line" <<< "$output"; then
+            echo "FAIL $name: no line \"$line\" in"
+            echo "$output"
+            failed=1
+            return
+        fi
+    done
+    echo "ok   $name"
+}
+
+snap=$(mktemp)
+trap 'rm -f "$snap"' EXIT
+
+# A breakpoint at the pc the run starts at stops before anything runs
+output=$("$MINICPU" --break=0 tests/test1_simple_add.sal 2>&1)
+expect "break at the first instruction" $? 5 "$output" \
+    "minicpu: tests/test1_simple_add.sal: Breakpoint 1 at pc 0 after 0 instructions" \
+    "Status: stopped" "Instructions executed: 0" "Program counter: 0"
+
+# A breakpoint on HLT stops before it runs
+output=$("$MINICPU" --break=11 tests/test1_simple_add.sal 2>&1)
+expect "break at HLT" $? 5 "$output" "Status: stopped" "Instructions executed: 11" "Program counter: 11"
+
+# A checkpoint taken at a breakpoint goes on past it when it is restored
+"$MINICPU" --break=16 --checkpoint="$snap" tests/test11_fibonacci.sal > /dev/null 2>&1
+output=$("$MINICPU" --break=16 --restore="$snap" 2>&1)
+expect "restore at a breakpoint" $? 5 "$output" \
+    "minicpu: $snap: Breakpoint 1 at pc 16 after 17 instructions" "Program counter: 16" "counter: 1"
+
+# The c command stops at a breakpoint on the first instruction, the next c goes on
+output=$(printf 'tests/test1_simple_add.sal\nb 0\nc\nc\n' | "$MINICPU")
+expect "c at the first instruction" $? 0 "$output" \
+    "Breakpoint 1 at pc 0" "Program counter: 0" "HLT reached at pc 11" "sum: 15"
+
+exit $failed
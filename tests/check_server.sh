@@ -0,0 +1,84 @@
+#!/bin/bash
+# Checks --serve with --client: requests with a source, the program cache,
+# --program-id, --set, the budget and the deadline.
+# Run from the project directory: tests/check_server.sh [path to minicpu]
+
+MINICPU=${1:-./minicpu}
+failed=0
+
+# expect NAME EXIT_CODE EXPECTED_EXIT_CODE RESPONSE TEXT...: every TEXT has to be in RESPONSE
+expect() {
+    local name=$1 code=$2 expected=$3 response=$4
+    shift 4
+    if [ "$code" != "$expected" ]; then
+        echo "FAIL $name: exit code $code, expected $expected"
+        echo "$response"
+        failed=1
+        return
+    fi
+    for text in "$@"; do
+        if ! grep -qF -- "$text" <<< "$response"; then
+            echo "FAIL $name: no $text in"
+            echo "$response"
+            failed=1
+            return
+        fi
+    done
+    echo "ok   $name"
+}
+
+work=$(mktemp -d)
+socket=$work/minicpu.sock
+"$MINICPU" --serve="$socket" --jobs=2 2> "$work/server.log" &
+server=$!
+trap 'kill $server 2> /dev/null; wait $server 2> /dev/null; rm -rf "$work"' EXIT
+
+# Wait until the server listens (it says so once it does)
+for i in $(seq 50); do
+    grep -q "serving on" "$work/server.log" && break
+    sleep 0.1
+done
+
+# A new program is loaded and cached, the same source again comes from the cache
+response=$("$MINICPU" --client="$socket" tests/test1_simple_add.sal)
+expect "source" $? 0 "$response" '"status": "halted"' '"cached": false' '"instructions": 12' \
+    '"a": 15' '"b": 10' '"sum": 15'
+id=$(sed -n 's/.*"program": "\([^"]*\)".*/\1/p' <<< "$response")
+
+response=$("$MINICPU" --client="$socket" tests/test1_simple_add.sal)
+expect "same source again" $? 0 "$response" '"status": "halted"' "\"program\": \"$id\"" '"cached": true'
+
+# The cached program runs by its ID, without sending the source
+response=$("$MINICPU" --client="$socket" --program-id="$id")
+expect "program-id" $? 0 "$response" '"status": "halted"' '"cached": true' '"sum": 15'
+
+response=$("$MINICPU" --client="$socket" --program-id=0000000000000000)
+expect "unknown program-id" $? 1 "$response" '"status": "error"'
+
+# --set gives a symbol its value before the first instruction
+printf 'DEC n\nLDA n\nHLT\n' > "$work/set.sal"
+response=$("$MINICPU" --client="$socket" --set=n=7 "$work/set.sal")
+expect "set" $? 0 "$response" '"status": "halted"' '"a": 7' '"n": 7'
+
+# --max-steps is the budget of the request
+response=$("$MINICPU" --client="$socket" --max-steps=5 tests/test12_loop_1000.sal)
+expect "budget" $? 3 "$response" '"status": "budget"' '"instructions": 5'
+
+# A program that never ends is stopped at its deadline
+printf 'DEC x\nJMP 0\n' > "$work/spin.sal"
+response=$("$MINICPU" --client="$socket" --deadline=100 "$work/spin.sal")
+expect "deadline" $? 3 "$response" '"status": "deadline"'
+
+# The server stops on SIGTERM
+kill $server
+wait $server
+code=$?
+if [ "$code" != 0 ]; then
+    echo "FAIL stop: server exit code $code"
+    cat "$work/server.log"
+    failed=1
+else
+    echo "ok   stop"
+fi
+
+exit $failed
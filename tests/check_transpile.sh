@@ -0,0 +1,38 @@
+#!/bin/bash
+# Checks the transpiler against the interpreter: every test program is
+# written as C++ with --transpile, built with its main and run, and its output
+# and exit code compared with those of "minicpu FILE".
+# Run from the project directory: tests/check_transpile.sh [path to minicpu]
+
+MINICPU=${1:-./minicpu}
+CXX=${CXX:-g++}
+failed=0
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+for file in tests/*.sal; do
+    name=$(basename "$file" .sal)
+
+    expected=$("$MINICPU" "$file" 2>&1)
+    expectedCode=$?
+
+    if ! "$MINICPU" --transpile="$work/$name.cpp" "$file" ||
+       ! "$CXX" -std=c++11 -O2 -DMINICPU_TRANSPILED_MAIN "$work/$name.cpp" -o "$work/$name"; then
+        echo "FAIL $name: could not transpile and build it"
+        failed=1
+        continue
+    fi
+
+    output=$("$work/$name" 2>&1)
+    code=$?
+    if [ "$code" != "$expectedCode" ] || [ "$output" != "$expected" ]; then
+        echo "FAIL $name: exit code $code, expected $expectedCode"
+        diff <(echo "$expected") <(echo "$output")
+        failed=1
+    else
+        echo "ok   $name"
+    fi
+done
+
+exit $failed
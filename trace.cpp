@@ -0,0 +1,185 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iomanip>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+#include "trace.h"
+
+using namespace std;
+
+//
+// Start of TraceLevel definitions
+//
+// Converts "none", "final", "summary" or "full" to the trace level
+bool parseTraceLevel(const string& name, TraceLevel& level) {
+    if (name == "none") {
+        level = TRACE_NONE;
+    } else if (name == "final") {
+        level = TRACE_FINAL;
+    } else if (name == "summary") {
+        level = TRACE_SUMMARY;
+    } else if (name == "full") {
+        level = TRACE_FULL;
+    } else {
+        return false;
+    }
+    return true;
+}
+//
+// End of TraceLevel definitions
+//
+
+
+
+//
+// Start of OutputBuffer definitions
+//
+OutputBuffer::OutputBuffer(FILE* file, size_t size) : file(file), data(size) {
+    setp(data.data(), data.data() + data.size());
+}
+
+OutputBuffer::~OutputBuffer() {
+    flushData();
+    fflush(file);
+}
+
+// Called when the block is full
+OutputBuffer::int_type OutputBuffer::overflow(int_type c) {
+    if (!flushData()) {
+        return traits_type::eof();
+    }
+
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+// Copies whole strings into the block instead of going character by character
+streamsize OutputBuffer::xsputn(const char* s, streamsize count) {
+    streamsize written = 0;
+
+    while (written < count) {
+        streamsize room = epptr() - pptr();
+        if (room == 0) {
+            if (!flushData()) {
+                break;
+            }
+            room = epptr() - pptr();
+        }
+
+        streamsize chunk = min(room, count - written);
+        memcpy(pptr(), s + written, (size_t) chunk);
+        pbump((int) chunk);
+        written += chunk;
+    }
+
+    return written;
+}
+
+int OutputBuffer::sync() {
+    if (!flushData()) {
+        return -1;
+    }
+    return fflush(file) == 0 ? 0 : -1;
+}
+
+// Writes the pending output to the file
+bool OutputBuffer::flushData() {
+    size_t pending = (size_t) (pptr() - pbase());
+    bool ok = pending == 0 || fwrite(pbase(), 1, pending, file) == pending;
+
+    setp(data.data(), data.data() + data.size());
+    return ok;
+}
+//
+// End of OutputBuffer definitions
+//
+
+
+
+//
+// Start of trace hook definitions
+//
+SummaryTrace::SummaryTrace(ostream& stream, const Program& program) : out(stream) {
+    lines.resize(program.code.size());
+
+    for (size_t pc = 0; pc < program.code.size(); pc++) {
+        string line = to_string(pc) + ": " + opcodeName(program.code[pc].opcode);
+
+        // Operand text without the spaces the loader keeps in front of jump targets
+        const string& arg = program.argText[pc];
+        if (arg != "N/A") {
+            size_t start = arg.find_first_not_of(' ');
+            if (start != string::npos) {
+                line += " " + arg.substr(start);
+            }
+        }
+
+        lines[pc] = line;
+    }
+}
+//
+// End of trace hook definitions
+//
+
+// Prints how the run ended, how many instructions were executed and the final
+// registers, bits and symbols
+void printFinalState(ostream& out, const Hardware& hw, ExecStatus status, long long executed) {
+    static const char* const names[] = { "halted", "budget exhausted", "fault", "stopped" };
+
+    out << "Status: " << names[status] << '\n';
+    out << "Instructions executed: " << executed << '\n';
+    out << "Program counter: " << hw.pc << '\n';
+    hw.dumpState(out);
+}
+
+
+
+//
+// Start of result formatting definitions
+//
+// Short name of the status in CSV and JSON results
+const char* statusName(ExecStatus status) {
+    static const char* const names[] = { "halted", "budget", "fault", "stopped" };
+    return names[status];
+}
+
+// Writes the text as a JSON string
+void writeJsonString(ostream& out, const string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if ((unsigned char) c < 0x20) {
+            out << "\\u" << hex << setw(4) << setfill('0') << (int) c << dec << setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Writes the text as a CSV field
+void writeCsvField(ostream& out, const string& text) {
+    if (text.find_first_of(",\"\r\n") == string::npos) {
+        out << text;
+        return;
+    }
+    out << '"';
+    for (char c : text) {
+        if (c == '"') {
+            out << '"';
+        }
+        out << c;
+    }
+    out << '"';
+}
+//
+// End of result formatting definitions
+//
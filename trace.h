@@ -0,0 +1,164 @@
+//
+// Created by Michal
+//
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <streambuf>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+
+#ifndef MINICPU_TRACE_H
+#define MINICPU_TRACE_H
+
+//
+// Start of TraceLevel
+//
+// How much the headless run mode prints
+enum TraceLevel {
+    TRACE_NONE,     // Nothing, only the exit code tells what happened
+    TRACE_FINAL,    // The final state once the program stops
+    TRACE_SUMMARY,  // One line per instruction plus the final state
+    TRACE_FULL      // The full state after every instruction (same as the s and a commands)
+};
+
+// Converts "none", "final", "summary" or "full" to the trace level.
+// Returns false if the name is not one of those.
+bool parseTraceLevel(const std::string& name, TraceLevel& level);
+//
+// End of TraceLevel
+//
+
+
+
+//
+// Start of OutputBuffer
+//
+class OutputBuffer : public std::streambuf {
+    // Stream buffer that collects output in a large block and writes it with a
+    // single fwrite when the block is full, so traces are not written (and
+    // flushed) one line at a time. Use it through an std::ostream.
+public:
+    explicit OutputBuffer(FILE* file, size_t size = 1 << 16);
+    ~OutputBuffer() override;
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize count) override;
+    int sync() override;
+
+private:
+    FILE* file;              // Where the output finally goes
+    std::vector<char> data;  // Pending output
+
+    // Writes the pending output to the file
+    bool flushData();
+};
+//
+// End of OutputBuffer
+//
+
+
+
+//
+// Start of trace hooks
+//
+struct DumpTrace {
+    // Prints the full state after every instruction, exactly like Instruction::print()
+    static const bool enabled = true;
+    static const bool backEdges = false;  // Sees every instruction anyway
+    std::ostream& out;
+
+    explicit DumpTrace(std::ostream& stream) : out(stream) {}
+
+    void step(const Hardware& hw, const Program& program, int pc) {
+        hw.dump(out, opcodeName(program.code[pc].opcode), program.argText[pc]);
+    }
+
+    bool backEdge(const Hardware&, const Program&, long long) { return true; }
+};
+
+struct SummaryTrace {
+    // Prints one line per instruction: pc, instruction, registers and bits
+    static const bool enabled = true;
+    static const bool backEdges = false;  // Sees every instruction anyway
+    std::ostream& out;
+    std::vector<std::string> lines;  // "pc: NAME arg" prefix of every line, built once
+
+    SummaryTrace(std::ostream& stream, const Program& program);
+
+    void step(const Hardware& hw, const Program&, int pc) {
+        // Formatted by hand, ostream number formatting costs more than the run itself
+        char line[96];
+        char* end = line;
+        end = appendText(end, " A=");
+        end = appendNumber(end, hw.a);
+        end = appendText(end, " B=");
+        end = appendNumber(end, hw.b);
+        end = appendText(end, " V=");
+        *end++ = (char) ('0' + hw.overflow_bit);
+        end = appendText(end, " Z=");
+        *end++ = (char) ('0' + hw.zero_bit);
+        *end++ = '\n';
+
+        out.write(lines[pc].data(), (std::streamsize) lines[pc].size());
+        out.write(line, end - line);
+    }
+
+    static char* appendText(char* end, const char* text) {
+        while (*text != '\0') {
+            *end++ = *text++;
+        }
+        return end;
+    }
+
+    static char* appendNumber(char* end, long long value) {
+        char digits[24];
+        int count = 0;
+        unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long) value : (unsigned long long) value;
+
+        do {
+            digits[count++] = (char) ('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+
+        if (value < 0) {
+            *end++ = '-';
+        }
+        while (count > 0) {
+            *end++ = digits[--count];
+        }
+        return end;
+    }
+
+    bool backEdge(const Hardware&, const Program&, long long) { return true; }
+};
+//
+// End of trace hooks
+//
+
+// Prints how the run ended, how many instructions were executed and the final
+// registers, bits and symbols
+void printFinalState(std::ostream& out, const Hardware& hw, ExecStatus status, long long executed);
+
+
+
+//
+// Start of result formatting
+//
+// Short name of the status in CSV and JSON results: halted, budget, fault or stopped
+const char* statusName(ExecStatus status);
+
+// Writes the text as a JSON string
+void writeJsonString(std::ostream& out, const std::string& text);
+
+// Writes the text as a CSV field, quoted if it holds a comma, quote or line break
+void writeCsvField(std::ostream& out, const std::string& text);
+//
+// End of result formatting
+//
+
+#endif //MINICPU_TRACE_H
@@ -0,0 +1,268 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <ostream>
+#include "hardware.h"
+#include "bytecode.h"
+#include "tracefile.h"
+
+using namespace std;
+
+//
+// Start of trace file helpers
+//
+static const char traceMagic[8] = "MCTRACE";
+
+// Appends the bytes of a fixed size value to the header
+template <typename T>
+static void putValue(string& header, T value) {
+    header.append((const char*) &value, sizeof(value));
+}
+
+// Appends a string as its length followed by its bytes
+static void putString(string& header, const string& text) {
+    putValue(header, (uint32_t) text.size());
+    header += text;
+}
+
+// Reads a fixed size value, returns false at the end of the file
+template <typename T>
+static bool getValue(istream& in, T& value) {
+    return (bool) in.read((char*) &value, sizeof(value));
+}
+
+// Reads a string written by putString
+static bool getString(istream& in, string& text) {
+    uint32_t size;
+    if (!getValue(in, size) || size > (1u << 20)) {
+        return false;
+    }
+    text.resize(size);
+    return size == 0 || (bool) in.read(&text[0], size);
+}
+//
+// End of trace file helpers
+//
+
+
+
+//
+// Start of TraceWriter definitions
+//
+TraceWriter::~TraceWriter() {
+    string error;
+    close(error);
+}
+
+// Creates the file and writes the header
+bool TraceWriter::open(const string& filename, const Hardware& hw, const Program& program, string& error) {
+    file = fopen(filename.c_str(), "wb");
+    if (file == nullptr) {
+        error = "could not create " + filename;
+        return false;
+    }
+
+    string header(traceMagic, sizeof(traceMagic));
+    putValue(header, traceVersion);
+    putValue(header, (uint32_t) sizeof(TraceRecord));
+
+    // The program, so the decoder can print every instruction as it was written
+    putValue(header, (uint32_t) program.code.size());
+    for (size_t pc = 0; pc < program.code.size(); pc++) {
+        putValue(header, (int32_t) program.code[pc].opcode);
+        putString(header, program.argText[pc]);
+    }
+
+    // Every symbol with its address and current value
+    putValue(header, (uint32_t) program.symbols.size());
+    for (size_t i = 0; i < program.symbols.size(); i++) {
+        int address = program.addresses[i];
+        putString(header, program.symbols[i]);
+        putValue(header, (int32_t) address);
+        putValue(header, (uint8_t) hw.symbol_table.count(program.symbols[i]));
+        putValue(header, (int64_t) (address >= 0 ? hw.value_memory[address] : 0));
+    }
+
+    // Where the run starts
+    putValue(header, (int64_t) hw.a);
+    putValue(header, (int64_t) hw.b);
+    putValue(header, (uint8_t) (hw.zero_bit | hw.overflow_bit << 1));
+    putValue(header, (int32_t) hw.pc);
+
+    if (fwrite(header.data(), 1, header.size(), file) != header.size()) {
+        failed = true;
+    }
+
+    block.resize(1 << 15);
+    used = 0;
+    return true;
+}
+
+// Writes the pending records to the file
+void TraceWriter::flushBlock() {
+    if (used > 0 && fwrite(block.data(), sizeof(TraceRecord), used, file) != used) {
+        failed = true;
+    }
+    used = 0;
+}
+
+// Writes everything still pending and closes the file
+bool TraceWriter::close(string& error) {
+    if (file == nullptr) {
+        return true;
+    }
+
+    flushBlock();
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+    file = nullptr;
+
+    if (failed) {
+        error = "could not write the trace file";
+        return false;
+    }
+    return true;
+}
+//
+// End of TraceWriter definitions
+//
+
+
+
+//
+// Start of trace decoder definitions
+//
+// Prints count records of the trace file starting with record first
+bool decodeTrace(const string& filename, long long first, long long count, ostream& out, string& error) {
+    ifstream in(filename, ios::binary);
+    if (!in.is_open()) {
+        error = "could not open " + filename;
+        return false;
+    }
+
+    char magic[sizeof(traceMagic)];
+    uint32_t version, recordSize;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, traceMagic, sizeof(magic)) != 0 ||
+        !getValue(in, version) || !getValue(in, recordSize)) {
+        error = "not a MiniCPU trace file";
+        return false;
+    }
+    if (version != traceVersion || recordSize != sizeof(TraceRecord)) {
+        error = "unsupported trace file version " + to_string(version);
+        return false;
+    }
+
+    // Program text, indexed by pc
+    uint32_t size;
+    if (!getValue(in, size)) {
+        error = "trace file is truncated";
+        return false;
+    }
+    vector<string> argText(size);
+    for (uint32_t pc = 0; pc < size; pc++) {
+        int32_t opcode;
+        if (!getValue(in, opcode) || !getString(in, argText[pc])) {
+            error = "trace file is truncated";
+            return false;
+        }
+    }
+
+    // Symbols and the state before the first record. Only the symbol
+    // addresses are ever stored to, so memory ends at the highest of them.
+    uint32_t symbols;
+    if (!getValue(in, symbols)) {
+        error = "trace file is truncated";
+        return false;
+    }
+    vector<string> symbolNames(symbols);
+    vector<int32_t> addresses(symbols);
+    vector<uint8_t> declared(symbols);
+    vector<int64_t> values(symbols);
+    int memorySize = 1;
+    for (uint32_t i = 0; i < symbols; i++) {
+        if (!getString(in, symbolNames[i]) || !getValue(in, addresses[i]) ||
+            !getValue(in, declared[i]) || !getValue(in, values[i])) {
+            error = "trace file is truncated";
+            return false;
+        }
+        if (addresses[i] >= Hardware::maximumMemorySize) {
+            error = "trace file symbols are damaged";
+            return false;
+        }
+        memorySize = max(memorySize, addresses[i] + 1);
+    }
+
+    Hardware hw(memorySize);
+    map<int, string> names;  // Symbol name of every address, for DEC
+    for (uint32_t i = 0; i < symbols; i++) {
+        int address = addresses[i];
+        if (address < 0) {
+            continue;
+        }
+
+        names[address] = symbolNames[i];
+        hw.value_memory[address] = values[i];
+        if (declared[i] != 0) {
+            hw.symbol_table[symbolNames[i]] = address;
+        }
+    }
+
+    int64_t a, b;
+    uint8_t bits;
+    int32_t pc;
+    if (!getValue(in, a) || !getValue(in, b) || !getValue(in, bits) || !getValue(in, pc)) {
+        error = "trace file is truncated";
+        return false;
+    }
+    hw.a = a;
+    hw.b = b;
+    hw.zero_bit = bits & 1;
+    hw.overflow_bit = bits >> 1 & 1;
+    hw.pc = pc;
+
+    // Replay every record up to the range, print the ones in it
+    vector<TraceRecord> block(1 << 15);
+    long long index = 0;
+    const long long last = count > LLONG_MAX - first ? LLONG_MAX : first + count;
+
+    while (index < last) {
+        in.read((char*) block.data(), (streamsize) (block.size() * sizeof(TraceRecord)));
+        size_t records = (size_t) in.gcount() / sizeof(TraceRecord);
+        if (records == 0) {
+            break;
+        }
+
+        for (size_t i = 0; i < records && index < last; i++, index++) {
+            const TraceRecord& record = block[i];
+
+            hw.a = record.a;
+            hw.b = record.b;
+            hw.zero_bit = record.bits & 1;
+            hw.overflow_bit = record.bits >> 1 & 1;
+            if (record.slot >= 0 && record.slot < memorySize) {
+                if (record.opcode == OP_STR) {
+                    hw.value_memory[record.slot] = record.a;
+                } else if (record.opcode == OP_DEC) {
+                    hw.symbol_table[names[record.slot]] = record.slot;
+                }
+            }
+
+            if (index >= first) {
+                const string& arg = record.pc >= 0 && (uint32_t) record.pc < size ? argText[record.pc] : "N/A";
+                hw.dump(out, opcodeName(record.opcode), arg);
+            }
+        }
+    }
+
+    return true;
+}
+//
+// End of trace decoder definitions
+//
@@ -0,0 +1,122 @@
+//
+// Created by Michal
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "hardware.h"
+#include "bytecode.h"
+#include "engine.h"
+
+#ifndef MINICPU_TRACEFILE_H
+#define MINICPU_TRACEFILE_H
+
+//
+// Start of TraceRecord
+//
+// Binary trace file (--record=FILE), in the byte order of the machine:
+//     "MCTRACE" magic (8 bytes with the terminating 0), version, record size
+//     the program: instruction count, then opcode and operand text of every pc
+//     the symbols: count, then name, address, declared flag and value of each
+//     the starting registers, bits and pc
+//     one TraceRecord per executed instruction, until the end of the file
+const uint32_t traceVersion = 1;
+
+struct TraceRecord {
+    // State right after one instruction was executed
+    int64_t a;        // Register A
+    int64_t b;        // Register B
+    int32_t pc;       // pc of the instruction
+    int32_t slot;     // value_memory address stored to (STR) or declared (DEC), -1 if none
+    uint8_t opcode;   // Opcode of the instruction
+    uint8_t bits;     // Zero bit in bit 0, overflow bit in bit 1
+    uint8_t unused[6];
+};
+//
+// End of TraceRecord
+//
+
+
+
+//
+// Start of TraceWriter
+//
+class TraceWriter {
+    // Writes the header and then collects records in a large block that is
+    // written with one fwrite when it is full
+public:
+    TraceWriter() = default;
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    // Creates the file and writes the header for the program and the current
+    // state of the hardware. Returns false and sets error if it cannot be written.
+    bool open(const std::string& filename, const Hardware& hw, const Program& program, std::string& error);
+
+    // Writes everything still pending and closes the file.
+    // Returns false and sets error if any write failed.
+    bool close(std::string& error);
+
+    // Record for the next instruction
+    TraceRecord& next() {
+        if (used == block.size()) {
+            flushBlock();
+        }
+        return block[used++];
+    }
+
+private:
+    FILE* file = nullptr;
+    std::vector<TraceRecord> block;  // Pending records
+    size_t used = 0;                 // Records of block in use
+    bool failed = false;             // A write failed
+
+    // Writes the pending records to the file
+    void flushBlock();
+};
+
+struct RecordTrace {
+    // Trace hook that writes one binary record per instruction
+    static const bool enabled = true;
+    static const bool backEdges = false;  // Sees every instruction anyway
+    TraceWriter& writer;
+
+    explicit RecordTrace(TraceWriter& output) : writer(output) {}
+
+    void step(const Hardware& hw, const Program& program, int pc) {
+        const DecodedInstruction& instruction = program.code[pc];
+        TraceRecord& record = writer.next();
+
+        record.a = hw.a;
+        record.b = hw.b;
+        record.pc = pc;
+        record.opcode = (uint8_t) instruction.opcode;
+        record.bits = (uint8_t) (hw.zero_bit | hw.overflow_bit << 1);
+
+        if (instruction.opcode == OP_STR) {
+            record.slot = instruction.operand;
+        } else if (instruction.opcode == OP_DEC) {
+            record.slot = program.addresses[instruction.operand];
+        } else {
+            record.slot = -1;
+        }
+    }
+
+    bool backEdge(const Hardware&, const Program&, long long) { return true; }
+};
+//
+// End of TraceWriter
+//
+
+// Prints count records of the trace file starting with record first in the
+// same format as the s and a commands (and --trace=full). The state before
+// first is rebuilt by replaying the records before it.
+// Returns false and sets error if the file cannot be read.
+bool decodeTrace(const std::string& filename, long long first, long long count, std::ostream& out, std::string& error);
+
+#endif //MINICPU_TRACEFILE_H
@@ -0,0 +1,293 @@
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "bytecode.h"
+#include "transpile.h"
+
+using namespace std;
+
+//
+// Start of transpiler helpers
+//
+// C identifier made from the file name without directories and extension
+static string functionName(const string& source) {
+    size_t slash = source.find_last_of("/\\");
+    string name = slash == string::npos ? source : source.substr(slash + 1);
+    size_t dot = name.find('.');
+    if (dot != string::npos && dot > 0) {
+        name = name.substr(0, dot);
+    }
+
+    string result = "sal_";
+    for (char c : name) {
+        result += isalnum((unsigned char) c) ? c : '_';
+    }
+    return result;
+}
+
+// The text as a C string literal (symbol names may hold any byte)
+static string stringLiteral(const string& text) {
+    string result = "\"";
+    for (char c : text) {
+        unsigned char byte = (unsigned char) c;
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (byte < 0x20 || byte >= 0x7f) {
+            // Octal, so a following digit cannot become part of the escape
+            result += '\\';
+            result += (char) ('0' + (byte >> 6));
+            result += (char) ('0' + (byte >> 3 & 7));
+            result += (char) ('0' + (byte & 7));
+        } else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+// The text for a // comment. A backslash at the end would swallow the next
+// line, so only plain characters are kept.
+static string commentText(string text) {
+    for (char& c : text) {
+        if ((unsigned char) c < 0x20 || (unsigned char) c >= 0x7f || c == '\\') {
+            c = '?';
+        }
+    }
+    return text;
+}
+
+// The instruction as it was written, for a comment
+static string instructionText(const Program& program, int pc) {
+    string text = opcodeName(program.code[pc].opcode);
+    string operand = program.argText[pc];
+    if (operand != "N/A") {
+        if (operand.empty() || operand[0] != ' ') {
+            text += ' ';
+        }
+        text += operand;
+    }
+    return commentText(text);
+}
+//
+// End of transpiler helpers
+//
+
+
+
+//
+// Start of transpiler definitions
+//
+bool writeTranspiled(const string& path, const string& source, const Program& program, string& error) {
+    const string name = functionName(source);
+    const int symbols = (int) program.symbols.size();
+    const int arrays = max(symbols, 1);  // Arrays cannot be empty
+
+    // LDA/LDB/STR hold value_memory addresses, the generated code indexes
+    // its own array by symbol id
+    unordered_map<int, int> symbolAt;
+    for (int symbol = 0; symbol < symbols; symbol++) {
+        symbolAt[program.addresses[symbol]] = symbol;
+    }
+
+    ostringstream out;
+    out << "// Generated by minicpu --transpile from " << commentText(source) << "\n"
+        << "// " << name << "(state, budget) runs the program from state.pc for at most budget\n"
+        << "// instructions and returns 0 (halted), 1 (budget used up) or 2 (ran into an\n"
+        << "// empty slot), like the minicpu engines.\n"
+        << "\n"
+        << "#ifndef " << name << "_H\n"
+        << "#define " << name << "_H\n"
+        << "\n"
+        << "struct " << name << "_state {\n"
+        << "    long long a = 0;\n"
+        << "    long long b = 0;\n"
+        << "    int zero_bit = 0;\n"
+        << "    int overflow_bit = 0;\n"
+        << "    int pc = 0;\n"
+        << "    long long executed = 0;\n"
+        << "    long long memory[" << arrays << "] = {};  // Value of every symbol\n"
+        << "    bool declared[" << arrays << "] = {};     // Its DEC has run\n"
+        << "};\n"
+        << "\n"
+        << "static const int " << name << "_symbol_count = " << symbols << ";\n"
+        << "static const char* const " << name << "_symbols[" << arrays << "] = {";
+    for (int symbol = 0; symbol < symbols; symbol++) {
+        out << (symbol > 0 ? ", " : "") << stringLiteral(program.symbols[symbol]);
+    }
+    if (symbols == 0) {
+        out << "\"\"";
+    }
+    out << "};\n"
+        << "\n"
+        << "inline int " << name << "(" << name << "_state& state, long long budget) {\n"
+        << "    long long a = state.a;\n"
+        << "    long long b = state.b;\n"
+        << "    int zero = state.zero_bit;\n"
+        << "    int overflow = state.overflow_bit;\n"
+        << "    long long* const memory = state.memory;\n"
+        << "    long long left = budget;\n"
+        << "    long long result = 0;\n"
+        << "    int status = 1;\n"
+        << "    int pc = state.pc;\n"
+        << "    (void) memory;\n"
+        << "    (void) result;\n"
+        << "\n"
+        << "    switch (pc) {\n";
+    for (int pc = 0; pc <= program.length; pc++) {
+        out << "        case " << pc << ": goto pc" << pc << ";\n";
+    }
+    out << "        default: status = 2; goto done;\n"
+        << "    }\n";
+
+    for (int pc = 0; pc <= program.length; pc++) {
+        const DecodedInstruction& instruction = program.code[pc];
+        const int opcode = instruction.opcode;
+        out << "\n";
+        if (opcode == OP_NONE) {
+            // An empty slot stops the run even when the budget is used up
+            out << "pc" << pc << ":\n"
+                << "    pc = " << pc << ";\n"
+                << "    status = 2;\n"
+                << "    goto done;\n";
+            continue;
+        }
+
+        out << "pc" << pc << ":  // " << instructionText(program, pc) << "\n"
+            << "    if (left == 0) { pc = " << pc << "; goto done; }\n"
+            << "    left--;\n";
+        int symbol = -1;
+        if (opcode == OP_DEC) {
+            symbol = instruction.operand;
+        } else if (opcode == OP_LDA || opcode == OP_LDB || opcode == OP_STR) {
+            symbol = symbolAt[instruction.operand];
+        }
+        switch (opcode) {
+            case OP_DEC:
+                out << "    state.declared[" << symbol << "] = true;\n";
+                break;
+            case OP_LDA:
+                out << "    a = memory[" << symbol << "];\n";
+                break;
+            case OP_LDB:
+                out << "    b = memory[" << symbol << "];\n";
+                break;
+            case OP_LDI:
+                out << "    a = " << instruction.operand << ";\n";
+                break;
+            case OP_STR:
+                out << "    memory[" << symbol << "] = a;\n";
+                break;
+            case OP_XCH:
+                out << "    result = a; a = b; b = result;\n";
+                break;
+            case OP_ADD:
+                // The rules of ADD::execute: out of range only sets the
+                // overflow bit, zero keeps it
+                out << "    result = a + b;\n"
+                    << "    if (result <= -2147483648LL || result >= 2147483647LL) {\n"
+                    << "        overflow = 1;\n"
+                    << "    } else if (result == 0) {\n"
+                    << "        a = 0;\n"
+                    << "        zero = 1;\n"
+                    << "    } else {\n"
+                    << "        a = result;\n"
+                    << "        zero = 0;\n"
+                    << "        overflow = 0;\n"
+                    << "    }\n";
+                break;
+            case OP_JMP:
+                out << "    goto pc" << instruction.operand << ";\n";
+                break;
+            case OP_JZS:
+                out << "    if (zero != 0) goto pc" << instruction.operand << ";\n";
+                break;
+            case OP_JVS:
+                out << "    if (overflow != 0) goto pc" << instruction.operand << ";\n";
+                break;
+            case OP_HLT:
+                out << "    pc = " << pc << ";\n"
+                    << "    status = 0;\n"
+                    << "    goto done;\n";
+                break;
+            default:
+                break;
+        }
+    }
+
+    out << "\n"
+        << "done:\n"
+        << "    state.a = a;\n"
+        << "    state.b = b;\n"
+        << "    state.zero_bit = zero;\n"
+        << "    state.overflow_bit = overflow;\n"
+        << "    state.pc = pc;\n"
+        << "    state.executed += budget - left;\n"
+        << "    return status;\n"
+        << "}\n"
+        << "\n"
+        << "#endif // " << name << "_H\n";
+
+    // The final state printed like printFinalState, symbols sorted by name
+    vector<int> order(symbols);
+    for (int symbol = 0; symbol < symbols; symbol++) {
+        order[symbol] = symbol;
+    }
+    sort(order.begin(), order.end(), [&](int x, int y) { return program.symbols[x] < program.symbols[y]; });
+
+    out << "\n"
+        << "#ifdef MINICPU_TRANSPILED_MAIN\n"
+        << "#include <climits>\n"
+        << "#include <cstdio>\n"
+        << "\n"
+        << "#ifndef MINICPU_TRANSPILED_STEPS\n"
+        << "#define MINICPU_TRANSPILED_STEPS LLONG_MAX\n"
+        << "#endif\n"
+        << "\n"
+        << "int main() {\n"
+        << "    static const char* const names[] = { \"halted\", \"budget exhausted\", \"fault\" };\n"
+        << "    static const int order[" << arrays << "] = {";
+    for (int i = 0; i < symbols; i++) {
+        out << (i > 0 ? ", " : "") << order[i];
+    }
+    if (symbols == 0) {
+        out << "0";
+    }
+    out << "};\n"
+        << "    " << name << "_state state;\n"
+        << "    int status = " << name << "(state, MINICPU_TRANSPILED_STEPS);\n"
+        << "\n"
+        << "    printf(\"Status: %s\\n\", names[status]);\n"
+        << "    printf(\"Instructions executed: %lld\\n\", state.executed);\n"
+        << "    printf(\"Program counter: %d\\n\", state.pc);\n"
+        << "    printf(\"Register A: %lld\\n\", state.a);\n"
+        << "    printf(\"Register B: %lld\\n\", state.b);\n"
+        << "    printf(\"Overflow bit: %d\\n\", state.overflow_bit);\n"
+        << "    printf(\"Zero bit: %d\\n\", state.zero_bit);\n"
+        << "    printf(\"Symbols and values: \\n\");\n"
+        << "    for (int i = 0; i < " << name << "_symbol_count; i++) {\n"
+        << "        if (state.declared[order[i]]) {\n"
+        << "            printf(\"%s: %lld\\n\", " << name << "_symbols[order[i]], state.memory[order[i]]);\n"
+        << "        }\n"
+        << "    }\n"
+        << "    printf(\"\\n\");\n"
+        << "    return status == 0 ? 0 : status == 2 ? 2 : 3;\n"
+        << "}\n"
+        << "#endif\n";
+
+    ofstream file(path, ios::binary);
+    file << out.str();
+    file.close();
+    if (!file) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+//
+// End of transpiler definitions
+//
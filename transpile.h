@@ -0,0 +1,36 @@
+//
+// Created by Michal
+//
+
+#include <string>
+
+#ifndef MINICPU_TRANSPILE_H
+#define MINICPU_TRANSPILE_H
+
+class Program;
+
+//
+// Start of transpiler
+//
+// Writes the linked program to path as C++ source (C++11) with one function
+// that runs it, for programs that are part of a build. For a program in
+// loop.sal the file has
+//     struct sal_loop_state      registers, bits, pc, executed and the
+//                                symbols' values (memory) and DEC flags
+//     sal_loop_symbols           name of every symbol, by memory index
+//     int sal_loop(sal_loop_state& state, long long budget)
+// Every instruction is a label and every jump a goto, so the optimizing
+// compiler sees the whole control flow. The function goes on from
+// state.pc, runs at most budget instructions and returns the ExecStatus
+// (0 halted, 1 budget used up, 2 ran into an empty slot), with exactly the
+// results of the engines. Compiled with -DMINICPU_TRANSPILED_MAIN the file
+// also has a main() that runs it and prints the final state like minicpu
+// (-DMINICPU_TRANSPILED_STEPS=N for a budget). Returns false and sets error
+// if the file cannot be written.
+bool writeTranspiled(const std::string& path, const std::string& source, const Program& program,
+                     std::string& error);
+//
+// End of transpiler
+//
+
+#endif //MINICPU_TRANSPILE_H
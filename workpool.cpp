@@ -0,0 +1,86 @@
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "workpool.h"
+
+using namespace std;
+
+//
+// Start of WorkPool definitions
+//
+WorkPool::WorkPool(int count) : threads(count) {
+    if (threads <= 0) {
+        threads = (int) thread::hardware_concurrency();
+    }
+    if (threads <= 0) {
+        threads = 1;  // The number of cores is not known
+    }
+}
+
+// Calls task(worker, index) for every index in [0, count)
+void WorkPool::run(size_t count, const function<void(int, size_t)>& task) {
+    // No more workers than tasks
+    const int workers = (int) min((size_t) threads, count);
+    if (workers == 0) {
+        return;
+    }
+
+    vector<unique_ptr<Queue>> queues;
+    for (int worker = 0; worker < workers; worker++) {
+        queues.emplace_back(new Queue());
+    }
+    for (size_t index = 0; index < count; index++) {
+        queues[index % workers]->tasks.push_back(index);
+    }
+
+    // No task is ever added while the workers run, so a worker that finds
+    // every queue empty is done
+    auto work = [&](int worker) {
+        size_t index;
+        while (take(queues, worker, index)) {
+            task(worker, index);
+        }
+    };
+
+    vector<thread> pool;
+    for (int worker = 1; worker < workers; worker++) {
+        pool.emplace_back(work, worker);
+    }
+    work(0);
+    for (thread& t : pool) {
+        t.join();
+    }
+}
+
+// Next task for the worker
+bool WorkPool::take(vector<unique_ptr<Queue>>& queues, int worker, size_t& index) {
+    {
+        Queue& own = *queues[worker];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            index = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Steal the last task of the next worker that still has some
+    const int workers = (int) queues.size();
+    for (int i = 1; i < workers; i++) {
+        Queue& victim = *queues[(worker + i) % workers];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+//
+// End of WorkPool definitions
+//
@@ -0,0 +1,54 @@
+//
+// Created by Michal
+//
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef MINICPU_WORKPOOL_H
+#define MINICPU_WORKPOOL_H
+
+//
+// Start of WorkPool
+//
+class WorkPool {
+    // Runs many independent tasks on several threads. Every worker has its own
+    // queue of task numbers, dealt out round robin up front. A worker takes
+    // its tasks in ascending order from the front of its queue and, once the
+    // queue is empty, steals from the back of another worker's queue, so a
+    // worker that drew the long tasks does not hold up the others and the
+    // early tasks (whose results are needed first) finish first.
+public:
+    // threads workers, 0 for one per core
+    explicit WorkPool(int threads = 0);
+
+    // Number of workers
+    int size() const { return threads; }
+
+    // Calls task(worker, index) for every index in [0, count) and returns once
+    // all calls have returned. worker (0 .. size() - 1) tells which worker
+    // makes the call, so tasks can use per worker state without locking. The
+    // calling thread is worker 0.
+    void run(size_t count, const std::function<void(int worker, size_t index)>& task);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    int threads;  // Number of workers
+
+    // Next task for the worker: its own first, otherwise a stolen one.
+    // Returns false once every queue is empty.
+    static bool take(std::vector<std::unique_ptr<Queue>>& queues, int worker, size_t& index);
+};
+//
+// End of WorkPool
+//
+
+#endif //MINICPU_WORKPOOL_H